@@ -2,10 +2,12 @@
 #include "../../lib/AI_Base.h"
 #include "BattleAI.h"
 #include "../../lib/BattleState.h"
+#include "../../lib/NetPacks.h"
 #include "../../CCallback.h"
 #include "../../lib/CCreatureHandler.h"
 #include "../../lib/CSpellHandler.h"
 #include "../../lib/VCMI_Lib.h"
+#include "../../lib/CThreadHelper.h"
 
 using boost::optional;
 shared_ptr<CBattleCallback> cbc;
@@ -385,6 +387,36 @@ struct CurrentOffensivePotential
 // 	}
 // }
 
+//calls func(i) for every i in [0, count) on shared thread pool (limited by its thread cap), func may only read the battle
+template<typename Func>
+static void parallelFor(size_t count, Func func)
+{
+	const int threads = std::min<int>(count, CThreadPool::get().getMaxThreads());
+	std::string error;
+	boost::mutex errorMx;
+	std::vector<Task> tasks;
+	for(int t = 0; t < threads; t++)
+	{
+		tasks.push_back([&, t]
+		{
+			try
+			{
+				for(size_t i = t; i < count; i += threads)
+					func(i);
+			}
+			catch(std::exception &e)
+			{
+				boost::unique_lock<boost::mutex> lock(errorMx);
+				error = e.what();
+			}
+		});
+	}
+	CThreadPool::get().run(tasks);
+
+	if(!error.empty())
+		throw std::runtime_error(error);
+}
+
 void CBattleAI::attemptCastingSpell()
 {
 	LOGL("Casting spells sounds like fun. Let's see...");
@@ -420,12 +452,16 @@ void CBattleAI::attemptCastingSpell()
 	if(possibleCasts.empty())
 		return;
 
-	std::map<const CStack*, int> valueOfStack;
-	for(auto stack : cb->battleGetStacks())
+	const auto stacks = cb->battleGetStacks();
+	std::vector<int> stackValues(stacks.size());
+	parallelFor(stacks.size(), [&](size_t i)
 	{
-		PotentialTargets pt(stack);
-		valueOfStack[stack] = pt.bestActionValue();
-	}
+		stackValues[i] = PotentialTargets(stacks[i]).bestActionValue();
+	});
+
+	std::map<const CStack*, int> valueOfStack; //read by all evaluating threads, must not be changed
+	for(size_t i = 0; i < stacks.size(); i++)
+		valueOfStack[stacks[i]] = stackValues[i];
 
 	auto evaluateSpellcast = [&] (const PossibleSpellcast &ps) -> int
 	{
@@ -466,29 +502,31 @@ void CBattleAI::attemptCastingSpell()
 			}
 		case TIMED_EFFECT:
 			{
-				StackWithBonuses swb;
-				swb.stack = cb->battleGetStackByPos(ps.dest);
-				if(!swb.stack)
+				const CStack *stack = cb->battleGetStackByPos(ps.dest);
+				if(!stack)
 					return -1;
 
 				Bonus pseudoBonus;
 				pseudoBonus.sid = ps.spell->id;
 				pseudoBonus.val = skillLevel;
 				pseudoBonus.turnsRemain = 1; //TODO
-				CStack::stackEffectToFeature(swb.bonusesToAdd, pseudoBonus);
 
-				HypotheticChangesToBattleState state;
-				state.bonusesOfStacks[swb.stack] = &swb;
+				SetStackEffect sse;
+				sse.stacks.push_back(stack->ID);
+				CStack::stackEffectToFeature(sse.effect, pseudoBonus);
 
-				PotentialTargets pt(swb.stack, state);
+				CBattleSnapshot state(cbc.get());
+				state.apply(sse);
+
+				PotentialTargets pt(stack, state);
 				auto newValue = pt.bestActionValue();
-				auto oldValue = valueOfStack[swb.stack];
+				auto oldValue = vstd::contains(valueOfStack, stack) ? valueOfStack.at(stack) : 0;
 				auto gain = newValue - oldValue;
-				if(swb.stack->owner != playerID) //enemy
+				if(stack->owner != playerID) //enemy
 					gain = -gain;
 
 				LOGFL("Casting %s on %s would improve the stack by %d points (from %d to %d)",
-					ps.spell->name % swb.stack->nodeName() % gain % (oldValue) % (newValue));
+					ps.spell->name % stack->nodeName() % gain % (oldValue) % (newValue));
 
 				return gain;
 			}
@@ -498,7 +536,13 @@ void CBattleAI::attemptCastingSpell()
 		}
 	};
 
-	auto castToPerform = *vstd::maxElementByFun(possibleCasts, evaluateSpellcast);
+	std::vector<int> castValues(possibleCasts.size());
+	parallelFor(possibleCasts.size(), [&](size_t i)
+	{
+		castValues[i] = evaluateSpellcast(possibleCasts[i]);
+	});
+
+	auto castToPerform = possibleCasts[boost::max_element(castValues) - castValues.begin()];
 	LOGFL("Best spell is %s. Will cast.", castToPerform.spell->name);
 
 	BattleAction spellcast;
@@ -592,22 +636,6 @@ ThreatMap::ThreatMap(const CStack *Endangered) : endangered(Endangered)
 	}
 }
 
-const TBonusListPtr StackWithBonuses::getAllBonuses(const CSelector &selector, const CSelector &limit, const CBonusSystemNode *root /*= nullptr*/, const std::string &cachingStr /*= ""*/) const 
-{
-	TBonusListPtr ret = make_shared<BonusList>();
-	const TBonusListPtr originalList = stack->getAllBonuses(selector, limit, root, cachingStr);
-	range::copy(*originalList, std::back_inserter(*ret));
-	for(auto &bonus : bonusesToAdd)
-	{
-		if(selector(&bonus)  &&  (!limit || !limit(&bonus)))
-			ret->push_back(&bonus);
-	}
-
-	//TODO limiters?
-
-	return ret;
-}
-
 int AttackPossibility::damageDiff() const
 {
 	const auto dealtDmgValue = priorities.stackEvaluator(enemy) * damageDealt;
@@ -620,13 +648,14 @@ int AttackPossibility::attackValue() const
 	return damageDiff() + tacticImpact;
 }
 
-AttackPossibility AttackPossibility::evaluate(const BattleAttackInfo &AttackInfo, const HypotheticChangesToBattleState &state, BattleHex hex)
+AttackPossibility AttackPossibility::evaluate(const BattleAttackInfo &AttackInfo, const CBattleSnapshot &state, BattleHex hex)
 {
-	auto attacker = AttackInfo.attacker;
 	auto enemy = AttackInfo.defender;
+	auto &attackerState = state.getStack(AttackInfo.attacker);
+	auto &enemyState = state.getStack(enemy);
 
-	const int remainingCounterAttacks = getValOr(state.counterAttacksLeft, enemy, enemy->counterAttacks);
-	const bool counterAttacksBlocked = attacker->hasBonusOfType(Bonus::BLOCKS_RETALIATION) || enemy->hasBonusOfType(Bonus::NO_RETALIATION);
+	const int remainingCounterAttacks = enemyState.counterAttacks;
+	const bool counterAttacksBlocked = attackerState.hasBonusOfType(Bonus::BLOCKS_RETALIATION) || enemyState.hasBonusOfType(Bonus::NO_RETALIATION);
 	const int totalAttacks = 1 + AttackInfo.attackerBonuses->getBonuses(Selector::type(Bonus::ADDITIONAL_ATTACK), (Selector::effectRange (Bonus::NO_LIMIT).Or(Selector::effectRange(Bonus::ONLY_MELEE_FIGHT))))->totalValue();
 
 	AttackPossibility ap = {enemy, hex, AttackInfo, 0, 0, 0};
@@ -642,8 +671,8 @@ AttackPossibility AttackPossibility::evaluate(const BattleAttackInfo &AttackInfo
 		if(remainingCounterAttacks <= i || counterAttacksBlocked)
 			ap.damageReceived = 0;
 
-		curBai.attackerCount = attacker->count - attacker->countKilledByAttack(ap.damageReceived).first;
-		curBai.defenderCount = enemy->count - enemy->countKilledByAttack(ap.damageDealt).first;
+		curBai.attackerCount = attackerState.count - attackerState.countKilledByAttack(ap.damageReceived).first;
+		curBai.defenderCount = enemyState.count - enemyState.countKilledByAttack(ap.damageDealt).first;
 		if(!curBai.attackerCount) 
 			break;
 		//TODO what about defender? should we break? but in pessimistic scenario defender might be alive
@@ -652,47 +681,55 @@ AttackPossibility AttackPossibility::evaluate(const BattleAttackInfo &AttackInfo
 	//TODO other damage related to attack (eg. fire shield and other abilities)
 
 	//Limit damages by total stack health
-	vstd::amin(ap.damageDealt, enemy->count * enemy->MaxHealth() - (enemy->MaxHealth() - enemy->firstHPleft));
-	vstd::amin(ap.damageReceived, attacker->count * attacker->MaxHealth() - (attacker->MaxHealth() - attacker->firstHPleft));
+	vstd::amin(ap.damageDealt, enemyState.count * enemyState.MaxHealth() - (enemyState.MaxHealth() - enemyState.firstHPleft));
+	vstd::amin(ap.damageReceived, attackerState.count * attackerState.MaxHealth() - (attackerState.MaxHealth() - attackerState.firstHPleft));
 
 	return ap;
 }
 
 
-PotentialTargets::PotentialTargets(const CStack *attacker, const HypotheticChangesToBattleState &state /*= HypotheticChangesToBattleState()*/)
+PotentialTargets::PotentialTargets(const CStack *attacker)
+	: PotentialTargets(attacker, CBattleSnapshot(cbc.get()))
 {
-	auto dists = cbc->battleGetDistances(attacker);
-	auto avHexes = cbc->battleGetAvailableHexes(attacker, false);
+}
 
-	for(const CStack *enemy : cbc->battleGetStacks())
+PotentialTargets::PotentialTargets(const CStack *attacker, const CBattleSnapshot &state)
+{
+	const auto reachability = state.getReachability(attacker);
+	const auto avHexes = state.getAvailableHexes(attacker, reachability);
+
+	for(const CStack *enemy : state.getAliveStacks())
 	{
 		//Consider only stacks of different owner
 		if(enemy->attackerOwned == attacker->attackerOwned)
 			continue;
 
+		const BattleHex enemyPosition = state.getStack(enemy).position;
+
 		auto GenerateAttackInfo = [&](bool shooting, BattleHex hex) -> AttackPossibility
 		{
-			auto bai = BattleAttackInfo(attacker, enemy, shooting);
-			bai.attackerBonuses = getValOr(state.bonusesOfStacks, bai.attacker, bai.attacker);
-			bai.defenderBonuses = getValOr(state.bonusesOfStacks, bai.defender, bai.defender);
-			
+			auto bai = state.makeAttackInfo(attacker, enemy, shooting);
+
 			if(hex.isValid())
 			{
-				assert(dists[hex] <= attacker->Speed());
-				bai.chargedFields = dists[hex];
+				assert(reachability.distances[hex] <= state.getStack(attacker).Speed());
+				bai.chargedFields = reachability.distances[hex];
 			}
 
-			return AttackPossibility::evaluate(bai, state, hex);
+			auto ap = AttackPossibility::evaluate(bai, state, hex);
+			ap.attack.attackerBonuses = attacker; //snapshot may not outlive targets
+			ap.attack.defenderBonuses = enemy;
+			return ap;
 		};
 
-		if(cbc->battleCanShoot(attacker, enemy->position))
+		if(state.canShoot(attacker, enemy))
 		{
 			possibleAttacks.push_back(GenerateAttackInfo(true, BattleHex::INVALID));
 		}
 		else
 		{
 			for(BattleHex hex : avHexes)
-				if(CStack::isMeleeAttackPossible(attacker, enemy, hex))
+				if(CStack::isMeleeAttackPossible(attacker, enemy, hex, enemyPosition))
 					possibleAttacks.push_back(GenerateAttackInfo(false, hex));
 
 			if(!vstd::contains_if(possibleAttacks, [=](const AttackPossibility &pa) { return pa.enemy == enemy; }))
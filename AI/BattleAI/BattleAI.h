@@ -3,19 +3,11 @@
 #include "../../lib/BattleHex.h"
 #include "../../lib/HeroBonus.h"
 #include "../../lib/CBattleCallback.h"
+#include "../../lib/CBattleSnapshot.h"
 
 class CSpell;
 
 
-class StackWithBonuses : public IBonusBearer
-{
-public:
-	const CStack *stack;
-	mutable std::vector<Bonus> bonusesToAdd;
-
-	virtual const TBonusListPtr getAllBonuses(const CSelector &selector, const CSelector &limit, const CBonusSystemNode *root = nullptr, const std::string &cachingStr = "") const override;
-};
-
 struct EnemyInfo
 {
 	const CStack * s;
@@ -60,12 +52,6 @@ struct ThreatMap
 	ThreatMap(const CStack *Endangered);
 };
 
-struct HypotheticChangesToBattleState
-{
-	std::map<const CStack *, const IBonusBearer *> bonusesOfStacks;
-	std::map<const CStack *, int> counterAttacksLeft;
-};
-
 struct AttackPossibility
 {
 	const CStack *enemy; //redundant (to attack.defender) but looks nice
@@ -79,20 +65,9 @@ struct AttackPossibility
 	int damageDiff() const;
 	int attackValue() const;
 
-	static AttackPossibility evaluate(const BattleAttackInfo &AttackInfo, const HypotheticChangesToBattleState &state, BattleHex hex);
+	static AttackPossibility evaluate(const BattleAttackInfo &AttackInfo, const CBattleSnapshot &state, BattleHex hex);
 };
 
-template<typename Key, typename Val, typename Val2>
-const Val getValOr(const std::map<Key, Val> &Map, const Key &key, const Val2 defaultValue)
-{
-	//returning references here won't work: defaultValue must be converted into Val, creating temporary
-	auto i = Map.find(key);
-	if(i != Map.end())
-		return i->second;
-	else 
-		return defaultValue;
-}
-
 struct PotentialTargets
 {
 	std::vector<AttackPossibility> possibleAttacks;
@@ -101,7 +76,8 @@ struct PotentialTargets
 	//std::function<AttackPossibility(bool,BattleHex)>  GenerateAttackInfo; //args: shooting, destHex
 
 	PotentialTargets(){};
-	PotentialTargets(const CStack *attacker, const HypotheticChangesToBattleState &state = HypotheticChangesToBattleState());
+	PotentialTargets(const CStack *attacker); //in current state of battle
+	PotentialTargets(const CStack *attacker, const CBattleSnapshot &state);
 
 	AttackPossibility bestAction() const;
 	int bestActionValue() const;
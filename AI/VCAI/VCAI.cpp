@@ -993,6 +993,7 @@ void VCAI::makeTurn()
 	}
 	if(cb->getSelectedHero())
 		cb->recalculatePaths();
+	cb->precalculatePaths(cb->getHeroesInfo()); //heroes get selected one by one, their paths will be ready
 
 	makeTurnInternal();
 	makingTurn.reset();
@@ -1718,7 +1719,7 @@ bool VCAI::moveHeroToTile(int3 dst, HeroPtr h)
 	else
 	{
 		CGPath path;
-		cb->getPath2(dst, path);
+		cb->getPathTo(*h, dst, path);
 		if(path.nodes.empty())
 		{
             logAi->errorStream() << "Hero " << h->name << " cannot reach " << dst;
@@ -177,15 +177,7 @@ bool CCallback::buildBuilding(const CGTownInstance *town, BuildingID buildingID)
 	return true;
 }
 
-int CBattleCallback::battleMakeAction(BattleAction* action)
-{
-	assert(action->actionType == Battle::HERO_SPELL);
-	MakeCustomAction mca(*action);
-	sendRequest(&mca);
-	return 0;
-}
-
-int CBattleCallback::sendRequest(const CPack *request)
+int CClientBattleCallback::sendRequest(const CPack *request)
 {
 	int requestID = cl->sendRequest(request, *player);
 	if(waitTillRealize)
@@ -290,7 +282,7 @@ void CCallback::buildBoat( const IShipyard *obj )
 }
 
 CCallback::CCallback( CGameState * GS, boost::optional<PlayerColor> Player, CClient *C )
-	:CBattleCallback(GS, Player, C)
+	:CClientBattleCallback(GS, Player, C)
 {
 	waitTillRealize = false;
 	unlockGsWhenWaiting = false;
@@ -308,7 +300,9 @@ const CGPathNode * CCallback::getPathInfo( int3 tile )
 		return nullptr;
 
 	validatePaths();
-	return &cl->pathInfo->nodes[tile.x][tile.y][tile.z];
+
+	boost::unique_lock<boost::mutex> pathLock(cl->pathMx);
+	return cl->pathInfo->getNode(tile);
 }
 
 bool CCallback::getPath2( int3 dest, CGPath &ret )
@@ -322,11 +316,30 @@ bool CCallback::getPath2( int3 dest, CGPath &ret )
 	return cl->pathInfo->getPath(dest, ret);
 }
 
+bool CCallback::getPathTo(const CGHeroInstance *hero, int3 dest, CGPath &ret)
+{
+	if (!gs->map->isInTheMap(dest))
+		return false;
+
+	//nodes are invalidated by generation counter, so the storage can be reused by all queries on this thread
+	static boost::thread_specific_ptr<CPathsInfo> pathsInfo;
+	if(!pathsInfo.get() || pathsInfo->sizes != getMapSize())
+		pathsInfo.reset(new CPathsInfo(getMapSize()));
+
+	gs->calculatePaths(hero, *pathsInfo, std::vector<int3>(1, dest));
+	return pathsInfo->getPath(dest, ret);
+}
+
 void CCallback::recalculatePaths()
 {
 	cl->calculatePaths(cl->IGameCallback::getSelectedHero(*player));
 }
 
+void CCallback::precalculatePaths(const std::vector<const CGHeroInstance *> &heroes)
+{
+	cl->calculatePaths(heroes);
+}
+
 void CCallback::calculatePaths( const CGHeroInstance *hero, CPathsInfo &out, int3 src /*= int3(-1,-1,-1)*/, int movement /*= -1*/ )
 {
 	gs->calculatePaths(hero, out, src, movement);
@@ -396,18 +409,7 @@ void CCallback::unregisterBattleInterface(shared_ptr<IBattleEventsReceiver> batt
 	cl->additionalBattleInts[*player] -= battleEvents;
 }
 
-CBattleCallback::CBattleCallback(CGameState *GS, boost::optional<PlayerColor> Player, CClient *C )
+CClientBattleCallback::CClientBattleCallback(CGameState *GS, boost::optional<PlayerColor> Player, CClient *C )
+	: CBattleCallback(GS, Player), cl(C)
 {
-	gs = GS;
-	player = Player;
-	cl = C;
-}
-
-bool CBattleCallback::battleMakeTacticAction( BattleAction * action )
-{
-	assert(cl->gs->curB->tacticDistance);
-	MakeAction ma;
-	ma.ba = *action;
-	sendRequest(&ma);
-	return true;
 }
@@ -30,16 +30,6 @@ struct CPack;
 class IBattleEventsReceiver;
 class IGameEventsReceiver;
 
-class IBattleCallback
-{
-public:
-	bool waitTillRealize; //if true, request functions will return after they are realized by server
-	bool unlockGsWhenWaiting;//if true after sending each request, gs mutex will be unlocked so the changes can be applied; NOTICE caller must have gs mx locked prior to any call to actiob callback!
-	//battle
-	virtual int battleMakeAction(BattleAction* action)=0;//for casting spells by hero - DO NOT use it for moving active stack
-	virtual bool battleMakeTacticAction(BattleAction * action) =0; // performs tactic phase actions
-};
-
 class IGameActionCallback
 {
 public:
@@ -80,23 +70,21 @@ public:
 
 struct CPack;
 
-class CBattleCallback : public IBattleCallback, public CPlayerBattleCallback
+class CClientBattleCallback : public CBattleCallback
 {
 protected:
-	int sendRequest(const CPack *request); //returns requestID (that'll be matched to requestID in PackageApplied)
+	int sendRequest(const CPack *request) override; //returns requestID (that'll be matched to requestID in PackageApplied)
 	CClient *cl;
 	//virtual bool hasAccess(int playerId) const;
 
 public:
-	CBattleCallback(CGameState *GS, boost::optional<PlayerColor> Player, CClient *C);
-	int battleMakeAction(BattleAction* action) override;//for casting spells by hero - DO NOT use it for moving active stack
-	bool battleMakeTacticAction(BattleAction * action) override; // performs tactic phase actions
+	CClientBattleCallback(CGameState *GS, boost::optional<PlayerColor> Player, CClient *C);
 
 	friend class CCallback;
 	friend class CClient;
 };
 
-class CCallback : public CPlayerSpecificInfoCallback, public IGameActionCallback, public CBattleCallback
+class CCallback : public CPlayerSpecificInfoCallback, public IGameActionCallback, public CClientBattleCallback
 {
 private:
 
@@ -109,9 +97,11 @@ public:
 	//client-specific functionalities (pathfinding)
 	virtual const CGPathNode *getPathInfo(int3 tile); //uses main, client pathfinder info
 	virtual bool getPath2(int3 dest, CGPath &ret); //uses main, client pathfinder info
+	virtual bool getPathTo(const CGHeroInstance *hero, int3 dest, CGPath &ret); //calculates only path to given tile, doesn't use nor change main pathfinder info
 
 	virtual void calculatePaths(const CGHeroInstance *hero, CPathsInfo &out, int3 src = int3(-1,-1,-1), int movement = -1);
 	virtual void recalculatePaths(); //updates main, client pathfinder info (should be called when moving hero is over)
+	virtual void precalculatePaths(const std::vector<const CGHeroInstance *> &heroes); //calculates paths of all given heroes concurrently, selecting them afterwards won't need pathfinding
 
 	//Set of metrhods that allows adding more interfaces for this player that'll receive game event call-ins.
 	void registerGameInterface(shared_ptr<IGameEventsReceiver> gameEvents);
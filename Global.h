@@ -63,6 +63,8 @@ static_assert(sizeof(bool) == 1, "Bool needs to be 1 byte in size.");
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <bitset>
 #include <cassert>
 #include <climits>
 #include <cmath>
@@ -79,6 +81,7 @@ static_assert(sizeof(bool) == 1, "Bool needs to be 1 byte in size.");
 #include <set>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include <unordered_set>
 #include <unordered_map>
 #include <utility>
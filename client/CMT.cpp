@@ -89,6 +89,7 @@ void playIntro();
 static void listenForEvents();
 //void requestChangingResolution();
 void startGame(StartInfo * options, CConnection *serv = nullptr);
+void rejoinGame(const std::string &host);
 
 #ifndef _WIN32
 #ifndef _GNU_SOURCE
@@ -224,6 +225,7 @@ int main(int argc, char** argv)
 		("version,v", "display version information and exit")
 		("battle,b", po::value<std::string>(), "runs game in duel mode (battle-only")
 		("start", po::value<std::string>(), "starts game from saved StartInfo file")
+		("rejoin", po::value<std::string>(), "joins running game at given server after lost connection, takes over players waiting for their client")
 		("onlyAI", "runs without human player, all players will be default AI")
 		("noGUI", "runs without GUI, implies --onlyAI")
 		("ai", po::value<std::vector<std::string>>(), "AI to be used for the player, can be specified several times for the consecutive players")
@@ -383,7 +385,9 @@ int main(int argc, char** argv)
 		if(vm.count("start"))
 			fileToStartFrom = vm["start"].as<std::string>();
 
-		if(fileToStartFrom.size() && boost::filesystem::exists(fileToStartFrom))
+		if(vm.count("rejoin"))
+			rejoinGame(vm["rejoin"].as<std::string>());
+		else if(fileToStartFrom.size() && boost::filesystem::exists(fileToStartFrom))
 			startGameFromFile(fileToStartFrom); //ommit pregame and start the game using settings from fiel
 		else
 		{
@@ -638,6 +642,7 @@ void processCommand(const std::string &message)
 		{
 			CSaveFile out(fname);
 			out << SEL->sInfo;
+			out.close();
 		}
 	}
 	else if(cn == "start")
@@ -948,6 +953,14 @@ void startGame(StartInfo * options, CConnection *serv/* = nullptr*/)
 		client->connectionHandler = new boost::thread(&CClient::run, client);
 }
 
+void rejoinGame(const std::string &host)
+{
+	client = new CClient;
+	CPlayerInterface::howManyPeople = 0;
+	client->rejoinGame(CServerHandler::justConnectToServer(host), std::set<PlayerColor>());
+	client->connectionHandler = new boost::thread(&CClient::run, client);
+}
+
 void handleQuit()
 {
 	if (client)
@@ -959,6 +972,7 @@ void handleQuit()
 		delete mainGUIThread;
 		mainGUIThread = nullptr;
 	}
+	CSaveFile::waitForBackgroundSaves();
 	delete console;
 	console = nullptr;
 	boost::this_thread::sleep(boost::posix_time::milliseconds(750));
@@ -709,6 +709,7 @@ CSelectionScreen::CSelectionScreen(CMenuScreen::EState Type, CMenuScreen::EMulti
 
 		serv->enterPregameConnectionMode();
 		*serv << playerNames.begin()->second;
+		serv->flush();
 
 		if(multiPlayer == CMenuScreen::MULTI_NETWORK_GUEST)
 		{
@@ -726,6 +727,7 @@ CSelectionScreen::CSelectionScreen(CMenuScreen::EState Type, CMenuScreen::EMulti
 
 				UpdateStartOptions uso(sInfo);
 				*serv << &uso;
+				serv->flush();
 			}
 		}
 
@@ -744,6 +746,7 @@ CSelectionScreen::~CSelectionScreen()
 		assert(serverHandlingThread);
 		QuitMenuWithoutStarting qmws;
 		*serv << &qmws;
+		serv->flush();
 // 		while(!serverHandlingThread->timed_join(boost::posix_time::milliseconds(50)))
 // 			processPacks();
 		serverHandlingThread->join();
@@ -772,6 +775,7 @@ void CSelectionScreen::toggleTab(CIntObject *tab)
 			pga.action = PregameGuiAction::OPEN_RANDOM_MAP_OPTIONS;
 
 		*serv << &pga;
+		serv->flush();
 	}
 
 	if(curTab && curTab->active)
@@ -833,6 +837,7 @@ void CSelectionScreen::changeSelection(const CMapInfo * to)
 
 		UpdateStartOptions uso(sInfo);
 		*serv << &uso;
+		serv->flush();
 	}
 }
 
@@ -866,6 +871,7 @@ void CSelectionScreen::startScenario()
 		start->block(true);
 		StartWithCurrentSettings swcs;
 		*serv << &swcs;
+		serv->flush();
 		ongoingClosing = true;
 		return;
 	}
@@ -1000,7 +1006,7 @@ void CSelectionScreen::processPacks()
 	{
 		CPackForSelectionScreen *pack = upcomingPacks.front();
 		upcomingPacks.pop_front();
-		CBaseForPGApply *apply = applier->apps[typeList.getTypeID(pack)]; //find the applier
+		CBaseForPGApply *apply = applier->getApplier(typeList.getTypeID(pack)); //find the applier
 		apply->applyOnPG(this, pack);
 		delete pack;
 	}
@@ -1018,6 +1024,7 @@ void CSelectionScreen::propagateOptions()
 	{
 		UpdateStartOptions ups(sInfo);
 		*serv << &ups;
+		serv->flush();
 	}
 }
 
@@ -1028,6 +1035,7 @@ void CSelectionScreen::postRequest(ui8 what, ui8 dir)
 
 	RequestOptionsChange roc(what, dir, myNameID);
 	*serv << &roc;
+	serv->flush();
 }
 
 void CSelectionScreen::postChatMessage(const std::string &txt)
@@ -1037,6 +1045,7 @@ void CSelectionScreen::postChatMessage(const std::string &txt)
 	cm.message = txt;
 	cm.playerName = sInfo.getPlayersSettings(myNameID)->name;
 	*serv << &cm;
+	serv->flush();
 }
 
 void CSelectionScreen::propagateNames()
@@ -1044,6 +1053,7 @@ void CSelectionScreen::propagateNames()
 	PlayersNames pn;
 	pn.playerNames = playerNames;
 	*serv << &pn;
+	serv->flush();
 }
 
 void CSelectionScreen::showAll(SDL_Surface *to)
@@ -3822,6 +3832,7 @@ void QuitMenuWithoutStarting::apply(CSelectionScreen *selScreen)
 	if(!selScreen->ongoingClosing)
 	{
 		*selScreen->serv << this; //resend to confirm
+		selScreen->serv->flush();
 		GH.popIntTotally(selScreen); //will wait with deleting us before this thread ends
 	}
 
@@ -3943,6 +3954,7 @@ void StartWithCurrentSettings::apply(CSelectionScreen *selScreen)
 	if(!selScreen->ongoingClosing)
 	{
 		*selScreen->serv << this; //resend to confirm
+		selScreen->serv->flush();
 	}
 
 	selScreen->serv = nullptr; //hide it so it won't be deleted
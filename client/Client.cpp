@@ -254,6 +254,7 @@ void CClient::loadGame( const std::string & fname )
 		const_cast<CGameInfo*>(CGI)->mh = new CMapHandler();
 		const_cast<CGameInfo*>(CGI)->mh->map = gs->map;
 		pathInfo = make_unique<CPathsInfo>(getMapSize());
+		otherHeroesPaths.clear();
 		CGI->mh->init();
         logNetwork->infoStream() <<"Initing maphandler: "<<tmh.getDiff();
 
@@ -273,6 +274,7 @@ void CClient::loadGame( const std::string & fname )
 	ui8 pom8;
 	*serv << ui8(3) << ui8(1); //load game; one client
 	*serv << fname;
+	serv->flush();
 	*serv >> pom8;
 	if(pom8) 
 		throw std::runtime_error("Server cannot open the savegame!");
@@ -285,6 +287,7 @@ void CClient::loadGame( const std::string & fname )
 		*serv << ui8(elem.first.getNum()); //players
 	}
 	*serv << ui8(PlayerColor::NEUTRAL.getNum());
+	serv->flush();
     logNetwork->infoStream() <<"Sent info to server: "<<tmh.getDiff();
 
 	serv->enableStackSendingByID();
@@ -318,6 +321,7 @@ void CClient::newGame( CConnection *con, StartInfo *si )
 		ui8 pom8;
 		c << ui8(2) << ui8(1); //new game; one client
 		c << *si;
+		c.flush();
 		c >> pom8;
 		if(pom8) 
 			throw std::runtime_error("Server cannot open the map!");
@@ -353,6 +357,7 @@ void CClient::newGame( CConnection *con, StartInfo *si )
 	if(networkMode != GUEST)
 		myPlayers.insert(PlayerColor::NEUTRAL);
 	c << myPlayers;
+	c.flush();
 
 	// Init map handler
 	if(gs->map)
@@ -362,6 +367,7 @@ void CClient::newGame( CConnection *con, StartInfo *si )
         logNetwork->infoStream() <<"Creating mapHandler: "<<tmh.getDiff();
 		CGI->mh->init();
 		pathInfo = make_unique<CPathsInfo>(getMapSize());
+		otherHeroesPaths.clear();
         logNetwork->infoStream() <<"Initializing mapHandler (together): "<<tmh.getDiff();
 	}
 
@@ -430,6 +436,79 @@ void CClient::newGame( CConnection *con, StartInfo *si )
 // 	}
 }
 
+void CClient::rejoinGame(CConnection *con, const std::set<PlayerColor> &players)
+{
+	serv = con;
+	CConnection &c = *serv;
+	CStopWatch tmh;
+
+	std::set<PlayerColor> myPlayers;
+	c << players;
+	c.flush();
+	c >> myPlayers;
+	if(myPlayers.empty())
+		throw std::runtime_error("Server has no players waiting for this client!");
+
+	//state from the beginning of the day in the format of saves, then packs sent since then
+	std::vector<ui8> checkpoint;
+	c >> checkpoint;
+	{
+		CMemoryLoader loader(checkpoint);
+		loadCommonState(loader);
+	}
+	logNetwork->infoStream() << "Loaded state checkpoint: " << tmh.getDiff();
+
+	const_cast<CGameInfo*>(CGI)->mh = new CMapHandler();
+	CGI->mh->map = gs->map;
+	CGI->mh->init();
+	pathInfo = make_unique<CPathsInfo>(getMapSize());
+	otherHeroesPaths.clear();
+	logNetwork->infoStream() << "Initializing mapHandler: " << tmh.getDiff();
+
+	c.addStdVecItems(gs);
+	c.enableStackSendingByID();
+	c.disableSmartPointerSerialization();
+	ui32 packs;
+	c >> packs;
+	for(ui32 i = 0; i < packs; i++)
+		handlePack(c.retreivePack()); //interfaces don't exist yet, so they don't react to past events
+	logNetwork->infoStream() << "Replayed " << packs << " packs: " << tmh.getDiff();
+
+	int humanPlayers = 0;
+	for(PlayerColor color : myPlayers)
+	{
+		if(color == PlayerColor::NEUTRAL)
+			continue;
+
+		const PlayerSettings &ps = gs->scenarioOps->playerInfos[color];
+		if(ps.playerID == PlayerSettings::PLAYER_AI)
+		{
+			auto AiToGive = aiNameForPlayer(ps, false);
+			logNetwork->infoStream() << boost::format("Player %s will be lead by %s") % color % AiToGive;
+			installNewPlayerInterface(CDynLibHandler::getNewAI(AiToGive), color);
+		}
+		else
+		{
+			installNewPlayerInterface(make_shared<CPlayerInterface>(color), color);
+			humanPlayers++;
+		}
+	}
+	loadNeutralBattleAI();
+	hotSeat = (humanPlayers > 1);
+
+	//server resends what it waits for from our players (turn, dialogs), battle continues with active stack
+	if(gs->curB)
+	{
+		battleStarted(gs->curB);
+		if(gs->curB->battleGetStackByID(gs->curB->activeStack))
+		{
+			BattleSetActiveStack sas;
+			sas.stack = gs->curB->activeStack;
+			sas.applyCl(this);
+		}
+	}
+}
+
 template <typename Handler>
 void CClient::serialize( Handler &h, const int version )
 {
@@ -498,10 +577,12 @@ void CClient::serialize( Handler &h, const int version )
 
 void CClient::handlePack( CPack * pack )
 {			
-	CBaseForCLApply *apply = applier->apps[typeList.getTypeID(pack)]; //find the applier
+	CBaseForCLApply *apply = applier->getApplier(typeList.getTypeID(pack)); //find the applier
 	if(apply)
 	{
-		boost::unique_lock<boost::recursive_mutex> guiLock(*LOCPLINT->pim);
+		boost::unique_lock<boost::recursive_mutex> guiLock;
+		if(LOCPLINT) //there is no interface yet when packs are replayed after rejoining game
+			guiLock = boost::unique_lock<boost::recursive_mutex>(*LOCPLINT->pim);
 		apply->applyOnClBefore(this,pack);
         logNetwork->traceStream() << "\tMade first apply on cl";
 		gs->apply(pack);
@@ -641,9 +722,53 @@ void CClient::calculatePaths(const CGHeroInstance *h)
 {
 	assert(h);
 	boost::unique_lock<boost::mutex> pathLock(pathMx);
+	if(pathInfo->hero != h)
+	{
+		unique_ptr<CPathsInfo> paths;
+		auto it = otherHeroesPaths.find(h);
+		if(it != otherHeroesPaths.end())
+		{
+			paths = std::move(it->second);
+			otherHeroesPaths.erase(it);
+		}
+		else
+			paths = make_unique<CPathsInfo>(getMapSize());
+
+		if(pathInfo->hero)
+			otherHeroesPaths[pathInfo->hero] = std::move(pathInfo);
+		pathInfo = std::move(paths);
+
+		if(pathInfo->isValid && pathInfo->hpos == h->getPosition(false))
+			return; //paths calculated earlier are still up to date
+	}
 	gs->calculatePaths(h, *pathInfo);
 }
 
+void CClient::calculatePaths(const std::vector<const CGHeroInstance *> &heroes)
+{
+	boost::unique_lock<boost::mutex> pathLock(pathMx);
+	std::vector<const CGHeroInstance *> outdatedHeroes;
+	std::vector<CPathsInfo *> outdatedPaths;
+	for(const CGHeroInstance *h : heroes)
+	{
+		CPathsInfo *paths = pathInfo.get();
+		if(pathInfo->hero != h)
+		{
+			auto &entry = otherHeroesPaths[h];
+			if(!entry)
+				entry = make_unique<CPathsInfo>(getMapSize());
+			paths = entry.get();
+		}
+
+		if(paths->hero != h || !paths->isValid || paths->hpos != h->getPosition(false))
+		{
+			outdatedHeroes.push_back(h);
+			outdatedPaths.push_back(paths);
+		}
+	}
+	gs->calculatePaths(outdatedHeroes, outdatedPaths);
+}
+
 void CClient::commenceTacticPhaseForInt(shared_ptr<CBattleGameInterface> battleInt)
 {
 	setThreadName("CClient::commenceTacticPhaseForInt");
@@ -660,8 +785,22 @@ void CClient::commenceTacticPhaseForInt(shared_ptr<CBattleGameInterface> battleI
 
 void CClient::invalidatePaths(const CGHeroInstance *h /*= nullptr*/)
 {
+	boost::unique_lock<boost::mutex> pathLock(pathMx);
 	if(!h || pathInfo->hero == h)
-		pathInfo->isValid = false;
+		pathInfo->invalidate();
+
+	if(h)
+		otherHeroesPaths.erase(h);
+	else
+		otherHeroesPaths.clear();
+}
+
+void CClient::invalidatePaths(const std::vector<int3> &changedTiles)
+{
+	boost::unique_lock<boost::mutex> pathLock(pathMx);
+	pathInfo->invalidateTiles(changedTiles);
+	for(auto &paths : otherHeroesPaths)
+		paths.second->invalidateTiles(changedTiles);
 }
 
 int CClient::sendRequest(const CPack *request, PlayerColor player)
@@ -736,7 +875,7 @@ void CClient::installNewBattleInterface(shared_ptr<CBattleGameInterface> battleI
 	if(needCallback)
 	{
 		logGlobal->traceStream() << boost::format("\tInitializing the battle interface for player %s") % *color;
-		auto cbc = make_shared<CBattleCallback>(gs, color, this);
+		auto cbc = std::make_shared<CClientBattleCallback>(gs, color, this);
 		battleCallbacks[colorUsed] = cbc;
 		battleInterface->init(cbc);
 	}
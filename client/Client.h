@@ -125,8 +125,9 @@ public:
 
 	boost::optional<BattleAction> curbaction;
 
-	unique_ptr<CPathsInfo> pathInfo;
-	boost::mutex pathMx; //protects the variable above
+	unique_ptr<CPathsInfo> pathInfo; //paths of recently selected hero
+	std::map<const CGHeroInstance *, unique_ptr<CPathsInfo> > otherHeroesPaths; //kept to be reused or repaired when hero gets selected again
+	boost::mutex pathMx; //protects the variables above
 
 	CScriptingModule *erm;
 
@@ -140,6 +141,7 @@ public:
 
 	void init();
 	void newGame(CConnection *con, StartInfo *si); //con - connection to server
+	void rejoinGame(CConnection *con, const std::set<PlayerColor> &players); //takes over players of running game whose client lost connection, all of them if players is empty
 
 	void loadNeutralBattleAI();
 	void installNewPlayerInterface(shared_ptr<CGameInterface> gameInterface, boost::optional<PlayerColor> color);
@@ -155,7 +157,9 @@ public:
 	void finishCampaign( shared_ptr<CCampaignState> camp );
 	void proposeNextMission(shared_ptr<CCampaignState> camp);
 	void invalidatePaths(const CGHeroInstance *h = nullptr); //invalidates paths for hero h or for any hero if h is nullptr => they'll got recalculated when the next query comes
+	void invalidatePaths(const std::vector<int3> &changedTiles); //paths are outdated only around given tiles => they'll got repaired when the next query comes
 	void calculatePaths(const CGHeroInstance *h);
+	void calculatePaths(const std::vector<const CGHeroInstance *> &heroes); //calculates outdated paths of all given heroes concurrently, so they are ready when heroes get selected
 	void updatePaths(); //calls calculatePaths for same hero for which we previously calculated paths
 
 	bool terminate;	// tell to terminate
@@ -220,7 +224,7 @@ public:
 
 	//////////////////////////////////////////////////////////////////////////
 	friend class CCallback; //handling players actions
-	friend class CBattleCallback; //handling players actions
+	friend class CClientBattleCallback; //handling players actions
 
 	int sendRequest(const CPack *request, PlayerColor player); //returns ID given to that request
 
@@ -175,7 +175,7 @@ void FoWChange::applyCl( CClient *cl )
 				i.second->tileHidden(tiles);
 		}
 
-	cl->invalidatePaths();
+	cl->invalidatePaths(std::vector<int3>(tiles.begin(), tiles.end()));
 }
 
 void SetAvailableHeroes::applyCl( CClient *cl )
@@ -327,13 +327,31 @@ void PrepareForAdvancingCampaign::applyCl(CClient *cl)
 	cl->serv->prepareForSendingHeroes();
 }
 
+//tiles which accessibility depends on given object
+static std::vector<int3> objectTiles(const CGObjectInstance *o)
+{
+	int3 pos = o->visitablePos();
+
+	std::vector<int3> ret(1, pos);
+	for(const int3 &tile : o->getBlockedPos())
+		ret.push_back(tile);
+	if(o->ID == Obj::MONSTER) //monster guards neighbouring tiles
+	{
+		for(int dx = -1; dx <= 1; dx++)
+			for(int dy = -1; dy <= 1; dy++)
+				ret.push_back(pos + int3(dx, dy, 0));
+	}
+	return ret;
+}
+
 void RemoveObject::applyFirstCl( CClient *cl )
 {
 	const CGObjectInstance *o = cl->getObj(id);
 
 	CGI->mh->hideObject(o);
 
-	int3 pos = o->visitablePos();
+	cl->invalidatePaths(objectTiles(o));
+
 	//notify interfaces about removal
 	for(auto i=cl->playerint.begin(); i!=cl->playerint.end(); i++)
 	{
@@ -344,7 +362,7 @@ void RemoveObject::applyFirstCl( CClient *cl )
 
 void RemoveObject::applyCl( CClient *cl )
 {
-	cl->invalidatePaths();
+	//paths were invalidated before removal, when object tiles were still known
 }
 
 void TryMoveHero::applyFirstCl( CClient *cl )
@@ -373,7 +391,16 @@ void TryMoveHero::applyFirstCl( CClient *cl )
 void TryMoveHero::applyCl( CClient *cl )
 {
 	const CGHeroInstance *h = cl->getHero(id);
-	cl->invalidatePaths();
+	if(result == SUCCESS)
+	{
+		//hero made one step, tiles it left and entered and revealed tiles are the only changes
+		std::vector<int3> changedTiles(fowRevealed.begin(), fowRevealed.end());
+		changedTiles.push_back(CGHeroInstance::convertPosition(start, false));
+		changedTiles.push_back(CGHeroInstance::convertPosition(end, false));
+		cl->invalidatePaths(changedTiles);
+	}
+	else
+		cl->invalidatePaths();
 
 	if(result == TELEPORTATION  ||  result == EMBARK  ||  result == DISEMBARK)
 	{
@@ -798,6 +825,7 @@ void SaveGame::applyCl(CClient *cl)
 		CSaveFile save(CResourceHandler::get()->getResourceName(ResourceID(info.getStem(), EResType::CLIENT_SAVEGAME)));
 		cl->saveCommonState(save);
 		save << *cl;
+		save.closeInBackground();
 	}
 	catch(std::exception &e)
 	{
@@ -907,9 +935,10 @@ void CenterView::applyCl(CClient *cl)
 
 void NewObject::applyCl(CClient *cl)
 {
+	const CGObjectInstance *obj = cl->getObj(id);
+	cl->invalidatePaths(objectTiles(obj));
 	cl->updatePaths();
 
-	const CGObjectInstance *obj = cl->getObj(id);
 	CGI->mh->printObject(obj);
 
 	for(auto i=cl->playerint.begin(); i!=cl->playerint.end(); i++)
@@ -56,22 +56,37 @@ BattleHex BattleHex::operator+(EDir dir) const
 	return ret;
 }
 
-std::vector<BattleHex> BattleHex::neighbouringTiles() const
+static std::vector<BattleHex> calculateNeighbouringTiles(si16 hex)
 {
 	std::vector<BattleHex> ret;
 	const int WN = GameConstants::BFIELD_WIDTH;
 	// H3 order : TR, R, BR, BL, L, TL (T = top, B = bottom ...)
 
-	checkAndPush(hex - ( (hex/WN)%2 ? WN+1 : WN ), ret); // 1
-	checkAndPush(hex + 1, ret); // 2
-	checkAndPush(hex + ( (hex/WN)%2 ? WN : WN+1 ), ret); // 3
-	checkAndPush(hex + ( (hex/WN)%2 ? WN-1 : WN ), ret); // 4
-	checkAndPush(hex - 1, ret); // 5
-	checkAndPush(hex - ( (hex/WN)%2 ? WN : WN-1 ), ret); // 6
+	BattleHex::checkAndPush(hex - ( (hex/WN)%2 ? WN+1 : WN ), ret); // 1
+	BattleHex::checkAndPush(hex + 1, ret); // 2
+	BattleHex::checkAndPush(hex + ( (hex/WN)%2 ? WN : WN+1 ), ret); // 3
+	BattleHex::checkAndPush(hex + ( (hex/WN)%2 ? WN-1 : WN ), ret); // 4
+	BattleHex::checkAndPush(hex - 1, ret); // 5
+	BattleHex::checkAndPush(hex - ( (hex/WN)%2 ? WN : WN-1 ), ret); // 6
 
 	return ret;
 }
 
+//[hex] -> its neighbours; battlefield is small and neighbours are needed very often (eg. in every BFS)
+static const std::vector<std::vector<BattleHex> > neighbouringTilesTable = []
+{
+	std::vector<std::vector<BattleHex> > ret;
+	for(si16 hex = 0; hex < GameConstants::BFIELD_SIZE; hex++)
+		ret.push_back(calculateNeighbouringTiles(hex));
+	return ret;
+}();
+
+const std::vector<BattleHex> & BattleHex::neighbouringTiles() const
+{
+	static const std::vector<BattleHex> noTiles;
+	return isValid() ? neighbouringTilesTable[hex] : noTiles;
+}
+
 signed char BattleHex::mutualPosition(BattleHex hex1, BattleHex hex2)
 {
 	if(hex2 == hex1 - ( (hex1/17)%2 ? 18 : 17 )) //top left
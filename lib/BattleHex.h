@@ -96,7 +96,7 @@ struct DLL_LINKAGE BattleHex
 	//generates new BattleHex moved by given dir
 	BattleHex operator+(EDir dir) const;
 
-	std::vector<BattleHex> neighbouringTiles() const;
+	const std::vector<BattleHex> & neighbouringTiles() const; //precomputed, empty for invalid hexes
 
 	//returns info about mutual position of given hexes (-1 - they're distant, 0 - left top, 1 - right top, 2 - right, 3 - right bottom, 4 - left bottom, 5 - left)
 	static signed char mutualPosition(BattleHex hex1, BattleHex hex2);
@@ -112,4 +112,6 @@ struct DLL_LINKAGE BattleHex
 
 	bool isAvailable() const; //valid position not in first or last column
 	static BattleHex getClosestTile(bool attackerOwned, BattleHex initialPos, std::set<BattleHex> & possibilities); //TODO: vector or set? copying one to another is bad
-};
\ No newline at end of file
+};
+
+typedef std::bitset<GameConstants::BFIELD_SIZE> TBattleHexSet; //set of battlefield hexes, hex is in set if its bit is set
@@ -836,6 +836,7 @@ CStack * BattleInfo::getStackT(BattleHex tileID, bool onlyAlive /*= true*/)
 }
 
 BattleInfo::BattleInfo()
+	: version(0)
 {
 	setBattle(this);
 	setNodeType(BATTLE);
@@ -65,6 +65,9 @@ struct DLL_LINKAGE BattleInfo : public CBonusSystemNode, public CBattleInfoCallb
 	ui8 tacticsSide; //which side is requested to play tactics phase
 	ui8 tacticDistance; //how many hexes we can go forward (1 = only hexes adjacent to margin line)
 
+	std::atomic<ui32> version; //increased with every pack applied during battle (AI threads read it concurrently), not serialized
+	mutable CReachabilityCache reachabilityCache; //reachabilities computed for current version
+
 	template <typename Handler> void serialize(Handler &h, const int version)
 	{
 		h & sides & round & activeStack & selectedStack & siege & town & tile & stacks & belligerents & obstacles
@@ -216,6 +216,17 @@ const CGTownInstance * CBattleInfoEssentials::battleGetDefendedTown() const
 	return getBattle()->town;
 }
 
+ui32 CBattleInfoEssentials::battleGetVersion() const
+{
+	RETURN_IF_NOT_BATTLE(0);
+	return getBattle()->version;
+}
+
+CReachabilityCache & CBattleInfoEssentials::battleReachabilityCache() const
+{
+	return getBattle()->reachabilityCache;
+}
+
 BattlePerspective::BattlePerspective CBattleInfoEssentials::battleGetMySide() const
 {
 	RETURN_IF_NOT_BATTLE(BattlePerspective::INVALID);
@@ -1135,35 +1146,32 @@ ReachabilityInfo CBattleInfoCallback::makeBFS(const AccessibilityInfo &accessibi
 	if(!params.startPosition.isValid()) //if got call for arrow turrets
 		return ret;
 
-	const std::set<BattleHex> quicksands = getStoppers(params.perspective);
-	//const bool twoHexCreature = params.doubleWide;
-
+	const TBattleHexSet quicksands = getStoppers(params.perspective);
+	const TBattleHexSet accessible = accessibility.accessibleHexes(params.doubleWide, params.attackerOwned);
 
-	std::queue<BattleHex> hexq; //bfs queue
+	//every hex is queued at most once (when it's reached for the first time), so array is enough for bfs queue
+	std::array<BattleHex, GameConstants::BFIELD_SIZE> hexq;
+	int queueBegin = 0, queueEnd = 0;
 
 	//first element
-	hexq.push(params.startPosition);
+	hexq[queueEnd++] = params.startPosition;
 	ret.distances[params.startPosition] = 0;
 
-	while(!hexq.empty()) //bfs loop
+	while(queueBegin < queueEnd) //bfs loop
 	{
-		const BattleHex curHex = hexq.front();
-		hexq.pop();
+		const BattleHex curHex = hexq[queueBegin++];
 
 		//walking stack can't step past the quicksands
 		//TODO what if second hex of two-hex creature enters quicksand
-		if(curHex != params.startPosition && vstd::contains(quicksands, curHex))
+		if(curHex != params.startPosition && quicksands[curHex])
 			continue;
 
 		const int costToNeighbour = ret.distances[curHex] + 1;
 		for(BattleHex neighbour : curHex.neighbouringTiles())
 		{
-			const bool accessible = accessibility.accessible(neighbour, params.doubleWide, params.attackerOwned);
-			const int costFoundSoFar = ret.distances[neighbour];
-
-			if(accessible  &&  costToNeighbour < costFoundSoFar)
+			if(accessible[neighbour]  &&  costToNeighbour < ret.distances[neighbour])
 			{
-				hexq.push(neighbour);
+				hexq[queueEnd++] = neighbour;
 				ret.distances[neighbour] = costToNeighbour;
 				ret.predecessors[neighbour] = curHex;
 			}
@@ -1178,16 +1186,18 @@ ReachabilityInfo CBattleInfoCallback::makeBFS(const CStack *stack) const
 	return makeBFS(getAccesibility(stack), ReachabilityInfo::Parameters(stack));
 }
 
-std::set<BattleHex> CBattleInfoCallback::getStoppers(BattlePerspective::BattlePerspective whichSidePerspective) const
+TBattleHexSet CBattleInfoCallback::getStoppers(BattlePerspective::BattlePerspective whichSidePerspective) const
 {
-	std::set<BattleHex> ret;
+	TBattleHexSet ret;
 	RETURN_IF_NOT_BATTLE(ret);
 
 	for(auto &oi : battleGetAllObstacles(whichSidePerspective))
 	{
 		if(battleIsObstacleVisibleForSide(*oi, whichSidePerspective))
 		{
-			range::copy(oi->getStoppingTile(), vstd::set_inserter(ret));
+			for(auto hex : oi->getStoppingTile())
+				if(hex.isValid())
+					ret.set(hex);
 		}
 	}
 
@@ -1270,10 +1280,23 @@ ReachabilityInfo CBattleInfoCallback::getReachability(const CStack *stack) const
 
 ReachabilityInfo CBattleInfoCallback::getReachability(const ReachabilityInfo::Parameters &params) const
 {
+	ReachabilityInfo ret;
+	RETURN_IF_NOT_BATTLE(ret);
+
+	//the same reachability is asked for many times between two changes of battle (by AI evaluating its moves, by server validating them...)
+	const ui32 version = battleGetVersion();
+	const auto side = battleGetMySide();
+	auto &cache = battleReachabilityCache();
+	if(cache.get(version, side, params, ret))
+		return ret;
+
 	if(params.flying)
-		return getFlyingReachability(params);
+		ret = getFlyingReachability(params);
 	else
-		return makeBFS(getAccesibility(params.knownAccessible), params);
+		ret = makeBFS(getAccesibility(params.knownAccessible), params);
+
+	cache.put(version, side, params, ret);
+	return ret;
 }
 
 ReachabilityInfo CBattleInfoCallback::getFlyingReachability(const ReachabilityInfo::Parameters params) const
@@ -1896,7 +1919,7 @@ ui32 CBattleInfoCallback::calculateSpellDmg( const CSpell * sp, const CGHeroInst
 	return ret;
 }
 
-std::set<const CStack*> CBattleInfoCallback::getAffectedCreatures(const CSpell * spell, int skillLevel, PlayerColor attackerOwner, BattleHex destinationTile)
+std::set<const CStack*> CBattleInfoCallback::getAffectedCreatures(const CSpell * spell, int skillLevel, PlayerColor attackerOwner, BattleHex destinationTile) const
 {
 	std::set<const CStack*> attackedCres; /*std::set to exclude multiple occurrences of two hex creatures*/
 
@@ -2217,6 +2240,24 @@ bool AccessibilityInfo::accessible(BattleHex tile, bool doubleWide, bool attacke
 	return true;
 }
 
+TBattleHexSet AccessibilityInfo::accessibleHexes(bool doubleWide, bool attackerOwned) const
+{
+	TBattleHexSet free; //hexes that can be covered by stack
+	for(int i = 0; i < GameConstants::BFIELD_SIZE; i++)
+		free[i] = at(i) == EAccessibility::ACCESSIBLE || (at(i) == EAccessibility::GATE && !attackerOwned);
+
+	if(!doubleWide)
+		return free;
+
+	TBattleHexSet ret;
+	for(int i = 0; i < GameConstants::BFIELD_SIZE; i++)
+	{
+		const BattleHex otherHex = attackerOwned ? i - 1 : i + 1; //as in CStack::getHexes
+		ret[i] = free[i] && otherHex.isValid() && free[otherHex];
+	}
+	return ret;
+}
+
 bool AccessibilityInfo::occupiable(const CStack *stack, BattleHex tile) const
 {
 	//obviously, we can occupy tile by standing on it
@@ -2252,6 +2293,56 @@ ReachabilityInfo::Parameters::Parameters(const CStack *Stack)
 	knownAccessible = stack->getHexes();
 }
 
+CReachabilityCache::CReachabilityCache()
+	: version(0)
+{
+}
+
+CReachabilityCache::CReachabilityCache(const CReachabilityCache &other)
+	: version(0)
+{
+}
+
+CReachabilityCache & CReachabilityCache::operator=(const CReachabilityCache &other)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	entries.clear();
+	return *this;
+}
+
+CReachabilityCache::TKey CReachabilityCache::makeKey(BattlePerspective::BattlePerspective side, const ReachabilityInfo::Parameters &params)
+{
+	return TKey(side, params.perspective, params.attackerOwned, params.doubleWide, params.flying, params.startPosition, params.knownAccessible);
+}
+
+bool CReachabilityCache::get(ui32 battleVersion, BattlePerspective::BattlePerspective side, const ReachabilityInfo::Parameters &params, ReachabilityInfo &out) const
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	if(version != battleVersion)
+		return false;
+
+	auto it = entries.find(makeKey(side, params));
+	if(it == entries.end())
+		return false;
+
+	out = it->second;
+	out.params = params; //stack pointer is not part of key
+	return true;
+}
+
+void CReachabilityCache::put(ui32 battleVersion, BattlePerspective::BattlePerspective side, const ReachabilityInfo::Parameters &params, const ReachabilityInfo &reachability)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	if(battleVersion < version) //battle changed while reachability was computed
+		return;
+	if(version != battleVersion || entries.size() >= MAX_ENTRIES)
+	{
+		entries.clear();
+		version = battleVersion;
+	}
+	entries[makeKey(side, params)] = reachability;
+}
+
 ESpellCastProblem::ESpellCastProblem CPlayerBattleCallback::battleCanCastThisSpell(const CSpell * spell) const
 {
 	RETURN_IF_NOT_BATTLE(ESpellCastProblem::INVALID);
@@ -2364,3 +2455,28 @@ BattleAttackInfo BattleAttackInfo::reverse() const
 
 	return ret;
 }
+
+CBattleCallback::CBattleCallback(CGameState *GS, boost::optional<PlayerColor> Player)
+{
+	gs = GS; //CCallbackBase is a virtual base
+	player = Player;
+	waitTillRealize = false;
+	unlockGsWhenWaiting = false;
+}
+
+int CBattleCallback::battleMakeAction(BattleAction* action)
+{
+	assert(action->actionType == Battle::HERO_SPELL);
+	MakeCustomAction mca(*action);
+	sendRequest(&mca);
+	return 0;
+}
+
+bool CBattleCallback::battleMakeTacticAction( BattleAction * action )
+{
+	assert(battleTacticDist());
+	MakeAction ma;
+	ma.ba = *action;
+	sendRequest(&ma);
+	return true;
+}
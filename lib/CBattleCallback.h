@@ -20,6 +20,8 @@ struct BattleInfo;
 struct CObstacleInstance;
 class IBonusBearer;
 struct InfoAboutHero;
+struct BattleAction;
+struct CPack;
 
 namespace boost
 {class shared_mutex;}
@@ -97,6 +99,7 @@ struct DLL_LINKAGE AccessibilityInfo : TAccessibilityArray
 	bool occupiable(const CStack *stack, BattleHex tile) const;
 	bool accessible(BattleHex tile, const CStack *stack) const; //checks for both tiles if stack is double wide
 	bool accessible(BattleHex tile, bool doubleWide, bool attackerOwned) const; //checks for both tiles if stack is double wide
+	TBattleHexSet accessibleHexes(bool doubleWide, bool attackerOwned) const; //tiles for which accessible(tile, doubleWide, attackerOwned) is true, at once
 };
 
 namespace BattlePerspective
@@ -152,10 +155,35 @@ struct DLL_LINKAGE ReachabilityInfo
 	}
 };
 
+// Reachabilities computed for one version of battle state (see BattleInfo::version), shared by all callbacks of the battle.
+// Entries computed for older version are dropped. Thread-safe, copies are empty.
+class DLL_LINKAGE CReachabilityCache
+{
+public:
+	enum { MAX_ENTRIES = 256 };
+
+	CReachabilityCache();
+	CReachabilityCache(const CReachabilityCache &other);
+	CReachabilityCache & operator=(const CReachabilityCache &other);
+
+	bool get(ui32 battleVersion, BattlePerspective::BattlePerspective side, const ReachabilityInfo::Parameters &params, ReachabilityInfo &out) const; //side - perspective of callback asking (it decides which obstacles are known)
+	void put(ui32 battleVersion, BattlePerspective::BattlePerspective side, const ReachabilityInfo::Parameters &params, const ReachabilityInfo &reachability);
+
+private:
+	typedef std::tuple<int, int, bool, bool, bool, si16, std::vector<BattleHex> > TKey; //side, perspective, attackerOwned, doubleWide, flying, start position, known accessible hexes
+
+	static TKey makeKey(BattlePerspective::BattlePerspective side, const ReachabilityInfo::Parameters &params);
+
+	mutable boost::mutex mx;
+	ui32 version; //version of battle for which entries were computed
+	std::map<TKey, ReachabilityInfo> entries;
+};
+
 class DLL_LINKAGE CBattleInfoEssentials : public virtual CCallbackBase
 {
 protected:
 	bool battleDoWeKnowAbout(ui8 side) const;
+	CReachabilityCache & battleReachabilityCache() const;
 public:
 	enum EStackOwnership
 	{
@@ -163,6 +191,7 @@ public:
 	};
 
 	BattlePerspective::BattlePerspective battleGetMySide() const;
+	ui32 battleGetVersion() const; //changes whenever battle state changes
 
 	ETerrainType battleTerrainType() const;
 	BFieldType battleGetBattlefieldType() const;
@@ -258,7 +287,7 @@ public:
 	std::vector<BattleHex> battleGetPossibleTargets(PlayerColor player, const CSpell *spell) const;
 	ui32 calculateSpellBonus(ui32 baseDamage, const CSpell * sp, const CGHeroInstance * caster, const CStack * affectedCreature) const;
 	ui32 calculateSpellDmg(const CSpell * sp, const CGHeroInstance * caster, const CStack * affectedCreature, int spellSchoolLevel, int usedSpellPower) const; //calculates damage inflicted by spell
-	std::set<const CStack*> getAffectedCreatures(const CSpell * s, int skillLevel, PlayerColor attackerOwner, BattleHex destinationTile); //calculates stack affected by given spell
+	std::set<const CStack*> getAffectedCreatures(const CSpell * s, int skillLevel, PlayerColor attackerOwner, BattleHex destinationTile) const; //calculates stack affected by given spell
 
 	SpellID battleGetRandomStackSpell(const CStack * stack, ERandomSpell mode) const;
 	SpellID getRandomBeneficialSpell(const CStack * subject) const;
@@ -296,7 +325,9 @@ protected:
 	ReachabilityInfo getFlyingReachability(const ReachabilityInfo::Parameters params) const;
 	ReachabilityInfo makeBFS(const AccessibilityInfo &accessibility, const ReachabilityInfo::Parameters params) const;
 	ReachabilityInfo makeBFS(const CStack *stack) const; //uses default parameters -> stack position and owner's perspective
-	std::set<BattleHex> getStoppers(BattlePerspective::BattlePerspective whichSidePerspective) const; //get hexes with stopping obstacles (quicksands)
+	TBattleHexSet getStoppers(BattlePerspective::BattlePerspective whichSidePerspective) const; //get hexes with stopping obstacles (quicksands)
+
+	friend class CBattleSnapshot;
 
 
 };
@@ -315,3 +346,28 @@ public:
 	const CGHeroInstance * battleGetMyHero() const;
 	InfoAboutHero battleGetEnemyHero() const;
 };
+
+class IBattleCallback
+{
+public:
+	bool waitTillRealize; //if true, request functions will return after they are realized by server
+	bool unlockGsWhenWaiting;//if true after sending each request, gs mutex will be unlocked so the changes can be applied; NOTICE caller must have gs mx locked prior to any call to actiob callback!
+	//battle
+	virtual int battleMakeAction(BattleAction* action)=0;//for casting spells by hero - DO NOT use it for moving active stack
+	virtual bool battleMakeTacticAction(BattleAction * action) =0; // performs tactic phase actions
+};
+
+/// Callback given to battle interfaces, actions are passed as requests to whoever runs the game (client sends them to server)
+class DLL_LINKAGE CBattleCallback : public IBattleCallback, public CPlayerBattleCallback
+{
+protected:
+	virtual int sendRequest(const CPack *request) = 0; //returns requestID (that'll be matched to requestID in PackageApplied)
+
+	CBattleCallback(CGameState *GS, boost::optional<PlayerColor> Player);
+
+public:
+	int battleMakeAction(BattleAction* action) override;//for casting spells by hero - DO NOT use it for moving active stack
+	bool battleMakeTacticAction(BattleAction * action) override; // performs tactic phase actions
+
+	friend class CClient;
+};
@@ -0,0 +1,440 @@
+#include "StdInc.h"
+#include "CBattleSnapshot.h"
+
+#include "BattleState.h"
+#include "NetPacks.h"
+#include "CSpellHandler.h"
+
+/*
+ * CBattleSnapshot.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+CBattleSnapshot::StackState::StackState(const CStack *Stack)
+	: stack(Stack), position(Stack->position), count(Stack->count), firstHPleft(Stack->firstHPleft),
+	counterAttacks(Stack->counterAttacks), shots(Stack->shots), alive(Stack->alive()),
+	dropUntilAttack(false), dropUntilBeingAttacked(false), dropNegativeEffects(false)
+{
+}
+
+std::pair<int,int> CBattleSnapshot::StackState::countKilledByAttack(int damageReceived) const
+{
+	const int maxHealth = MaxHealth();
+	int killedCount = damageReceived / maxHealth;
+	int newRemainingHP = 0;
+	const int damageFirst = damageReceived % maxHealth;
+
+	if(damageReceived && vstd::contains(stack->state, EBattleStackState::CLONED)) // block ability should not kill clone (0 damage)
+	{
+		killedCount = count;
+	}
+	else if(firstHPleft <= damageFirst)
+	{
+		killedCount++;
+		newRemainingHP = firstHPleft + maxHealth - damageFirst;
+	}
+	else
+	{
+		newRemainingHP = firstHPleft - damageFirst;
+	}
+
+	return std::make_pair(killedCount, newRemainingHP);
+}
+
+ui32 CBattleSnapshot::StackState::Speed() const
+{
+	if(hasBonusOfType(Bonus::SIEGE_WEAPON) || getEffect(SpellID::BIND))
+		return 0;
+
+	//like in CStack::Speed, percents are taken only from bonuses of stack itself
+	int percentBonus = 0;
+	for(const Bonus *bonus : stack->getBonusList())
+		if(bonus->type == Bonus::STACKS_SPEED && !isRemoved(bonus))
+			percentBonus += bonus->additionalInfo;
+	for(const Bonus *bonus : getLimitedAddedBonuses())
+		if(bonus->type == Bonus::STACKS_SPEED)
+			percentBonus += bonus->additionalInfo;
+
+	return ((100 + percentBonus) * valOfBonuses(Bonus::STACKS_SPEED)) / 100;
+}
+
+bool CBattleSnapshot::StackState::isRemoved(const Bonus *bonus) const
+{
+	if(dropNegativeEffects && bonus->sourceSpell() && bonus->sourceSpell()->isNegative())
+		return true;
+
+	return (dropUntilAttack && Bonus::UntilAttack(bonus)) || (dropUntilBeingAttacked && Bonus::UntilBeingAttacked(bonus));
+}
+
+const TBonusListPtr CBattleSnapshot::StackState::getAllBonuses(const CSelector &selector, const CSelector &limit, const CBonusSystemNode *root /*= nullptr*/, const BonusCachingKey &cachingKey /*= BonusCachingKey()*/) const
+{
+	const TBonusListPtr originalList = stack->getAllBonuses(selector, limit, root, cachingKey);
+	if(addedBonuses.empty() && !dropUntilAttack && !dropUntilBeingAttacked && !dropNegativeEffects)
+		return originalList; //unchanged stacks don't pay for copying
+
+	TBonusListPtr ret = make_shared<BonusList>();
+	for(Bonus *bonus : *originalList)
+		if(!isRemoved(bonus))
+			ret->push_back(bonus);
+
+	for(Bonus *bonus : getLimitedAddedBonuses())
+	{
+		if(selector(bonus) && (limit ? limit(bonus) : bonus->effectRange == Bonus::NO_LIMIT))
+			ret->push_back(bonus);
+	}
+
+	return ret;
+}
+
+std::vector<Bonus *> CBattleSnapshot::StackState::getLimitedAddedBonuses() const
+{
+	std::vector<Bonus *> ret, undecided;
+	for(auto &bonus : addedBonuses)
+		(bonus.limiter ? undecided : ret).push_back(const_cast<Bonus *>(&bonus));
+
+	if(undecided.empty())
+		return ret;
+
+	//decided like in CBonusSystemNode::limitBonuses, limiters may check other bonuses of stack
+	BonusList accepted;
+	for(Bonus *bonus : *stack->IBonusBearer::getAllBonuses())
+		if(!isRemoved(bonus))
+			accepted.push_back(bonus);
+	for(Bonus *bonus : ret)
+		accepted.push_back(bonus);
+
+	while(true)
+	{
+		const size_t undecidedCount = undecided.size();
+		vstd::erase_if(undecided, [&](Bonus *bonus) -> bool
+		{
+			BonusLimitationContext context = {bonus, *stack, accepted};
+			const int decision = bonus->limiter->limit(context);
+			if(decision == ILimiter::ACCEPT)
+			{
+				accepted.push_back(bonus);
+				ret.push_back(bonus);
+			}
+			return decision != ILimiter::NOT_SURE;
+		});
+
+		if(undecided.size() == undecidedCount) //bonuses still not sure are dropped
+			break;
+	}
+
+	return ret;
+}
+
+/// Bonuses with propagator are attached only to nodes accepted by it, stacks in battle have no children to pass them to
+static bool attachesToStack(const Bonus &bonus, const CStack *stack)
+{
+	return !bonus.propagator || bonus.propagator->shouldBeAttached(const_cast<CStack *>(stack));
+}
+
+CBattleSnapshot::CBattleSnapshot(const CBattleInfoCallback *Cb)
+	: cb(Cb)
+{
+	for(const CStack *stack : cb->battleGetAllStacks())
+		stacks.push_back(make_shared<StackState>(stack));
+}
+
+const CBattleSnapshot::StackState & CBattleSnapshot::getStack(const CStack *stack) const
+{
+	return getStack(stack->ID);
+}
+
+const CBattleSnapshot::StackState & CBattleSnapshot::getStack(ui32 stackID) const
+{
+	for(auto &state : stacks)
+		if(state->stack->ID == stackID)
+			return *state;
+
+	throw std::runtime_error("Snapshot has no stack with ID " + boost::lexical_cast<std::string>(stackID));
+}
+
+TStacks CBattleSnapshot::getAliveStacks() const
+{
+	TStacks ret;
+	for(auto &state : stacks)
+		if(state->alive)
+			ret.push_back(state->stack);
+	return ret;
+}
+
+CBattleSnapshot::StackState & CBattleSnapshot::modifyStack(ui32 stackID)
+{
+	for(auto &state : stacks)
+	{
+		if(state->stack->ID == stackID)
+		{
+			if(!state.unique())
+				state = make_shared<StackState>(*state);
+			return *state;
+		}
+	}
+
+	throw std::runtime_error("Snapshot has no stack with ID " + boost::lexical_cast<std::string>(stackID));
+}
+
+BattleAttackInfo CBattleSnapshot::makeAttackInfo(const CStack *attacker, const CStack *defender, bool shooting) const
+{
+	const StackState &attackerState = getStack(attacker), &defenderState = getStack(defender);
+
+	BattleAttackInfo bai(attacker, defender, shooting);
+	bai.attackerBonuses = &attackerState; //valid until the snapshot is changed
+	bai.defenderBonuses = &defenderState;
+	bai.attackerPosition = attackerState.position;
+	bai.defenderPosition = defenderState.position;
+	bai.attackerCount = attackerState.count;
+	bai.defenderCount = defenderState.count;
+	return bai;
+}
+
+AccessibilityInfo CBattleSnapshot::getAccesibility(const std::vector<BattleHex> &accessibleHexes /*= std::vector<BattleHex>()*/) const
+{
+	AccessibilityInfo ret = cb->getAccesibility();
+
+	//stacks moved or killed in snapshot free their real hexes, then stacks moved or revived take their new ones
+	for(auto &state : stacks)
+	{
+		if(state->stack->alive() && (!state->alive || state->position != state->stack->position))
+			for(auto hex : state->stack->getHexes())
+				if(hex.isAvailable() && ret[hex] == EAccessibility::ALIVE_STACK)
+					ret[hex] = EAccessibility::ACCESSIBLE;
+	}
+	for(auto &state : stacks)
+	{
+		if(state->alive && (!state->stack->alive() || state->position != state->stack->position))
+			for(auto hex : state->stack->getHexes(state->position))
+				if(hex.isAvailable())
+					ret[hex] = EAccessibility::ALIVE_STACK;
+	}
+
+	for(auto hex : accessibleHexes)
+		if(hex.isValid())
+			ret[hex] = EAccessibility::ACCESSIBLE;
+
+	return ret;
+}
+
+ReachabilityInfo CBattleSnapshot::getReachability(const CStack *stack) const
+{
+	const StackState &state = getStack(stack);
+
+	ReachabilityInfo::Parameters params(stack);
+	params.startPosition = state.position;
+	params.knownAccessible = stack->getHexes(state.position);
+	params.flying = state.hasBonusOfType(Bonus::FLYING);
+	if(cb->battleGetMySide() != BattlePerspective::ALL_KNOWING)
+		params.perspective = cb->battleGetMySide(); //we don't see obstacles from the perspective of enemy
+
+	//while stacks stand where they do in battle, the result cached by battle can be used
+	const bool layoutChanged = vstd::contains_if(stacks, [](const shared_ptr<StackState> &other)
+	{
+		return other->alive != other->stack->alive() || (other->alive && other->position != other->stack->position);
+	});
+	if(!layoutChanged)
+		return cb->getReachability(params);
+
+	const AccessibilityInfo accessibility = getAccesibility(params.knownAccessible);
+	if(!params.flying)
+		return cb->makeBFS(accessibility, params);
+
+	ReachabilityInfo ret;
+	ret.accessibility = accessibility;
+	ret.params = params;
+	for(int i = 0; i < GameConstants::BFIELD_SIZE; i++)
+	{
+		if(ret.accessibility.accessible(i, params.doubleWide, params.attackerOwned))
+		{
+			ret.predecessors[i] = params.startPosition;
+			ret.distances[i] = BattleHex::getDistance(params.startPosition, i);
+		}
+	}
+	return ret;
+}
+
+std::vector<BattleHex> CBattleSnapshot::getAvailableHexes(const CStack *stack, const ReachabilityInfo &reachability) const
+{
+	std::vector<BattleHex> ret;
+	const StackState &state = getStack(stack);
+	if(!state.alive || !state.position.isValid()) //turrets
+		return ret;
+
+	//like CBattleInfoCallback::battleGetAvailableHexes
+	const bool tacticsMove = cb->battleTacticDist() && cb->battleGetTacticsSide() == !stack->attackerOwned;
+	const ui32 speed = state.Speed();
+	for(int i = 0; i < GameConstants::BFIELD_SIZE; i++)
+	{
+		if(!reachability.isReachable(i))
+			continue;
+		if(tacticsMove ? !cb->isInTacticRange(i) : reachability.distances[i] > speed)
+			continue;
+
+		ret.push_back(i);
+	}
+
+	return ret;
+}
+
+bool CBattleSnapshot::isBlocked(const CStack *stack) const
+{
+	const StackState &state = getStack(stack);
+	if(state.hasBonusOfType(Bonus::SIEGE_WEAPON)) //siege weapons cannot be blocked
+		return false;
+
+	const auto neighbours = stack->getSurroundingHexes(state.position);
+	for(auto &other : stacks)
+	{
+		if(!other->alive || other->stack->owner == stack->owner)
+			continue;
+
+		for(auto hex : other->stack->getHexes(other->position))
+			if(vstd::contains(neighbours, hex))
+				return true;
+	}
+
+	return false;
+}
+
+bool CBattleSnapshot::canShoot(const CStack *stack, const CStack *target) const
+{
+	//like CBattleInfoCallback::battleCanShoot
+	const StackState &state = getStack(stack), &targetState = getStack(target);
+	if(cb->battleTacticDist() || !state.alive || !targetState.alive || stack->owner == target->owner)
+		return false;
+
+	if(state.hasBonusOfType(Bonus::FORGETFULL) || stack->getCreature()->idNumber == CreatureID::CATAPULT)
+		return false;
+
+	return state.hasBonusOfType(Bonus::SHOOTER)
+		&& state.shots
+		&& (!isBlocked(stack) || state.hasBonusOfType(Bonus::FREE_SHOOTING));
+}
+
+BattleStackAttacked CBattleSnapshot::makeAttacked(const CStack *stack, ui32 damage, const CStack *attacker /*= nullptr*/) const
+{
+	const StackState &state = getStack(stack);
+	auto afterAttack = state.countKilledByAttack(damage);
+
+	BattleStackAttacked bsa;
+	bsa.stackAttacked = stack->ID;
+	bsa.attackerID = attacker ? attacker->ID : -1;
+	bsa.damageAmount = damage;
+	bsa.killedAmount = std::min<ui32>(afterAttack.first, state.count);
+	bsa.newAmount = state.count - bsa.killedAmount;
+	bsa.newHP = afterAttack.second;
+	if(!bsa.newAmount)
+		bsa.flags |= damage && vstd::contains(stack->state, EBattleStackState::CLONED) ? BattleStackAttacked::CLONE_KILLED : BattleStackAttacked::KILLED;
+
+	return bsa;
+}
+
+void CBattleSnapshot::apply(const BattleStackMoved &bsm)
+{
+	modifyStack(bsm.stack).position = bsm.tilesToMove.back();
+}
+
+void CBattleSnapshot::apply(const BattleStackAttacked &bsa)
+{
+	StackState &state = modifyStack(bsa.stackAttacked);
+	state.count = bsa.newAmount;
+	state.firstHPleft = bsa.newHP;
+	state.alive = !bsa.killed() || bsa.willRebirth();
+
+	for(auto &shr : bsa.healedStacks) //life drain
+		apply(shr);
+}
+
+void CBattleSnapshot::apply(const BattleAttack &ba)
+{
+	StackState &attacker = modifyStack(ba.stackAttacking);
+	if(ba.counter())
+		attacker.counterAttacks--;
+
+	if(ba.shot())
+	{
+		//don't remove ammo if we have a working ammo cart
+		const bool hasAmmoCart = vstd::contains_if(stacks, [&](const shared_ptr<StackState> &state)
+		{
+			return state->stack->owner == attacker.stack->owner && state->stack->getCreature()->idNumber == CreatureID::AMMO_CART && state->alive;
+		});
+		if(!hasAmmoCart)
+			attacker.shots--;
+	}
+
+	for(auto &bsa : ba.bsa)
+		apply(bsa);
+
+	attacker.dropUntilAttack = true;
+	vstd::erase_if(attacker.addedBonuses, [](const Bonus &bonus) { return Bonus::UntilAttack(&bonus); });
+
+	for(auto &bsa : ba.bsa)
+	{
+		StackState &attacked = modifyStack(bsa.stackAttacked);
+		attacked.dropUntilBeingAttacked = true;
+		vstd::erase_if(attacked.addedBonuses, [](const Bonus &bonus) { return Bonus::UntilBeingAttacked(&bonus); });
+	}
+}
+
+void CBattleSnapshot::apply(const SetStackEffect &sse)
+{
+	if(sse.effect.empty() && sse.uniqueBonuses.empty())
+		return;
+
+	const int spellID = sse.effect.empty() ? sse.uniqueBonuses.front().second.sid : sse.effect.front().sid; //effects' source ID
+
+	//like SetStackEffect::applyGs, but renewed effects are not prolonged
+	for(ui32 id : sse.stacks)
+	{
+		StackState &state = modifyStack(id);
+		if(spellID == SpellID::DISRUPTING_RAY || spellID == SpellID::ACID_BREATH_DEFENSE || !state.hasBonus(Selector::source(Bonus::SPELL_EFFECT, spellID)))
+			for(auto &bonus : sse.effect)
+				if(attachesToStack(bonus, state.stack))
+					state.addedBonuses.push_back(bonus);
+	}
+
+	for(auto &para : sse.uniqueBonuses)
+	{
+		StackState &state = modifyStack(para.first);
+		if(attachesToStack(para.second, state.stack)
+			&& !state.hasBonus(Selector::source(Bonus::SPELL_EFFECT, spellID).And(Selector::typeSubtype(para.second.type, para.second.subtype))))
+			state.addedBonuses.push_back(para.second);
+	}
+}
+
+void CBattleSnapshot::apply(const StacksHealedOrResurrected &shr)
+{
+	//like StacksHealedOrResurrected::applyGs, without marking raised stacks as summoned
+	for(auto &heal : shr.healedStacks)
+	{
+		StackState &state = modifyStack(heal.stackID);
+		const bool resurrected = !state.alive;
+		if(resurrected)
+		{
+			if(!getAccesibility().accessible(state.position, state.stack))
+				return; //position is already occupied
+
+			state.alive = true;
+			state.dropNegativeEffects = true;
+			vstd::erase_if(state.addedBonuses, [](const Bonus &bonus) { return bonus.sourceSpell() && bonus.sourceSpell()->isNegative(); });
+		}
+
+		const ui32 maxHealth = state.MaxHealth();
+		const ui32 raised = std::min(heal.healedHP / maxHealth, state.stack->baseAmount - state.count);
+		state.count += raised;
+		state.firstHPleft += heal.healedHP - raised * maxHealth;
+		if(state.firstHPleft > maxHealth)
+		{
+			state.firstHPleft -= maxHealth;
+			if(state.stack->baseAmount > state.count)
+				state.count++;
+		}
+		vstd::amin(state.firstHPleft, maxHealth);
+	}
+}
@@ -0,0 +1,85 @@
+/*
+ * CBattleSnapshot.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#pragma once
+
+#include "BattleHex.h"
+#include "HeroBonus.h"
+#include "CBattleCallback.h"
+
+class CStack;
+struct BattleStackMoved;
+struct BattleStackAttacked;
+struct BattleAttack;
+struct SetStackEffect;
+struct StacksHealedOrResurrected;
+
+/// Hypothetical state of battle, used (eg. by AI) to evaluate sequences of actions without touching the real battle.
+/// Only the changeable part of stacks (position, health, counter-attacks, shots and received spell effects) is kept,
+/// everything else is read from the battle through callback. Stack states are shared between copies of snapshot
+/// and copied only when changed, so branching of search tree and discarding its leaves is cheap.
+/// Not simulated: rebirth chances, summoning of new stacks and effects on obstacles.
+class DLL_LINKAGE CBattleSnapshot
+{
+public:
+	/// State of stack in snapshot, it can be used instead of stack in bonus queries
+	class DLL_LINKAGE StackState : public IBonusBearer
+	{
+	public:
+		const CStack *stack;
+		BattleHex position;
+		ui32 count, firstHPleft;
+		ui8 counterAttacks;
+		si16 shots;
+		bool alive;
+
+		std::vector<Bonus> addedBonuses; //received in snapshot
+		bool dropUntilAttack, dropUntilBeingAttacked; //stack has attacked / has been attacked in snapshot, so such bonuses of real stack are gone
+		bool dropNegativeEffects; //stack has been resurrected in snapshot
+
+		StackState(const CStack *Stack);
+
+		std::pair<int,int> countKilledByAttack(int damageReceived) const; //returns pair<killed count, new left HP>
+		ui32 Speed() const; //like CStack::Speed with bind effect considered
+		bool isRemoved(const Bonus *bonus) const; //bonus of real stack is gone in snapshot
+
+		const TBonusListPtr getAllBonuses(const CSelector &selector, const CSelector &limit, const CBonusSystemNode *root = nullptr, const BonusCachingKey &cachingKey = BonusCachingKey()) const override;
+
+	private:
+		std::vector<Bonus *> getLimitedAddedBonuses() const; //added bonuses accepted by their limiters
+	};
+
+	CBattleSnapshot(const CBattleInfoCallback *Cb); //current state of battle as seen by callback
+
+	const StackState & getStack(const CStack *stack) const;
+	const StackState & getStack(ui32 stackID) const; //throws if there is no such stack
+	TStacks getAliveStacks() const; //stacks alive in snapshot
+	BattleAttackInfo makeAttackInfo(const CStack *attacker, const CStack *defender, bool shooting) const; //counts, positions and bonuses from snapshot
+
+	AccessibilityInfo getAccesibility(const std::vector<BattleHex> &accessibleHexes = std::vector<BattleHex>()) const; //given hexes will be marked as accessible
+	ReachabilityInfo getReachability(const CStack *stack) const;
+	std::vector<BattleHex> getAvailableHexes(const CStack *stack, const ReachabilityInfo &reachability) const; //movement destinations within stack's speed, reachability has to come from this snapshot
+	bool isBlocked(const CStack *stack) const; //there is enemy stack next to stack in snapshot
+	bool canShoot(const CStack *stack, const CStack *target) const;
+
+	BattleStackAttacked makeAttacked(const CStack *stack, ui32 damage, const CStack *attacker = nullptr) const; //result of dealing damage to stack (rebirth is not considered)
+
+	void apply(const BattleStackMoved &bsm);
+	void apply(const BattleStackAttacked &bsa);
+	void apply(const BattleAttack &ba);
+	void apply(const SetStackEffect &sse);
+	void apply(const StacksHealedOrResurrected &shr);
+
+private:
+	const CBattleInfoCallback *cb;
+	std::vector<shared_ptr<StackState> > stacks; //states of all stacks, shared with copies of snapshot until changed
+
+	StackState & modifyStack(ui32 stackID); //copies state of stack if it's shared
+};
@@ -26,6 +26,7 @@
 #include "GameConstants.h"
 #include "rmg/CMapGenerator.h"
 #include "CStopWatch.h"
+#include "CThreadHelper.h"
 
 DLL_LINKAGE std::minstd_rand ran;
 class CGObjectInstance;
@@ -1843,7 +1844,9 @@ int CGameState::getMovementCost(const CGHeroInstance *h, const int3 &src, const
 void CGameState::apply(CPack *pack)
 {
 	ui16 typ = typeList.getTypeID(pack);
-	applierGs->apps[typ]->applyOnGS(this,pack);
+	applierGs->getApplier(typ)->applyOnGS(this,pack);
+	if(curB)
+		curB->version++; //any pack may have changed the battle (stacks, obstacles, bonuses...)
 }
 
 void CGameState::calculatePaths(const CGHeroInstance *hero, CPathsInfo &out, int3 src, int movement)
@@ -1852,6 +1855,33 @@ void CGameState::calculatePaths(const CGHeroInstance *hero, CPathsInfo &out, int
 	pathfinder.calculatePaths(src, movement);
 }
 
+void CGameState::calculatePaths(const CGHeroInstance *hero, CPathsInfo &out, const std::vector<int3> &destinations, int3 src, int movement)
+{
+	CPathfinder pathfinder(out, this, hero);
+	pathfinder.calculatePaths(destinations, src, movement);
+}
+
+void CGameState::calculatePaths(const std::vector<const CGHeroInstance *> &heroes, const std::vector<CPathsInfo *> &out)
+{
+	assert(heroes.size() == out.size());
+
+	//searches only read gamestate and each of them has its own workspace, so they don't need any synchronization
+	//pool threads are persistent, so their node queues are reused by following batches
+	std::vector<Task> tasks;
+	for(size_t i = 0; i < heroes.size(); i++)
+	{
+		const CGHeroInstance *hero = heroes[i];
+		CPathsInfo *paths = out[i];
+		tasks.push_back([this, hero, paths]
+		{
+			CPathfinder pathfinder(*paths, this, hero);
+			pathfinder.calculatePaths();
+		});
+	}
+
+	CThreadPool::get().run(tasks);
+}
+
 /**
  * Tells if the tile is guarded by a monster as well as the position
  * of the monster that will attack on it.
@@ -2664,7 +2694,12 @@ bool CGameState::isUsedHero(HeroTypeID hid) const
 }
 
 CGPathNode::CGPathNode()
-:coord(-1,-1,-1)
+:coord(-1,-1,-1), generation(0)
+{
+	reset();
+}
+
+void CGPathNode::reset()
 {
 	accessible = NOT_SET;
 	land = 0;
@@ -2683,7 +2718,7 @@ bool CPathsInfo::getPath( const int3 &dst, CGPath &out )
 	assert(isValid);
 
 	out.nodes.clear();
-	const CGPathNode *curnode = &nodes[dst.x][dst.y][dst.z];
+	const CGPathNode *curnode = getNode(dst);
 	if(!curnode->theNodeBefore)
 		return false;
 
@@ -2698,31 +2733,85 @@ bool CPathsInfo::getPath( const int3 &dst, CGPath &out )
 }
 
 CPathsInfo::CPathsInfo( const int3 &Sizes )
-:sizes(Sizes)
+:sizes(Sizes), generation(0), nodes(sizes.x * sizes.y * sizes.z)
 {
+	isValid = isRepairable = tilesInvalidated = false;
 	hero = nullptr;
-	nodes = new CGPathNode**[sizes.x];
-	for(int i = 0; i < sizes.x; i++)
+	maxMovePoints[0] = maxMovePoints[1] = 0;
+	int3 pos;
+	for(pos.z = 0; pos.z < sizes.z; pos.z++)
+		for(pos.y = 0; pos.y < sizes.y; pos.y++)
+			for(pos.x = 0; pos.x < sizes.x; pos.x++)
+				nodes[getIndex(pos)].coord = pos;
+}
+
+CGPathNode *CPathsInfo::getNode(const int3 &coord)
+{
+	CGPathNode &node = nodes[getIndex(coord)];
+	if(node.generation != generation)
 	{
-		nodes[i] = new CGPathNode*[sizes.y];
-		for (int j = 0; j < sizes.y; j++)
-		{
-			nodes[i][j] = new CGPathNode[sizes.z];
-		}
+		node.reset();
+		node.generation = generation;
 	}
+	return &node;
 }
 
-CPathsInfo::~CPathsInfo()
+void CPathsInfo::nextGeneration()
 {
-	for(int i = 0; i < sizes.x; i++)
+	if(!++generation)
 	{
-		for (int j = 0; j < sizes.y; j++)
-		{
-			delete [] nodes[i][j];
-		}
-		delete [] nodes[i];
+		//counter wrapped around, stamps of old nodes could be taken for current ones
+		for(auto &node : nodes)
+			node.generation = 0;
+		generation = 1;
+	}
+}
+
+void CPathsInfo::invalidate()
+{
+	isValid = isRepairable = tilesInvalidated = false;
+	changedTiles.clear();
+}
+
+void CPathsInfo::invalidateTiles(const std::vector<int3> &tiles)
+{
+	isValid = false;
+	if(isRepairable)
+	{
+		tilesInvalidated = true;
+		changedTiles.insert(changedTiles.end(), tiles.begin(), tiles.end());
 	}
-	delete [] nodes;
+}
+
+CPathsInfo::CostInputs::CostInputs()
+	: pathfindingLevel(0), flying(false), freeFlying(false), waterWalking(false), freeWaterWalking(false)
+{
+}
+
+CPathsInfo::CostInputs::CostInputs(const CGHeroInstance *h)
+{
+	for(auto &stack : h->Slots())
+		nativeTerrains.push_back(VLC->townh->factions[stack.second->type->faction]->nativeTerrain);
+	boost::sort(nativeTerrains);
+	nativeTerrains.erase(boost::unique(nativeTerrains).end(), nativeTerrains.end());
+
+	pathfindingLevel = h->getSecSkillLevel(SecondarySkill::PATHFINDING);
+	flying = h->hasBonusOfType(Bonus::FLYING_MOVEMENT);
+	freeFlying = h->hasBonusOfType(Bonus::FLYING_MOVEMENT, 1);
+	waterWalking = h->hasBonusOfType(Bonus::WATER_WALKING);
+	freeWaterWalking = h->hasBonusOfType(Bonus::WATER_WALKING, 1);
+}
+
+bool CPathsInfo::CostInputs::operator==(const CostInputs &other) const
+{
+	return nativeTerrains == other.nativeTerrains && pathfindingLevel == other.pathfindingLevel
+		&& flying == other.flying && freeFlying == other.freeFlying
+		&& waterWalking == other.waterWalking && freeWaterWalking == other.freeWaterWalking;
+}
+
+bool CPathsInfo::CostInputs::operator!=(const CostInputs &other) const
+{
+	return !(*this == other);
 }
 
 int3 CGPath::startPos() const
@@ -3034,30 +3123,30 @@ TeamState::TeamState()
 
 void CPathfinder::initializeGraph()
 {
-	CGPathNode ***graph = out.nodes;
-	for(size_t i=0; i < out.sizes.x; ++i)
-	{
-		for(size_t j=0; j < out.sizes.y; ++j)
-		{
-			for(size_t k=0; k < out.sizes.z; ++k)
-			{
-				curPos = int3(i,j,k);
-				const TerrainTile *tinfo = &gs->map->getTile(int3(i, j, k));
-				CGPathNode &node = graph[i][j][k];
-				node.accessible = evaluateAccessibility(tinfo);
-				node.turns = 0xff;
-				node.moveRemains = 0;
-				node.coord.x = i;
-				node.coord.y = j;
-				node.coord.z = k;
-                node.land = tinfo->terType != ETerrainType::WATER;
-				node.theNodeBefore = nullptr;
-			}
-		}
-	}
+	//full search initializes all nodes, so accessibility of unreachable tiles is known as well
+	int3 pos;
+	for(pos.z = 0; pos.z < out.sizes.z; ++pos.z)
+		for(pos.y = 0; pos.y < out.sizes.y; ++pos.y)
+			for(pos.x = 0; pos.x < out.sizes.x; ++pos.x)
+				getNode(pos);
+}
+
+void CPathfinder::initializeNode(CGPathNode &node)
+{
+	curPos = node.coord;
+	const TerrainTile *tinfo = &gs->map->getTile(curPos);
+	node.reset();
+	node.generation = out.generation;
+	node.accessible = evaluateAccessibility(tinfo);
+	node.land = tinfo->terType != ETerrainType::WATER;
 }
 
 void CPathfinder::calculatePaths(int3 src /*= int3(-1,-1,-1)*/, int movement /*= -1*/)
+{
+	calculatePaths(std::vector<int3>(), src, movement);
+}
+
+void CPathfinder::calculatePaths(const std::vector<int3> &dsts, int3 src /*= int3(-1,-1,-1)*/, int movement /*= -1*/)
 {
 	assert(hero);
 	assert(hero == getHero(hero->id));
@@ -3066,33 +3155,54 @@ void CPathfinder::calculatePaths(int3 src /*= int3(-1,-1,-1)*/, int movement /*=
 	if(movement < 0)
 		movement = hero->movement;
 
-	out.hero = hero;
-	out.hpos = src;
-
 	if(!gs->map->isInTheMap(src)/* || !gs->map->isInTheMap(dest)*/) //check input
 	{
         logGlobal->errorStream() << "CGameState::calculatePaths: Hero outside the gs->map? How dare you...";
+		out.hero = hero;
+		out.hpos = src;
+		out.isRepairable = false;
 		return;
 	}
 
-	initializeGraph();
+	queue.clear();
 
+	destinations = dsts;
+	destinationFound.assign(destinations.size(), false);
+	destinationsLeft = destinations.size();
+	if(destinations.empty() && canRepairGraph(src, movement))
+	{
+		repairGraph(src, movement);
+	}
+	else
+	{
+		out.nextGeneration();
+		if(destinations.empty())
+			initializeGraph();
+		else
+			initializeHeuristic(); //nodes are initialized when search reaches them
 
-	//initial tile - set cost on 0 and add to the queue
-	CGPathNode &initialNode = *getNode(src);
-	initialNode.turns = 0;
-	initialNode.moveRemains = movement;
-	mq.push_back(&initialNode);
+		//initial tile - set cost on 0 and add to the queue
+		CGPathNode &initialNode = *getNode(src);
+		initialNode.turns = 0;
+		initialNode.moveRemains = movement;
+		pushNode(&initialNode);
+	}
+
+	out.hero = hero;
+	out.hpos = src;
+	out.maxMovePoints[0] = hero->maxMovePoints(false);
+	out.maxMovePoints[1] = hero->maxMovePoints(true);
+	out.costInputs = CPathsInfo::CostInputs(hero);
+	out.tilesInvalidated = false;
+	out.changedTiles.clear();
 
 	std::vector<int3> neighbours;
 	neighbours.reserve(16);
-	while(!mq.empty())
+	while(popNode())
 	{
-		cp = mq.front();
-		mq.pop_front();
 
 		const int3 sourceGuardPosition = guardingCreaturePosition(cp->coord);
-		bool guardedSource = (sourceGuardPosition != int3(-1, -1, -1) && cp->coord != src);
+		const bool guardedSource = isGuardedSource(cp, src);
 		ct = &gs->map->getTile(cp->coord);
 
 		int movement = cp->moveRemains, turn = cp->turns;
@@ -3146,10 +3256,6 @@ void CPathfinder::calculatePaths(int3 src /*= int3(-1,-1,-1)*/, int movement /*=
 			if(!canMoveBetween(cp->coord, dp->coord) || dp->accessible == CGPathNode::BLOCKED )
 				continue;
 
-			//special case -> hero embarked a boat standing on a guarded tile -> we must allow to move away from that tile
-            if(cp->accessible == CGPathNode::VISITABLE && guardedSource && cp->theNodeBefore->land && ct->topVisitableId() == Obj::BOAT)
-				guardedSource = false;
-
 			int cost = gs->getMovementCost(hero, cp->coord, dp->coord, movement);
 
 			//special case -> moving from src Subterranean gate to dest gate -> it's free
@@ -3184,26 +3290,322 @@ void CPathfinder::calculatePaths(int3 src /*= int3(-1,-1,-1)*/, int movement /*=
 				dp->turns = turnAtNextTile;
 				dp->theNodeBefore = cp;
 
-				const bool guardedDst = guardingCreaturePosition(dp->coord) != int3(-1, -1, -1)
-										&& dp->accessible == CGPathNode::BLOCKVIS;
-
-				if (dp->accessible == CGPathNode::ACCESSIBLE
-					|| (useEmbarkCost && allowEmbarkAndDisembark)
-					|| destTopVisObjID == Obj::SUBTERRANEAN_GATE
-					|| (guardedDst && !guardedSource)) // Can step into a hostile tile once.
+				if(isExpandable(dp, useEmbarkCost, guardedSource))
+				{
+					pushNode(dp);
+				}
+				else if(isDestination(dp->coord))
 				{
-					mq.push_back(dp);
+					pushNode(dp, false);
 				}
 			}
 		} //neighbours loop
 	} //queue loop
 
 	out.isValid = true;
+	out.isRepairable = destinations.empty();
+}
+
+void CPathfinder::initializeHeuristic()
+{
+	gates.clear();
+	if(useSubterraneanGates)
+	{
+		for(const CGObjectInstance *obj : gs->map->objects)
+			if(obj && obj->ID == Obj::SUBTERRANEAN_GATE)
+				gates.push_back(obj->visitablePos());
+	}
+
+	// Cheapest move is along cobblestone road or across water with favourable winds (2/3 of the cost)
+	minStepCost = 50;
+	for(int cost : VLC->heroh->terrCosts)
+		vstd::amin(minStepCost, cost);
+	minStepCost = minStepCost * 2 / 3;
+
+	// Movement points may get scaled on (dis)embarking with free boarding, heuristic wouldn't be admissible
+	if(hero->hasBonusOfType(Bonus::FREE_SHIP_BOARDING))
+		minStepCost = 0;
+
+	maxTurnMovement = std::max(hero->maxMovePoints(true), hero->maxMovePoints(false));
+}
+
+int CPathfinder::estimateDistance(const int3 &from) const
+{
+	auto tilesBetween = [](const int3 &a, const int3 &b)
+	{
+		return std::max(std::abs(a.x - b.x), std::abs(a.y - b.y));
+	};
+
+	//path leading through gates has to reach a gate on our level and leave from a gate on destination level
+	int toGate = INT_MAX;
+	for(const int3 &gate : gates)
+		if(gate.z == from.z)
+			vstd::amin(toGate, tilesBetween(from, gate));
+
+	int ret = INT_MAX;
+	for(size_t i = 0; i < destinations.size(); i++)
+	{
+		if(destinationFound[i])
+			continue;
+
+		const int3 &dst = destinations[i];
+		if(dst.z == from.z)
+			vstd::amin(ret, tilesBetween(from, dst));
+
+		if(toGate != INT_MAX)
+		{
+			for(const int3 &gate : gates)
+				if(gate.z == dst.z)
+					vstd::amin(ret, toGate + tilesBetween(gate, dst));
+		}
+	}
+
+	return ret == INT_MAX ? 0 : ret; //unreachable destinations -> no estimation
+}
+
+si64 CPathfinder::estimatePriority(const CGPathNode *node) const
+{
+	//state (turns, remaining movement points) in which we could reach the destination at best
+	const int needed = destinations.empty() ? 0 : estimateDistance(node->coord) * minStepCost;
+	int turns = node->turns;
+	int remains = node->moveRemains;
+	if(remains >= needed)
+		remains -= needed;
+	else
+	{
+		const int extraTurns = (needed - remains + maxTurnMovement - 1) / maxTurnMovement;
+		turns += extraTurns;
+		remains = remains + extraTurns * maxTurnMovement - needed;
+	}
+
+	return (static_cast<si64>(turns) << 32) - remains;
+}
+
+bool CPathfinder::canRepairGraph(const int3 &src, int movement)
+{
+	//repair is safe only if the last search is known to be outdated by given tiles and nothing else
+	if(!out.isRepairable || !out.tilesInvalidated || out.hero != hero
+		|| out.maxMovePoints[0] != hero->maxMovePoints(false) || out.maxMovePoints[1] != hero->maxMovePoints(true)
+		|| out.costInputs != CPathsInfo::CostInputs(hero))
+		return false;
+
+	//hero may have moved, but only along known path and not into guarded tile, which would end its movement
+	if(src != out.hpos && guardingCreaturePosition(src) != int3(-1, -1, -1))
+		return false;
+
+	const CGPathNode *node = getNode(src);
+	return node->turns == 0 && node->moveRemains == movement;
+}
+
+void CPathfinder::repairGraph(const int3 &src, int movement)
+{
+	enum ENodeState {UNKNOWN, VALID, INVALID, UNREACHED};
+
+	std::vector<ui8> state(out.nodes.size(), UNKNOWN);
+	std::vector<bool> affected(out.nodes.size(), false);
+	for(const int3 &tile : out.changedTiles)
+	{
+		if(gs->map->isInTheMap(tile))
+			affected[out.getIndex(tile)] = true;
+	}
+	//hero changes accessibility of tiles it leaves and enters
+	affected[out.getIndex(out.hpos)] = true;
+	affected[out.getIndex(src)] = true;
+
+	//path of node is still the best one if it starts at hero position and doesn't lead through any changed tile
+	//when hero moved, paths that didn't pass its new position are outdated as well
+	const size_t srcIndex = out.getIndex(src);
+	std::vector<size_t> chain;
+	for(size_t i = 0; i < out.nodes.size(); i++)
+	{
+		size_t cur = i;
+		while(state[cur] == UNKNOWN)
+		{
+			const CGPathNode &node = out.nodes[cur];
+			if(cur == srcIndex)
+				state[cur] = VALID;
+			else if(!node.reachable())
+				state[cur] = affected[cur] ? INVALID : UNREACHED;
+			else if(affected[cur] || !node.theNodeBefore)
+				state[cur] = INVALID;
+			else
+			{
+				chain.push_back(cur);
+				cur = node.theNodeBefore - &out.nodes[0];
+			}
+		}
+		for(size_t link : chain)
+			state[link] = state[cur];
+		chain.clear();
+	}
+
+	for(size_t i = 0; i < out.nodes.size(); i++)
+	{
+		CGPathNode &node = out.nodes[i];
+		if(affected[i])
+		{
+			initializeNode(node);
+		}
+		else if(state[i] == INVALID)
+		{
+			node.turns = 0xff;
+			node.moveRemains = 0;
+			node.theNodeBefore = nullptr;
+		}
+	}
+
+	CGPathNode &initialNode = out.nodes[srcIndex];
+	initialNode.turns = 0;
+	initialNode.moveRemains = movement;
+	initialNode.theNodeBefore = nullptr;
+
+	//search continues from valid nodes bordering outdated ones, it will stop where paths are unchanged
+	for(size_t i = 0; i < out.nodes.size(); i++)
+	{
+		if(state[i] != VALID)
+			continue;
+
+		CGPathNode &node = out.nodes[i];
+		const TerrainTile &tile = gs->map->getTile(node.coord);
+		bool bordersInvalid = tile.topVisitableId() == Obj::SUBTERRANEAN_GATE; //gate exit is neighbour as well
+		for(int dx = -1; dx <= 1 && !bordersInvalid; dx++)
+		{
+			for(int dy = -1; dy <= 1 && !bordersInvalid; dy++)
+			{
+				const int3 pos = node.coord + int3(dx, dy, 0);
+				if(gs->map->isInTheMap(pos) && state[out.getIndex(pos)] == INVALID)
+					bordersInvalid = true;
+			}
+		}
+		if(!bordersInvalid)
+			continue;
+
+		const CGPathNode *parent = node.theNodeBefore;
+		const bool embarking = parent && parent->land != node.land && (!parent->land || tile.topVisitableId() == Obj::BOAT);
+		if(!parent || isExpandable(&node, embarking, isGuardedSource(parent, src)))
+			pushNode(&node);
+	}
+}
+
+bool CPathfinder::isGuardedSource(const CGPathNode *node, const int3 &src) const
+{
+	if(node->coord == src || guardingCreaturePosition(node->coord) == int3(-1, -1, -1))
+		return false;
+
+	//special case -> hero embarked a boat standing on a guarded tile -> we must allow to move away from that tile
+	return !(node->accessible == CGPathNode::VISITABLE && node->theNodeBefore->land
+		&& gs->map->getTile(node->coord).topVisitableId() == Obj::BOAT);
+}
+
+bool CPathfinder::isExpandable(const CGPathNode *node, bool embarking, bool guardedSource) const
+{
+	const bool guardedDst = guardingCreaturePosition(node->coord) != int3(-1, -1, -1)
+							&& node->accessible == CGPathNode::BLOCKVIS;
+
+	return node->accessible == CGPathNode::ACCESSIBLE
+		|| (embarking && allowEmbarkAndDisembark)
+		|| gs->map->getTile(node->coord).topVisitableId() == Obj::SUBTERRANEAN_GATE
+		|| (guardedDst && !guardedSource); // Can step into a hostile tile once.
+}
+
+bool CPathfinder::isDestination(const int3 &coord) const
+{
+	return vstd::contains(destinations, coord);
+}
+
+void CPathfinder::pushNode(CGPathNode *node, bool expand /*= true*/)
+{
+	PrioritizedNode entry = {estimatePriority(node), node->turns, node->moveRemains, expand, node};
+	queue.push(entry);
+}
+
+bool CPathfinder::popNode()
+{
+	while(!queue.empty())
+	{
+		const PrioritizedNode top = queue.pop();
+		if(top.node->turns != top.turns || top.node->moveRemains != top.moveRemains)
+			continue; //node was improved after it was queued, there is other entry for it
+
+		for(size_t i = 0; i < destinations.size(); i++)
+		{
+			if(!destinationFound[i] && destinations[i] == top.node->coord)
+			{
+				//priority is exact for destination and all other nodes are estimated to be worse -> path is final
+				destinationFound[i] = true;
+				if(!--destinationsLeft)
+					return false;
+			}
+		}
+
+		if(top.expand)
+		{
+			cp = top.node;
+			return true;
+		}
+	}
+	return false;
 }
 
 CGPathNode *CPathfinder::getNode(const int3 &coord)
 {
-	return &out.nodes[coord.x][coord.y][coord.z];
+	CGPathNode &node = out.nodes[out.getIndex(coord)];
+	if(node.generation != out.generation)
+		initializeNode(node);
+	return &node;
+}
+
+CPathfinder::NodeQueue::NodeQueue() : first(0), count(0)
+{
+}
+
+void CPathfinder::NodeQueue::push(const PrioritizedNode &entry)
+{
+	//priority of bucket t is in ((t-1) << 32, t << 32], movement points left are below 2^32
+	const size_t index = static_cast<size_t>((entry.priority + 0xffffffffLL) >> 32);
+	if(index >= buckets.size())
+		buckets.resize(index + 1);
+
+	auto &bucket = buckets[index];
+	bucket.push_back(entry);
+	std::push_heap(bucket.begin(), bucket.end());
+	vstd::amin(first, index);
+	count++;
+}
+
+CPathfinder::PrioritizedNode CPathfinder::NodeQueue::pop()
+{
+	assert(count);
+	while(buckets[first].empty())
+		first++;
+
+	auto &bucket = buckets[first];
+	std::pop_heap(bucket.begin(), bucket.end());
+	const PrioritizedNode ret = bucket.back();
+	bucket.pop_back();
+	count--;
+	return ret;
+}
+
+bool CPathfinder::NodeQueue::empty() const
+{
+	return !count;
+}
+
+void CPathfinder::NodeQueue::clear()
+{
+	for(auto &bucket : buckets)
+		bucket.clear();
+	first = count = 0;
+}
+
+static boost::thread_specific_ptr<CPathfinder::NodeQueue> pathfinderQueue;
+
+static CPathfinder::NodeQueue &getPathfinderQueue()
+{
+	if(!pathfinderQueue.get())
+		pathfinderQueue.reset(new CPathfinder::NodeQueue());
+	return *pathfinderQueue;
 }
 
 bool CPathfinder::canMoveBetween(const int3 &a, const int3 &b) const
@@ -3285,7 +3687,7 @@ bool CPathfinder::goodForLandSeaTransition()
 	return true;
 }
 
-CPathfinder::CPathfinder(CPathsInfo &_out, CGameState *_gs, const CGHeroInstance *_hero) : CGameInfoCallback(_gs, boost::optional<PlayerColor>()), out(_out), hero(_hero), FoW(getPlayerTeam(hero->tempOwner)->fogOfWarMap)
+CPathfinder::CPathfinder(CPathsInfo &_out, CGameState *_gs, const CGHeroInstance *_hero) : CGameInfoCallback(_gs, boost::optional<PlayerColor>()), out(_out), hero(_hero), FoW(getPlayerTeam(hero->tempOwner)->fogOfWarMap), queue(getPathfinderQueue())
 {
 	useSubterraneanGates = true;
 	allowEmbarkAndDisembark = true;
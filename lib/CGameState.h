@@ -234,8 +234,10 @@ struct DLL_LINKAGE CGPathNode
 	ui32 moveRemains;
 	CGPathNode * theNodeBefore;
 	int3 coord; //coordinates
+	ui32 generation; //search that set the node, data from older searches is stale
 
 	CGPathNode();
+	void reset(); //makes node unreached, keeps its coordinates
 	bool reachable() const;
 };
 
@@ -250,15 +252,41 @@ struct DLL_LINKAGE CGPath
 
 struct DLL_LINKAGE CPathsInfo
 {
+	/// Properties of hero which movement costs depend on, paths can be repaired only if they didn't change
+	struct DLL_LINKAGE CostInputs
+	{
+		std::vector<int> nativeTerrains; //of army stacks, sorted, without duplicates
+		ui8 pathfindingLevel;
+		bool flying, freeFlying, waterWalking, freeWaterWalking;
+
+		CostInputs();
+		CostInputs(const CGHeroInstance *h);
+		bool operator==(const CostInputs &other) const;
+		bool operator!=(const CostInputs &other) const;
+	};
+
 	bool isValid;
+	bool isRepairable; //paths of all tiles are known and outdated only by changedTiles, next search may repair them instead of starting from scratch
+	bool tilesInvalidated; //invalidateTiles was called since last search, only then the graph is repaired
+	std::vector<int3> changedTiles; //tiles which accessibility may have changed since last search
 	const CGHeroInstance *hero;
 	int3 hpos;
+	int maxMovePoints[2]; //[land] hero movement points in next turns assumed by last search
+	CostInputs costInputs; //assumed by last search
 	int3 sizes;
-	CGPathNode ***nodes; //[w][h][level]
+	ui32 generation; //incremented by every search, nodes left from previous searches are treated as unreached
+	std::vector<CGPathNode> nodes; //[level][h][w] in one block, use getNode to access
 
+	size_t getIndex(const int3 &coord) const
+	{
+		return (coord.z * sizes.y + coord.y) * sizes.x + coord.x;
+	}
+	CGPathNode *getNode(const int3 &coord); //resets stale node
+	void nextGeneration(); //invalidates all nodes at once
+	void invalidate(); //paths have to be calculated from scratch
+	void invalidateTiles(const std::vector<int3> &tiles); //paths have to be recalculated only around given tiles
 	bool getPath(const int3 &dst, CGPath &out);
 	CPathsInfo(const int3 &Sizes);
-	~CPathsInfo();
 };
 
 struct DLL_EXPORT DuelParameters
@@ -330,8 +358,44 @@ private:
 	const CGHeroInstance *hero;
 	const std::vector<std::vector<std::vector<ui8> > > &FoW;
 
-	std::list<CGPathNode*> mq; //BFS queue -> nodes to be checked
+public:
+	struct PrioritizedNode
+	{
+		si64 priority; //(turns << 32) - movement points left; for goal directed search state of arriving at the closest destination is estimated; lower is better
+		ui8 turns; //state of node when it was queued, entry is outdated if node was improved since then
+		ui32 moveRemains;
+		bool expand; //false if node is queued only to learn when it's path is final (destination that can't be passed)
+		CGPathNode *node;
 
+		bool operator<(const PrioritizedNode &other) const
+		{
+			return priority > other.priority; //heap functions put the greatest element on top
+		}
+	};
+
+	/// Priority queue of nodes with a bucket per turn, nodes inside bucket form a heap ordered by movement points.
+	/// Movement in one turn touches only a single bucket, so heaps stay small. Memory is kept between searches.
+	class NodeQueue
+	{
+		std::vector<std::vector<PrioritizedNode> > buckets; //[turn]
+		size_t first; //all buckets below are empty
+		size_t count;
+	public:
+		NodeQueue();
+		void push(const PrioritizedNode &entry);
+		PrioritizedNode pop();
+		bool empty() const;
+		void clear();
+	};
+
+private:
+	NodeQueue &queue; //per-thread workspace, reused by all searches on that thread
+	std::vector<int3> destinations; //goal directed search (A*), used when destinations are given
+	std::vector<bool> destinationFound;
+	size_t destinationsLeft;
+	std::vector<int3> gates; //subterranean gates positions, gates make possible jumping between far tiles at no cost
+	int minStepCost; //lower bound of movement cost of moving to neighbouring tile
+	int maxTurnMovement; //upper bound of movement points hero gets in a new turn
 
 	int3 curPos;
 	CGPathNode *cp; //current (source) path node -> we took it from the queue
@@ -341,8 +405,19 @@ private:
 	int destTopVisObjID;
 
 
-	CGPathNode *getNode(const int3 &coord);
+	CGPathNode *getNode(const int3 &coord); //initializes node on first use in this search
+	void initializeNode(CGPathNode &node);
+	bool canRepairGraph(const int3 &src, int movement);
+	void repairGraph(const int3 &src, int movement); //resets nodes which paths lead through changed tiles and queues nodes bordering them
 	void initializeGraph();
+	void initializeHeuristic();
+	int estimateDistance(const int3 &from) const; //lower bound of tiles that have to be passed to the closest destination
+	si64 estimatePriority(const CGPathNode *node) const;
+	bool isDestination(const int3 &coord) const;
+	void pushNode(CGPathNode *node, bool expand = true);
+	bool isGuardedSource(const CGPathNode *node, const int3 &src) const; //true if hero standing on node can only attack the guard
+	bool isExpandable(const CGPathNode *node, bool embarking, bool guardedSource) const; //true if hero can move further from node, not only end its path here
+	bool popNode(); //sets cp to the next node to be checked, returns false when search is over
 	bool goodForLandSeaTransition(); //checks if current move will be between sea<->land. If so, checks it legality (returns false if movement is not possible) and sets useEmbarkCost
 
 	CGPathNode::EAccessibility evaluateAccessibility(const TerrainTile *tinfo) const;
@@ -351,6 +426,7 @@ private:
 public:
 	CPathfinder(CPathsInfo &_out, CGameState *_gs, const CGHeroInstance *_hero);
 	void calculatePaths(int3 src = int3(-1,-1,-1), int movement = -1); //calculates possible paths for hero, by default uses current hero position and movement left; returns pointer to newly allocated CPath or nullptr if path does not exists
+	void calculatePaths(const std::vector<int3> &dsts, int3 src = int3(-1,-1,-1), int movement = -1); //goal directed search, stops when best paths to all dsts are known (other nodes may be not calculated); empty dsts => all paths are calculated
 };
 
 
@@ -402,6 +478,8 @@ public:
 	bool checkForVisitableDir(const int3 & src, const int3 & dst) const; //check if src tile is visitable from dst tile
 	bool checkForVisitableDir(const int3 & src, const TerrainTile *pom, const int3 & dst) const; //check if src tile is visitable from dst tile
 	void calculatePaths(const CGHeroInstance *hero, CPathsInfo &out, int3 src = int3(-1,-1,-1), int movement = -1); //calculates possible paths for hero, by default uses current hero position and movement left; returns pointer to newly allocated CPath or nullptr if path does not exists
+	void calculatePaths(const CGHeroInstance *hero, CPathsInfo &out, const std::vector<int3> &destinations, int3 src = int3(-1,-1,-1), int movement = -1); //as above but only paths to given destinations are guaranteed to be calculated (much faster for nearby tiles)
+	void calculatePaths(const std::vector<const CGHeroInstance *> &heroes, const std::vector<CPathsInfo *> &out); //calculates paths of many heroes concurrently (out[i] for heroes[i]); gamestate must not be changed until it returns
 	int3 guardingCreaturePosition (int3 pos) const;
 	std::vector<CGObjectInstance*> guardingCreatures (int3 pos) const;
 	int victoryCheck(PlayerColor player) const; //checks if given player is winner; -1 if std victory, 1 if special victory, 0 else
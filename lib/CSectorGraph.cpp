@@ -0,0 +1,444 @@
+/*
+ * CSectorGraph.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include "CSectorGraph.h"
+
+#include "IGameCallback.h"
+#include "CObjectHandler.h"
+#include "CHeroHandler.h"
+#include "VCMI_Lib.h"
+#include "mapping/CMap.h"
+
+CSectorGraph::CSectorGraph(const CGameInfoCallback *Cb) : cb(Cb)
+{
+	update();
+}
+
+void CSectorGraph::update()
+{
+	sizes = cb->getMapSize();
+	clustersCount = int3((sizes.x + CLUSTER_SIZE - 1) / CLUSTER_SIZE, (sizes.y + CLUSTER_SIZE - 1) / CLUSTER_SIZE, sizes.z);
+	sector.assign(sizes.x * sizes.y * sizes.z, -1);
+	portal.assign(sector.size(), -1);
+	portalCosts.assign(sector.size(), INT_MAX);
+	clusters.assign(clustersCount.x * clustersCount.y * clustersCount.z, Cluster());
+}
+
+void CSectorGraph::tilesChanged(const std::vector<int3> &tiles)
+{
+	for(const int3 &tile : tiles)
+	{
+		if(cb->isInTheMap(tile))
+			clusters[getCluster(tile)].dirty = true;
+	}
+}
+
+int CSectorGraph::getSector(const int3 &tile)
+{
+	if(!cb->isInTheMap(tile))
+		return -1;
+
+	rebuildDirtyClusters();
+	return sector[getIndex(tile)];
+}
+
+int CSectorGraph::getDistance(const int3 &src, const int3 &dst)
+{
+	const int srcSector = getSector(src), dstSector = getSector(dst);
+	if(srcSector < 0 || dstSector < 0)
+		return -1;
+	if(src == dst)
+		return 0;
+
+	std::vector<int> fromSrc, toDst;
+	searchSector(src, false, fromSrc);
+	searchSector(dst, true, toDst);
+
+	int best = INT_MAX;
+	if(srcSector == dstSector)
+		best = fromSrc[getLocalIndex(dst)];
+
+	//Dijkstra on portal graph, starts from portals of source sector and ends when no path can be shorter than best one
+	typedef std::pair<int, int> TCostAndTile;
+	std::priority_queue<TCostAndTile, std::vector<TCostAndTile>, std::greater<TCostAndTile> > queue;
+	std::vector<int> reached; //portals with cost set, to be reset after query
+	auto reach = [&](int tile, int cost)
+	{
+		if(portalCosts[tile] == INT_MAX)
+			reached.push_back(tile);
+		portalCosts[tile] = cost;
+		queue.push(std::make_pair(cost, tile));
+	};
+
+	const int dstCluster = getCluster(dst);
+	for(const Portal &p : clusters[getCluster(src)].portals)
+	{
+		const int cost = fromSrc[getLocalIndex(getTile(p.tile))];
+		if(cost != INT_MAX)
+			reach(p.tile, cost);
+	}
+
+	while(!queue.empty())
+	{
+		const TCostAndTile top = queue.top();
+		queue.pop();
+		if(top.first >= best)
+			break;
+		if(top.first > portalCosts[top.second])
+			continue; //outdated entry
+
+		const int3 tile = getTile(top.second);
+		const int cluster = getCluster(tile);
+		if(cluster == dstCluster && toDst[getLocalIndex(tile)] != INT_MAX)
+			vstd::amin(best, top.first + toDst[getLocalIndex(tile)]);
+		if(portal[top.second] < 0)
+			continue;
+
+		for(const Link &link : clusters[cluster].portals[portal[top.second]].links)
+		{
+			const int cost = top.first + link.cost;
+			if(cost < portalCosts[link.tile])
+				reach(link.tile, cost);
+		}
+	}
+
+	for(int tile : reached)
+		portalCosts[tile] = INT_MAX;
+
+	return best == INT_MAX ? -1 : best;
+}
+
+int CSectorGraph::getTurns(const CGHeroInstance *hero, const int3 &dst)
+{
+	const int cost = getDistance(hero->getPosition(false), dst);
+	if(cost < 0)
+		return -1;
+	const int movement = hero->movement;
+	if(cost <= movement)
+		return 0;
+
+	const int movePerDay = std::max<int>(1, hero->maxMovePoints(!hero->boat));
+	return (cost - movement + movePerDay - 1) / movePerDay;
+}
+
+int CSectorGraph::getIndex(const int3 &tile) const
+{
+	return (tile.z * sizes.y + tile.y) * sizes.x + tile.x;
+}
+
+int3 CSectorGraph::getTile(int index) const
+{
+	return int3(index % sizes.x, (index / sizes.x) % sizes.y, index / (sizes.x * sizes.y));
+}
+
+int CSectorGraph::getLocalIndex(const int3 &tile) const
+{
+	return (tile.y % CLUSTER_SIZE) * CLUSTER_SIZE + tile.x % CLUSTER_SIZE;
+}
+
+int CSectorGraph::getCluster(const int3 &tile) const
+{
+	return (tile.z * clustersCount.y + tile.y / CLUSTER_SIZE) * clustersCount.x + tile.x / CLUSTER_SIZE;
+}
+
+void CSectorGraph::getClusterTiles(int cluster, std::vector<int3> &tiles) const
+{
+	const int3 corner((cluster % clustersCount.x) * CLUSTER_SIZE,
+		(cluster / clustersCount.x) % clustersCount.y * CLUSTER_SIZE,
+		cluster / (clustersCount.x * clustersCount.y));
+
+	tiles.clear();
+	for(int y = corner.y; y < std::min(corner.y + CLUSTER_SIZE, sizes.y); y++)
+		for(int x = corner.x; x < std::min(corner.x + CLUSTER_SIZE, sizes.x); x++)
+			tiles.push_back(int3(x, y, corner.z));
+}
+
+void CSectorGraph::getNeighbourClusters(int cluster, std::vector<int> &out) const
+{
+	const int x = cluster % clustersCount.x, y = (cluster / clustersCount.x) % clustersCount.y, z = cluster / (clustersCount.x * clustersCount.y);
+	out.clear();
+	for(int ny = std::max(y - 1, 0); ny <= std::min(y + 1, clustersCount.y - 1); ny++)
+		for(int nx = std::max(x - 1, 0); nx <= std::min(x + 1, clustersCount.x - 1); nx++)
+			if(nx != x || ny != y)
+				out.push_back((z * clustersCount.y + ny) * clustersCount.x + nx);
+}
+
+const TerrainTile *CSectorGraph::getPassableTile(const int3 &tile) const
+{
+	if(!cb->isInTheMap(tile))
+		return nullptr;
+
+	const TerrainTile *t = cb->getTile(tile, false);
+	if(!t || t->terType == ETerrainType::ROCK || (t->blocked && !t->visitable))
+		return nullptr;
+	return t;
+}
+
+int CSectorGraph::getStepCost(const int3 &from, const int3 &to) const
+{
+	const TerrainTile *s = cb->getTile(from, false), *d = cb->getTile(to, false);
+
+	//same as hero without native army and without pathfinding skill would pay
+	int ret = VLC->heroh->terrCosts[s->terType];
+	if(d->roadType != ERoadType::NO_ROAD && s->roadType != ERoadType::NO_ROAD)
+	{
+		switch(std::min(d->roadType, s->roadType))
+		{
+		case ERoadType::DIRT_ROAD:
+			ret = 75;
+			break;
+		case ERoadType::GRAVEL_ROAD:
+			ret = 65;
+			break;
+		case ERoadType::COBBLESTONE_ROAD:
+			ret = 50;
+			break;
+		}
+	}
+
+	if(from.x != to.x && from.y != to.y) //diagonal move
+		ret = ret * 1414 / 1000;
+	return ret;
+}
+
+void CSectorGraph::rebuildDirtyClusters()
+{
+	std::vector<int> dirty;
+	for(int i = 0; i < clusters.size(); i++)
+		if(clusters[i].dirty)
+			dirty.push_back(i);
+	if(dirty.empty())
+		return;
+
+	for(int cluster : dirty)
+		findSectors(cluster);
+
+	//exits leading to or from changed sectors have to be found again
+	std::set<int> affected(dirty.begin(), dirty.end());
+	std::vector<int> neighbours;
+	for(int cluster : dirty)
+	{
+		getNeighbourClusters(cluster, neighbours);
+		affected.insert(neighbours.begin(), neighbours.end());
+	}
+	for(int i = 0; i < clusters.size(); i++)
+	{
+		for(auto &exit : clusters[i].exits)
+			if(clusters[getCluster(getTile(exit.second.tile))].dirty)
+				affected.insert(i); //gate leading to changed cluster
+	}
+
+	for(int cluster : affected)
+		findExits(cluster);
+
+	std::map<int, std::set<int> > entrances; //[cluster]
+	for(int i = 0; i < clusters.size(); i++)
+	{
+		for(auto &exit : clusters[i].exits)
+		{
+			const int target = getCluster(getTile(exit.second.tile));
+			if(vstd::contains(affected, target))
+				entrances[target].insert(exit.second.tile);
+		}
+	}
+
+	for(int cluster : affected)
+		findPortalLinks(cluster, entrances[cluster]);
+
+	for(int cluster : dirty)
+		clusters[cluster].dirty = false;
+}
+
+void CSectorGraph::findSectors(int cluster)
+{
+	std::vector<int3> tiles;
+	getClusterTiles(cluster, tiles);
+	for(const int3 &tile : tiles)
+		sector[getIndex(tile)] = -1;
+
+	//flood fill inside the cluster, sector is only-water or only-land
+	int nextSector = cluster * CLUSTER_SIZE * CLUSTER_SIZE;
+	std::vector<int3> toVisit;
+	for(const int3 &tile : tiles)
+	{
+		const TerrainTile *t = getPassableTile(tile);
+		if(!t || sector[getIndex(tile)] >= 0)
+			continue;
+
+		const bool water = t->isWater();
+		sector[getIndex(tile)] = nextSector;
+		toVisit.push_back(tile);
+		while(!toVisit.empty())
+		{
+			const int3 pos = toVisit.back();
+			toVisit.pop_back();
+			for(int dx = -1; dx <= 1; dx++)
+			{
+				for(int dy = -1; dy <= 1; dy++)
+				{
+					const int3 neighbour = pos + int3(dx, dy, 0);
+					const TerrainTile *nt = getPassableTile(neighbour);
+					if(nt && nt->isWater() == water && getCluster(neighbour) == cluster && sector[getIndex(neighbour)] < 0)
+					{
+						sector[getIndex(neighbour)] = nextSector;
+						toVisit.push_back(neighbour);
+					}
+				}
+			}
+		}
+		nextSector++;
+	}
+}
+
+void CSectorGraph::findExits(int cluster)
+{
+	Cluster &c = clusters[cluster];
+	c.exits.clear();
+
+	//pairs of tiles for each neighbouring sector in order along the border
+	std::map<int, std::vector<std::pair<int3, int3> > > borders;
+	std::vector<int3> tiles;
+	getClusterTiles(cluster, tiles);
+	for(const int3 &tile : tiles)
+	{
+		const int tileSector = sector[getIndex(tile)];
+		if(tileSector < 0)
+			continue;
+
+		for(int dx = -1; dx <= 1; dx++)
+		{
+			for(int dy = -1; dy <= 1; dy++)
+			{
+				const int3 neighbour = tile + int3(dx, dy, 0);
+				if(!cb->isInTheMap(neighbour))
+					continue;
+
+				const int neighbourSector = sector[getIndex(neighbour)];
+				if(neighbourSector < 0 || neighbourSector == tileSector)
+					continue;
+
+				//(dis)embarking, tile must be free or with unoccupied boat
+				const TerrainTile *nt = cb->getTile(neighbour, false);
+				if(nt->isWater() != cb->getTile(tile, false)->isWater()
+					&& nt->blocked && !(nt->visitableObjects.size() == 1 && nt->topVisitableId() == Obj::BOAT))
+					continue;
+
+				borders[neighbourSector].push_back(std::make_pair(tile, neighbour));
+			}
+		}
+
+		const TerrainTile *t = cb->getTile(tile, false);
+		if(t->topVisitableId() == Obj::SUBTERRANEAN_GATE)
+		{
+			const CGObjectInstance *exitGate = cb->getObj(CGTeleport::getMatchingGate(t->visitableObjects.back()->id), false);
+			if(exitGate && getPassableTile(exitGate->visitablePos()))
+			{
+				Link link = {getIndex(exitGate->visitablePos()), 0};
+				c.exits.push_back(std::make_pair(getIndex(tile), link));
+			}
+		}
+	}
+
+	//first and last pair and straight crossings every PORTAL_SPACING tiles, so path never detours far to reach a portal
+	//coordinate along the border is used, neighbouring cluster picks the same pairs in opposite direction
+	for(auto &border : borders)
+	{
+		const std::vector<std::pair<int3, int3> > &pairs = border.second;
+		for(size_t i = 0; i < pairs.size(); i++)
+		{
+			const int3 &tile = pairs[i].first, &neighbour = pairs[i].second;
+			const bool straight = tile.x == neighbour.x || tile.y == neighbour.y;
+			const int alongBorder = tile.x == neighbour.x ? tile.x : tile.y;
+			if(i == 0 || i + 1 == pairs.size() || (straight && alongBorder % PORTAL_SPACING == 0))
+			{
+				Link link = {getIndex(neighbour), getStepCost(tile, neighbour)};
+				c.exits.push_back(std::make_pair(getIndex(tile), link));
+			}
+		}
+	}
+}
+
+void CSectorGraph::findPortalLinks(int cluster, const std::set<int> &entrances)
+{
+	Cluster &c = clusters[cluster];
+	for(const Portal &p : c.portals)
+		portal[p.tile] = -1;
+	c.portals.clear();
+
+	std::set<int> tiles = entrances;
+	for(auto &exit : c.exits)
+		tiles.insert(exit.first);
+	for(int tile : tiles)
+	{
+		portal[tile] = c.portals.size();
+		Portal p = {tile, std::vector<Link>()};
+		c.portals.push_back(p);
+	}
+
+	std::vector<int> costs;
+	for(Portal &p : c.portals)
+	{
+		searchSector(getTile(p.tile), false, costs);
+		for(const Portal &other : c.portals)
+		{
+			const int cost = costs[getLocalIndex(getTile(other.tile))];
+			if(other.tile != p.tile && cost != INT_MAX)
+			{
+				Link link = {other.tile, cost};
+				p.links.push_back(link);
+			}
+		}
+	}
+
+	for(auto &exit : c.exits)
+		c.portals[portal[exit.first]].links.push_back(exit.second);
+}
+
+void CSectorGraph::searchSector(const int3 &start, bool backwards, std::vector<int> &costs) const
+{
+	costs.assign(CLUSTER_SIZE * CLUSTER_SIZE, INT_MAX);
+	const int startSector = sector[getIndex(start)];
+	if(startSector < 0)
+		return;
+
+	//sector doesn't leave the cluster, tiles are identified by their local index
+	const int3 corner(start.x - start.x % CLUSTER_SIZE, start.y - start.y % CLUSTER_SIZE, start.z);
+	typedef std::pair<int, int> TCostAndTile;
+	std::priority_queue<TCostAndTile, std::vector<TCostAndTile>, std::greater<TCostAndTile> > queue;
+	costs[getLocalIndex(start)] = 0;
+	queue.push(std::make_pair(0, getLocalIndex(start)));
+	while(!queue.empty())
+	{
+		const TCostAndTile top = queue.top();
+		queue.pop();
+		if(top.first > costs[top.second])
+			continue;
+
+		const int3 pos = corner + int3(top.second % CLUSTER_SIZE, top.second / CLUSTER_SIZE, 0);
+		for(int dx = -1; dx <= 1; dx++)
+		{
+			for(int dy = -1; dy <= 1; dy++)
+			{
+				const int3 neighbour = pos + int3(dx, dy, 0);
+				if(neighbour == pos || !cb->isInTheMap(neighbour) || sector[getIndex(neighbour)] != startSector)
+					continue;
+
+				const int cost = top.first + (backwards ? getStepCost(neighbour, pos) : getStepCost(pos, neighbour));
+				int &neighbourCost = costs[getLocalIndex(neighbour)];
+				if(cost < neighbourCost)
+				{
+					neighbourCost = cost;
+					queue.push(std::make_pair(cost, getLocalIndex(neighbour)));
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,85 @@
+/*
+ * CSectorGraph.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#pragma once
+
+#include "int3.h"
+
+class CGameInfoCallback;
+class CGHeroInstance;
+struct TerrainTile;
+
+/// Abstraction of adventure map used to answer long range path queries quickly (HPA*-like).
+/// Map is divided into square clusters, connected passable parts of a cluster form sectors. Sectors are linked
+/// by portals: neighbouring tiles of different sectors (including (dis)embarkment points) and subterranean gates.
+/// Movement costs between portals of each sector are cached, so query searches only the small portal graph.
+/// Visitable objects (monsters, towns...) are treated as passable, costs use base terrain costs without hero skills,
+/// so results are estimations: exact paths of a hero (CPathfinder) may be longer (guards, skills) or differ in a turn.
+/// Queries reuse internal buffers, graph must not be used from several threads at once.
+class DLL_LINKAGE CSectorGraph
+{
+public:
+	static const int CLUSTER_SIZE = 16;
+	static const int PORTAL_SPACING = 4; //max distance between portals along border of two sectors
+
+	CSectorGraph(const CGameInfoCallback *Cb); //only tiles visible for callback are known
+
+	void update(); //rebuilds whole graph
+	void tilesChanged(const std::vector<int3> &tiles); //marks clusters of given tiles (eg. of removed object or revealed by fog) to be rebuilt on next query
+
+	int getSector(const int3 &tile); //-1 if tile is not passable or not visible
+	int getDistance(const int3 &src, const int3 &dst); //estimated movement points needed to get from src to dst, -1 if dst is unreachable
+	int getTurns(const CGHeroInstance *hero, const int3 &dst); //estimated number of days before hero reaches dst (0 - today), -1 if dst is unreachable
+
+private:
+	struct Link
+	{
+		int tile; //index of target tile
+		int cost;
+	};
+
+	struct Portal
+	{
+		int tile; //index of tile
+		std::vector<Link> links; //exits and cached links to other portals of the same sector
+	};
+
+	struct Cluster
+	{
+		bool dirty;
+		std::vector<std::pair<int, Link> > exits; //links from portal of this cluster to other sectors (embarkment, neighbouring clusters, gates)
+		std::vector<Portal> portals;
+
+		Cluster() : dirty(true) {}
+	};
+
+	const CGameInfoCallback *cb;
+	int3 sizes;
+	int3 clustersCount;
+	std::vector<si32> sector; //[tile index] sector id, -1 for impassable tiles
+	std::vector<si32> portal; //[tile index] index of portal in cluster of tile, -1 if tile is not a portal
+	std::vector<Cluster> clusters;
+	std::vector<int> portalCosts; //[tile index] costs of portals reached by current query, INT_MAX between queries
+
+	int getIndex(const int3 &tile) const;
+	int3 getTile(int index) const;
+	int getLocalIndex(const int3 &tile) const; //index of tile in its cluster
+	int getCluster(const int3 &tile) const;
+	void getClusterTiles(int cluster, std::vector<int3> &tiles) const;
+	void getNeighbourClusters(int cluster, std::vector<int> &out) const; //clusters around given one on the same level
+	const TerrainTile *getPassableTile(const int3 &tile) const; //nullptr for impassable and invisible tiles
+	int getStepCost(const int3 &from, const int3 &to) const;
+
+	void rebuildDirtyClusters();
+	void findSectors(int cluster);
+	void findExits(int cluster);
+	void findPortalLinks(int cluster, const std::set<int> &entrances); //entrances - tiles of cluster targeted by exits of other clusters
+	void searchSector(const int3 &start, bool backwards, std::vector<int> &costs) const; //[local index] costs of moving between start and tiles of its sector, INT_MAX for other tiles
+};
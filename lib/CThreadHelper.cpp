@@ -45,6 +45,118 @@ void CThreadHelper::processTasks()
 	}
 }
 
+CThreadPool::CThreadPool()
+	: maxThreads(std::max(1u, boost::thread::hardware_concurrency())), stopping(false),
+	batch(nullptr), batchNumber(0), helpers(0), busyHelpers(0), nextTask(0)
+{
+}
+
+CThreadPool::~CThreadPool()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(mx);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for(auto &worker : workers)
+		worker.join();
+}
+
+CThreadPool & CThreadPool::get()
+{
+	static CThreadPool pool;
+	return pool;
+}
+
+void CThreadPool::setMaxThreads(int Threads)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	maxThreads = std::max(1, Threads);
+}
+
+int CThreadPool::getMaxThreads() const
+{
+	return maxThreads;
+}
+
+void CThreadPool::run(std::vector<Task> &tasks)
+{
+	boost::unique_lock<boost::mutex> runLock(runMx, boost::try_to_lock);
+	const int threads = std::min<int>(tasks.size(), maxThreads);
+	if(threads <= 1 || !runLock.owns_lock()) //waiting for other batch could deadlock if we are its task
+	{
+		for(auto &task : tasks)
+			task();
+		return;
+	}
+
+	{
+		boost::unique_lock<boost::mutex> lock(mx);
+		while((int)workers.size() < threads - 1)
+			workers.push_back(boost::thread(&CThreadPool::workerLoop, this, (int)workers.size()));
+
+		batch = &tasks;
+		nextTask = 0;
+		error = nullptr;
+		helpers = busyHelpers = threads - 1;
+		batchNumber++;
+	}
+	wakeUp.notify_all();
+
+	processTasks();
+
+	std::exception_ptr batchError;
+	{
+		boost::unique_lock<boost::mutex> lock(mx);
+		while(busyHelpers)
+			batchDone.wait(lock);
+		batch = nullptr;
+		std::swap(batchError, error);
+	}
+
+	if(batchError)
+		std::rethrow_exception(batchError);
+}
+
+void CThreadPool::workerLoop(int index)
+{
+	setThreadName("CThreadPool::workerLoop");
+	ui32 doneBatch = 0;
+	boost::unique_lock<boost::mutex> lock(mx);
+	while(true)
+	{
+		while(!stopping && (batchNumber == doneBatch || index >= helpers))
+			wakeUp.wait(lock);
+		if(stopping)
+			return;
+
+		doneBatch = batchNumber;
+		lock.unlock();
+		processTasks();
+		lock.lock();
+		if(!--busyHelpers)
+			batchDone.notify_all();
+	}
+}
+
+void CThreadPool::processTasks()
+{
+	size_t i;
+	while((i = nextTask++) < batch->size())
+	{
+		try
+		{
+			(*batch)[i]();
+		}
+		catch(...)
+		{
+			boost::unique_lock<boost::mutex> lock(mx);
+			if(!error)
+				error = std::current_exception();
+		}
+	}
+}
+
 // set name for this thread.
 // NOTE: on *nix string will be trimmed to 16 symbols
 void setThreadName(const std::string &name)
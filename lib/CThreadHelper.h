@@ -29,6 +29,35 @@ public:
 	void run();
 };
 
+/// Worker threads kept alive between batches of CPU work, so frequent small batches (pathfinding for all heroes,
+/// battle AI evaluations) don't pay for creating threads and keep their per-thread workspaces warm
+class DLL_LINKAGE CThreadPool
+{
+	boost::mutex mx;
+	boost::condition_variable wakeUp, batchDone;
+	boost::mutex runMx; //one batch at a time
+	std::vector<boost::thread> workers;
+	int maxThreads;
+	bool stopping;
+
+	std::vector<Task> *batch;
+	ui32 batchNumber; //workers take part in every batch once
+	int helpers, busyHelpers; //workers taking part in current batch / still working on it
+	std::atomic<size_t> nextTask;
+	std::exception_ptr error; //first exception thrown by a task
+
+	CThreadPool();
+	void workerLoop(int index);
+	void processTasks();
+public:
+	~CThreadPool();
+	static CThreadPool & get();
+
+	void setMaxThreads(int Threads); //including calling thread, 1 - tasks are run by calling thread only
+	int getMaxThreads() const;
+	void run(std::vector<Task> &tasks); //returns when all tasks are done, rethrows first exception thrown by a task; nested or concurrent batches are run by their caller
+};
+
 template <typename T> inline void setData(T * data, std::function<T()> func)
 {
 	*data = func();
@@ -2,8 +2,11 @@
 #include "Connection.h"
 
 #include "RegisterTypes.h"
+#include "CThreadHelper.h"
+#include "CConfigHandler.h"
 
 #include <boost/asio.hpp>
+#include <zlib.h>
 
 /*
  * Connection.cpp, part of VCMI engine
@@ -24,6 +27,7 @@ extern template void registerTypes<CSaveFile>(CSaveFile & s);
 extern template void registerTypes<CLoadFile>(CLoadFile & s);
 extern template void registerTypes<CTypeList>(CTypeList & s);
 extern template void registerTypes<CLoadIntegrityValidator>(CLoadIntegrityValidator & s);
+extern template void registerTypes<CMemorySaver>(CMemorySaver & s);
 
 CTypeList typeList;
 
@@ -42,6 +46,18 @@ CTypeList typeList;
 
 void CConnection::init()
 {
+	batchDepth = 0;
+	messageStarted = false;
+	writeBuffer.reserve(BUFFER_SIZE);
+	readBuffer.resize(CCompressedBlock::HEADER_SIZE + BUFFER_SIZE);
+	readPos = readEnd = 0;
+	asyncWrites = asyncReads = stoppingReads = false;
+	strand = std::make_shared<asio::io_service::strand>(socket->get_io_service());
+	queuedBytes = maxQueuedBytes = 0;
+	compression = false;
+	compressionLevel = FAST_COMPRESSION;
+	framePos = 0;
+
 	enableSmartPointerSerializatoin();
 	disableStackSendingByID();
 	registerTypes(static_cast<CISer<CConnection>&>(*this));
@@ -53,9 +69,12 @@ void CConnection::init()
 #endif
 	connected = true;
 	std::string pom;
+	bool wantCompression = settings["server"]["compression"].Bool(), contactWantsCompression;
 	//we got connection
-	(*this) << std::string("Aiya!\n") << name << myEndianess; //identify ourselves
-	(*this) >> pom >> pom >> contactEndianess;
+	(*this) << std::string("Aiya!\n") << name << myEndianess << wantCompression; //identify ourselves
+	flush();
+	(*this) >> pom >> pom >> contactEndianess >> contactWantsCompression;
+	compression = wantCompression && contactWantsCompression;
     logNetwork->infoStream() << "Established connection with "<<pom;
 	wmx = new boost::mutex;
 	rmx = new boost::mutex;
@@ -143,36 +162,175 @@ CConnection::CConnection(TAcceptor * acceptor, boost::asio::io_service *Io_servi
 int CConnection::write(const void * data, unsigned size)
 {
 	//LOG("Sending " << size << " byte(s) of data" <<std::endl);
+	auto bytes = static_cast<const ui8 *>(data);
+	for(unsigned done = 0; done < size;)
+	{
+		unsigned chunk = std::min<unsigned>(size - done, BUFFER_SIZE - writeBuffer.size());
+		writeBuffer.insert(writeBuffer.end(), bytes + done, bytes + done + chunk);
+		done += chunk;
+		if(writeBuffer.size() == BUFFER_SIZE) //frame is full, rest of the message will follow in next frames
+		{
+			messageStarted = true;
+			sendFrame();
+		}
+	}
+	return size;
+}
+void CConnection::flush()
+{
+	if(!batchDepth)
+		sendBuffer();
+}
+
+void CConnection::sendBuffer()
+{
+	if(writeBuffer.empty() && !messageStarted)
+		return;
+
+	messageStarted = false;
+	sendFrame(); //shorter than BUFFER_SIZE, so it ends the message
+}
+
+void CConnection::sendFrame()
+{
+	auto header = std::make_shared<std::vector<ui8> >();
+	if(compression)
+	{
+		std::vector<ui8> frame;
+		CCompressedBlock::pack(writeBuffer, frame, compressionLevel);
+		writeBuffer.swap(frame);
+	}
+	else
+	{
+		//header is sent separately, so data doesn't have to be copied
+		header->resize(CCompressedBlock::HEADER_SIZE);
+		CCompressedBlock::makeHeader(header->data(), writeBuffer.size(), 0);
+	}
+
+	if(asyncWrites)
+	{
+		auto data = std::make_shared<const std::vector<ui8> >(std::move(writeBuffer));
+		writeBuffer.clear();
+		if(!header->empty())
+			queueWrite(header);
+		queueWrite(data);
+		return;
+	}
+
 	try
 	{
-		int ret;
-		ret = asio::write(*socket,asio::const_buffers_1(asio::const_buffer(data,size)));
-		return ret;
+		std::array<asio::const_buffer, 2> buffers = {{asio::buffer(*header), asio::buffer(writeBuffer)}};
+		asio::write(*socket, buffers);
+		writeBuffer.clear();
 	}
 	catch(...)
 	{
 		//connection has been lost
+		writeBuffer.clear();
 		connected = false;
 		throw;
 	}
 }
+
+void CConnection::readFrame()
+{
+	ui8 header[CCompressedBlock::HEADER_SIZE];
+	readRaw(header, CCompressedBlock::HEADER_SIZE);
+	ui32 dataSize, rawSize;
+	CCompressedBlock::parseHeader(header, dataSize, rawSize);
+	if(dataSize > BUFFER_SIZE || rawSize > BUFFER_SIZE) //sender splits data into frames of at most BUFFER_SIZE bytes
+		throw std::runtime_error("Received frame is too big, data is corrupted");
+
+	std::vector<ui8> data(dataSize);
+	readRaw(data.data(), dataSize);
+	CCompressedBlock::unpack(data, rawSize, frameData);
+	framePos = 0;
+}
+
+void CConnection::readRaw(ui8 * out, size_t size)
+{
+	size_t buffered = std::min(size, readEnd - readPos);
+	std::copy(readBuffer.begin() + readPos, readBuffer.begin() + readPos + buffered, out);
+	readPos += buffered;
+
+	size_t missing = size - buffered;
+	if(missing >= BUFFER_SIZE) //big chunk - read directly
+	{
+		readSocket(out + buffered, missing, missing);
+	}
+	else if(missing)
+	{
+		//read at least the missing part, take whatever else is already available
+		readEnd = readSocket(readBuffer.data(), readBuffer.size(), missing);
+		std::copy(readBuffer.begin(), readBuffer.begin() + missing, out + buffered);
+		readPos = missing;
+	}
+}
+
+size_t CConnection::readSocket(ui8 * out, size_t size, size_t atLeast)
+{
+	return asio::read(*socket, asio::mutable_buffers_1(asio::mutable_buffer(out, size)), asio::transfer_at_least(atLeast));
+}
+
+bool CConnection::takeBufferedFrame(bool &endsMessage)
+{
+	size_t available = readEnd - readPos;
+	if(available < CCompressedBlock::HEADER_SIZE)
+		return false;
+
+	ui32 dataSize, rawSize;
+	CCompressedBlock::parseHeader(&readBuffer[readPos], dataSize, rawSize);
+	if(dataSize > BUFFER_SIZE || rawSize > BUFFER_SIZE)
+		throw std::runtime_error("Received frame is too big, data is corrupted");
+	if(available < CCompressedBlock::HEADER_SIZE + dataSize)
+		return false;
+
+	if(framePos == frameData.size())
+	{
+		frameData.clear();
+		framePos = 0;
+	}
+	size_t start = frameData.size(), size = rawSize ? rawSize : dataSize;
+	frameData.resize(start + size);
+	CCompressedBlock::unpack(&readBuffer[readPos + CCompressedBlock::HEADER_SIZE], dataSize, rawSize, frameData.data() + start);
+	readPos += CCompressedBlock::HEADER_SIZE + dataSize;
+	endsMessage = size < BUFFER_SIZE;
+	return true;
+}
+
 int CConnection::read(void * data, unsigned size)
 {
 	//LOG("Receiving " << size << " byte(s) of data" <<std::endl);
 	try
 	{
-		int ret = asio::read(*socket,asio::mutable_buffers_1(asio::mutable_buffer(data,size)));
-		return ret;
+		auto out = static_cast<ui8 *>(data);
+		for(size_t done = 0; done < size;)
+		{
+			if(framePos == frameData.size())
+			{
+				if(asyncReads) //called by message handler, message contains whole packs
+					throw std::runtime_error("Received message is incomplete");
+				readFrame();
+			}
+
+			size_t chunk = std::min<size_t>(size - done, frameData.size() - framePos);
+			std::copy(frameData.begin() + framePos, frameData.begin() + framePos + chunk, out + done);
+			framePos += chunk;
+			done += chunk;
+		}
+		return size;
 	}
 	catch(...)
 	{
 		//connection has been lost
+		readPos = readEnd = 0;
 		connected = false;
 		throw;
 	}
 }
 CConnection::~CConnection(void)
 {
+	assert(!asyncReads);
 	if(handler)
 		handler->join();
 
@@ -233,6 +391,308 @@ void CConnection::sendPackToServer(const CPack &pack, PlayerColor player, ui32 r
 	boost::unique_lock<boost::mutex> lock(*wmx);
     logNetwork->traceStream() << "Sending to server a pack of type " << typeid(pack).name();
 	*this << player << requestID << &pack; //packs has to be sent as polymorphic pointers!
+	flush();
+}
+
+void CConnection::sendRawData(std::shared_ptr<const std::vector<ui8> > data)
+{
+	if(asyncWrites && writeBuffer.empty() && !messageStarted && !batchDepth && !compression && data->size() < BUFFER_SIZE)
+	{
+		//no need to copy data, it's whole message (compressed data has to be packed into frames)
+		auto header = std::make_shared<std::vector<ui8> >(CCompressedBlock::HEADER_SIZE);
+		CCompressedBlock::makeHeader(header->data(), data->size(), 0);
+		queueWrite(header);
+		queueWrite(data);
+		return;
+	}
+
+	write(data->data(), data->size());
+	flush();
+}
+
+void CConnection::startBatch()
+{
+	boost::unique_lock<boost::mutex> lock(*wmx);
+	batchDepth++;
+}
+
+void CConnection::endBatch()
+{
+	boost::unique_lock<boost::mutex> lock(*wmx);
+	if(!--batchDepth)
+		sendBuffer();
+}
+
+void CConnection::setCompressionLevel(int level)
+{
+	boost::unique_lock<boost::mutex> lock(*wmx);
+	compressionLevel = level;
+}
+
+void CConnection::enableAsyncWrites(size_t MaxQueuedBytes)
+{
+	boost::unique_lock<boost::mutex> lock(*wmx);
+	sendBuffer();
+	asyncWrites = true;
+	maxQueuedBytes = MaxQueuedBytes;
+}
+
+void CConnection::disableAsyncWrites()
+{
+	boost::unique_lock<boost::mutex> lock(*wmx);
+	sendBuffer();
+	boost::unique_lock<boost::mutex> queueLock(writeQueueMx);
+	while(!writeQueue.empty())
+		writeQueueCond.wait(queueLock);
+	asyncWrites = false;
+}
+
+void CConnection::queueWrite(std::shared_ptr<const std::vector<ui8> > data)
+{
+	boost::unique_lock<boost::mutex> lock(writeQueueMx);
+	while(connected && queuedBytes > maxQueuedBytes)
+		writeQueueCond.wait(lock);
+
+	if(!connected)
+		throw std::runtime_error("Cannot send data, connection has been lost");
+
+	writeQueue.push_back(data);
+	queuedBytes += data->size();
+	if(writeQueue.size() == 1)
+	{
+		std::static_pointer_cast<asio::io_service::strand>(strand)->post([this]
+		{
+			boost::unique_lock<boost::mutex> lock(writeQueueMx);
+			if(!writeQueue.empty()) //connection may have been lost meanwhile
+				startAsyncWrite();
+		});
+	}
+}
+
+void CConnection::startAsyncWrite()
+{
+	const std::vector<ui8> &data = *writeQueue.front();
+	asio::async_write(*socket, asio::const_buffers_1(asio::const_buffer(data.data(), data.size())),
+		std::static_pointer_cast<asio::io_service::strand>(strand)->wrap(boost::bind(&CConnection::asyncWriteFinished, this, asio::placeholders::error)));
+}
+
+void CConnection::asyncWriteFinished(const boost::system::error_code &error)
+{
+	boost::unique_lock<boost::mutex> lock(writeQueueMx);
+	if(error)
+	{
+		//connection has been lost
+		logNetwork->errorStream() << "Failed to send data through " << *this << ": " << error.message();
+		connected = false;
+		writeQueue.clear();
+		queuedBytes = 0;
+	}
+	else
+	{
+		queuedBytes -= writeQueue.front()->size();
+		writeQueue.pop_front();
+		if(!writeQueue.empty())
+			startAsyncWrite();
+	}
+	writeQueueCond.notify_all();
+}
+
+void CConnection::startAsyncReads(std::function<bool()> OnMessage, std::function<void(const std::string &)> OnError)
+{
+	{
+		boost::unique_lock<boost::mutex> lock(readStateMx);
+		assert(!asyncReads);
+		asyncReads = true;
+		stoppingReads = false;
+	}
+	messageHandler = OnMessage;
+	readErrorHandler = OnError;
+	std::static_pointer_cast<asio::io_service::strand>(strand)->post(boost::bind(&CConnection::continueAsyncReads, this));
+}
+
+void CConnection::stopAsyncReads()
+{
+	boost::unique_lock<boost::mutex> lock(readStateMx);
+	if(!asyncReads)
+		return;
+
+	stoppingReads = true;
+	bool cancelled = false; //waiting for it as well, so posted handler doesn't outlive this call
+	std::static_pointer_cast<asio::io_service::strand>(strand)->post([&]
+	{
+		boost::system::error_code error;
+		socket->cancel(error); //pending read finishes with error
+		boost::unique_lock<boost::mutex> lock(readStateMx);
+		cancelled = true;
+		readStateCond.notify_all();
+	});
+	while(asyncReads || !cancelled)
+		readStateCond.wait(lock);
+}
+
+bool CConnection::hasUnreadMessageData() const
+{
+	return framePos < frameData.size();
+}
+
+void CConnection::continueAsyncReads()
+{
+	try
+	{
+		bool endsMessage;
+		while(takeBufferedFrame(endsMessage))
+		{
+			if(!endsMessage)
+				continue;
+
+			bool keepReading;
+			{
+				boost::unique_lock<boost::mutex> lock(*rmx);
+				keepReading = messageHandler();
+			}
+			if(!keepReading)
+			{
+				finishAsyncReads("");
+				return;
+			}
+		}
+
+		{
+			boost::unique_lock<boost::mutex> lock(readStateMx);
+			if(stoppingReads)
+			{
+				lock.unlock();
+				finishAsyncReads("");
+				return;
+			}
+		}
+
+		//move beginning of the incomplete frame to the front, so whole frame fits into buffer
+		std::copy(readBuffer.begin() + readPos, readBuffer.begin() + readEnd, readBuffer.begin());
+		readEnd -= readPos;
+		readPos = 0;
+
+		size_t missing = CCompressedBlock::HEADER_SIZE - std::min(readEnd, CCompressedBlock::HEADER_SIZE);
+		if(!missing)
+		{
+			ui32 dataSize, rawSize;
+			CCompressedBlock::parseHeader(readBuffer.data(), dataSize, rawSize);
+			missing = CCompressedBlock::HEADER_SIZE + dataSize - readEnd; //frame size was checked by takeBufferedFrame
+		}
+		asio::async_read(*socket, asio::mutable_buffers_1(asio::mutable_buffer(readBuffer.data() + readEnd, readBuffer.size() - readEnd)),
+			asio::transfer_at_least(missing),
+			std::static_pointer_cast<asio::io_service::strand>(strand)->wrap(
+				boost::bind(&CConnection::asyncReadFinished, this, asio::placeholders::error, asio::placeholders::bytes_transferred)));
+	}
+	catch(std::exception &e)
+	{
+		finishAsyncReads(e.what());
+	}
+}
+
+void CConnection::asyncReadFinished(const boost::system::error_code &error, size_t transferred)
+{
+	if(error)
+	{
+		boost::unique_lock<boost::mutex> lock(readStateMx);
+		bool stopped = stoppingReads;
+		lock.unlock();
+		finishAsyncReads(stopped ? "" : error.message());
+		return;
+	}
+
+	readEnd += transferred;
+	continueAsyncReads();
+}
+
+void CConnection::finishAsyncReads(const std::string &error)
+{
+	if(!error.empty())
+	{
+		//connection has been lost
+		logNetwork->errorStream() << "Failed to read data from " << *this << ": " << error;
+		readPos = readEnd = 0;
+		connected = false;
+		readErrorHandler(error);
+	}
+	messageHandler = nullptr;
+	readErrorHandler = nullptr;
+
+	boost::unique_lock<boost::mutex> lock(readStateMx);
+	asyncReads = false;
+	readStateCond.notify_all();
+}
+
+CAsyncConnectionsWriter::CAsyncConnectionsWriter(const std::set<CConnection *> &Conns, size_t MaxQueuedBytes)
+	: maxQueuedBytes(MaxQueuedBytes)
+{
+	for(auto c : Conns)
+		addConnection(c);
+}
+
+void CAsyncConnectionsWriter::addConnection(CConnection *c)
+{
+	conns.push_back(c);
+	c->enableAsyncWrites(maxQueuedBytes);
+	if(!vstd::contains(services, c->io_service))
+	{
+		services.push_back(c->io_service);
+		runService(c->io_service);
+	}
+}
+
+void CAsyncConnectionsWriter::runService(asio::io_service *service)
+{
+	service->reset();
+	works.push_back(std::make_shared<asio::io_service::work>(*service));
+	threads.create_thread([service]
+	{
+		setThreadName("CAsyncConnectionsWriter::run");
+		service->run();
+	});
+}
+
+CAsyncConnectionsWriter::~CAsyncConnectionsWriter()
+{
+	for(auto c : conns)
+	{
+		try
+		{
+			c->disableAsyncWrites();
+		}
+		catch(...)
+		{
+			logNetwork->errorStream() << "Failed to send queued data through " << *c;
+		}
+		c->stopAsyncReads(); //after queue is sent, cancelling doesn't drop any data; handlers have to finish while io_service runs
+	}
+
+	works.clear();
+	for(auto service : services)
+		service->stop();
+	threads.join_all();
+}
+
+CConnectionsBatch::CConnectionsBatch(const std::set<CConnection *> &Conns)
+	: conns(Conns.begin(), Conns.end())
+{
+	for(auto c : conns)
+		c->startBatch();
+}
+
+CConnectionsBatch::~CConnectionsBatch()
+{
+	for(auto c : conns)
+	{
+		try
+		{
+			c->endBatch();
+		}
+		catch(...)
+		{
+			logNetwork->errorStream() << "Failed to send batched data through " << *c;
+		}
+	}
 }
 
 void CConnection::disableStackSendingByID()
@@ -261,7 +721,7 @@ void CConnection::enableSmartPointerSerializatoin()
 
 void CConnection::prepareForSendingHeroes()
 {
-	loadedPointers.clear();
+	clearLoadedPointers();
 	savedPointers.clear();
 	disableSmartVectorMemberSerialization();
 	enableSmartPointerSerializatoin();
@@ -269,7 +729,7 @@ void CConnection::prepareForSendingHeroes()
 
 void CConnection::enterPregameConnectionMode()
 {
-	loadedPointers.clear();
+	clearLoadedPointers();
 	savedPointers.clear();
 	disableSmartVectorMemberSerialization();
 	disableSmartPointerSerialization();
@@ -285,6 +745,79 @@ void CConnection::enableSmartVectorMemberSerializatoin()
 	smartVectorMembersSerialization = true;
 }
 
+CBackgroundChunkWriter::CBackgroundChunkWriter(std::ostream &Out)
+	: out(Out), finishing(false)
+{
+	thread = boost::thread(&CBackgroundChunkWriter::run, this);
+}
+
+CBackgroundChunkWriter::~CBackgroundChunkWriter()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(mx);
+		finishing = true;
+		cond.notify_all();
+	}
+	thread.join();
+}
+
+void CBackgroundChunkWriter::run()
+{
+	setThreadName("CBackgroundChunkWriter::run");
+	boost::unique_lock<boost::mutex> lock(mx);
+	while(true)
+	{
+		while(chunks.empty() && !finishing)
+			cond.wait(lock);
+		if(chunks.empty())
+			return;
+
+		std::vector<ui8> data = std::move(chunks.front());
+		bool failed = !error.empty();
+		lock.unlock();
+
+		if(!failed) //after error just drop the data
+		{
+			try
+			{
+				std::vector<ui8> block;
+				CCompressedBlock::pack(data, block, Z_BEST_SPEED);
+				out.write(reinterpret_cast<const char *>(block.data()), block.size());
+			}
+			catch(std::exception &e)
+			{
+				boost::unique_lock<boost::mutex> errorLock(mx);
+				error = e.what();
+			}
+		}
+
+		lock.lock();
+		chunks.pop_front(); //chunk leaves queue after it's written, so finish() knows when we are done
+		cond.notify_all();
+	}
+}
+
+void CBackgroundChunkWriter::addChunk(std::vector<ui8> &&data)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	while(chunks.size() >= MAX_QUEUED_CHUNKS && error.empty())
+		cond.wait(lock);
+	if(!error.empty())
+		throw std::runtime_error(error);
+
+	chunks.push_back(std::move(data));
+	cond.notify_all();
+}
+
+void CBackgroundChunkWriter::finish()
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	while(!chunks.empty())
+		cond.wait(lock);
+	if(!error.empty())
+		throw std::runtime_error(error);
+}
+
 CSaveFile::CSaveFile( const std::string &fname )
 {
 	registerTypes(*this);
@@ -293,16 +826,32 @@ CSaveFile::CSaveFile( const std::string &fname )
 
 CSaveFile::~CSaveFile()
 {
+	try
+	{
+		close();
+	}
+	catch(std::exception &e)
+	{
+		logGlobal->errorStream() << "Failed to save to " << fName << ": " << e.what();
+	}
 }
 
 int CSaveFile::write( const void * data, unsigned size )
 {
-	sfile->write((char *)data,size);
+	auto bytes = static_cast<const ui8 *>(data);
+	chunk.insert(chunk.end(), bytes, bytes + size);
+	if(chunk.size() >= CBackgroundChunkWriter::CHUNK_SIZE)
+	{
+		writer->addChunk(std::move(chunk));
+		chunk.clear();
+	}
 	return size;
 }
 
 void CSaveFile::openNextFile(const std::string &fname)
 {
+	close();
+	waitForBackgroundSaves(); //file may be being written
 	fName = fname;
 	try
 	{
@@ -313,7 +862,8 @@ void CSaveFile::openNextFile(const std::string &fname)
 			THROW_FORMAT("Error: cannot open to write %s!", fname);
 
 		sfile->write("VCMI",4); //write magic identifier
-		*this << version; //write format version
+		sfile->write(reinterpret_cast<const char *>(&version), sizeof(version)); //write format version, everything after is compressed
+		writer = make_unique<CBackgroundChunkWriter>(*sfile);
 	}
 	catch(...)
 	{
@@ -323,6 +873,62 @@ void CSaveFile::openNextFile(const std::string &fname)
 	}
 }
 
+void CSaveFile::close()
+{
+	if(!writer)
+		return;
+
+	auto lastWriter = std::move(writer); //file is closed even if writing fails
+	if(!chunk.empty())
+		lastWriter->addChunk(std::move(chunk));
+	chunk.clear();
+	lastWriter->finish();
+	sfile->flush();
+}
+
+static boost::mutex backgroundSavesMx;
+static std::vector<boost::thread> backgroundSaves; //finishing files closed by CSaveFile::closeInBackground
+
+void CSaveFile::closeInBackground()
+{
+	if(!writer)
+		return;
+
+	std::shared_ptr<CBackgroundChunkWriter> lastWriter = std::move(writer);
+	std::shared_ptr<std::ofstream> file = std::move(sfile);
+	if(!chunk.empty())
+		lastWriter->addChunk(std::move(chunk));
+	chunk.clear();
+
+	const std::string name = fName;
+	boost::unique_lock<boost::mutex> lock(backgroundSavesMx);
+	backgroundSaves.push_back(boost::thread([lastWriter, file, name]
+	{
+		setThreadName("CSaveFile::closeInBackground");
+		try
+		{
+			lastWriter->finish();
+			file->flush();
+			logGlobal->infoStream() << "Saved " << name;
+		}
+		catch(std::exception &e)
+		{
+			logGlobal->errorStream() << "Failed to save to " << name << ": " << e.what();
+		}
+	}));
+}
+
+void CSaveFile::waitForBackgroundSaves()
+{
+	std::vector<boost::thread> saves;
+	{
+		boost::unique_lock<boost::mutex> lock(backgroundSavesMx);
+		saves.swap(backgroundSaves);
+	}
+	for(auto & save : saves)
+		save.join();
+}
+
 void CSaveFile::reportState(CLogger * out)
 {
     out->debugStream() << "CSaveFile";
@@ -334,6 +940,8 @@ void CSaveFile::reportState(CLogger * out)
 
 void CSaveFile::clear()
 {
+	writer = nullptr;
+	chunk.clear();
 	fName.clear();
 	sfile = nullptr;
 }
@@ -344,6 +952,7 @@ void CSaveFile::putMagicBytes( const std::string &text )
 }
 
 CLoadFile::CLoadFile(const std::string &fname, int minimalVersion /*= version*/)
+	: compressed(false), chunkPos(0)
 {
 	registerTypes(*this);
 	openNextFile(fname, minimalVersion);
@@ -355,18 +964,51 @@ CLoadFile::~CLoadFile()
 
 int CLoadFile::read( const void * data, unsigned size )
 {
-	sfile->read((char *)data,size);
+	if(!compressed)
+	{
+		sfile->read((char *)data,size);
+		return size;
+	}
+
+	auto out = (ui8 *)data;
+	for(size_t done = 0; done < size;)
+	{
+		if(chunkPos == chunk.size())
+			readChunk();
+
+		size_t count = std::min<size_t>(size - done, chunk.size() - chunkPos);
+		std::copy(chunk.begin() + chunkPos, chunk.begin() + chunkPos + count, out + done);
+		chunkPos += count;
+		done += count;
+	}
 	return size;
 }
 
+void CLoadFile::readChunk()
+{
+	ui8 header[CCompressedBlock::HEADER_SIZE];
+	sfile->read((char *)header, CCompressedBlock::HEADER_SIZE);
+	ui32 dataSize, rawSize;
+	CCompressedBlock::parseHeader(header, dataSize, rawSize);
+
+	std::vector<ui8> data(dataSize);
+	sfile->read((char *)data.data(), dataSize);
+	CCompressedBlock::unpack(data, rawSize, chunk);
+	chunkPos = 0;
+}
+
 void CLoadFile::openNextFile(const std::string &fname, int minimalVersion)
 {
 	assert(!reverseEndianess);
 	assert(minimalVersion <= version);
+	CSaveFile::waitForBackgroundSaves(); //file may be being written
 
 	try
 	{
 		fName = fname;
+		compressed = false;
+		chunk.clear();
+		chunkPos = 0;
 		sfile = make_unique<std::ifstream>(fname, std::ios::binary);
 		sfile->exceptions(std::ifstream::failbit | std::ifstream::badbit); //we throw a lot anyway
 
@@ -399,6 +1041,7 @@ void CLoadFile::openNextFile(const std::string &fname, int minimalVersion)
 			else
 				THROW_FORMAT("Error: too new file format (%s)!", fname);
 		}
+		compressed = fileVersion >= compressedSaveVersion;
 	}
 	catch(...)
 	{
@@ -421,6 +1064,9 @@ void CLoadFile::clear()
 	sfile = nullptr;
 	fName.clear();
 	fileVersion = 0;
+	compressed = false;
+	chunk.clear();
+	chunkPos = 0;
 }
 
 void CLoadFile::checkMagicBytes( const std::string &text )
@@ -438,30 +1084,184 @@ CTypeList::CTypeList()
 
 ui16 CTypeList::registerType( const std::type_info *type )
 {
-	TTypeMap::const_iterator i = types.find(type);
-	if(i != types.end())
+	auto i = typesByAddress.find(type);
+	if(i != typesByAddress.end())
 		return i->second; //type found, return ID
 
+	auto j = types.find(std::type_index(*type));
+	if(j != types.end())
+	{
+		//type found under type_info of other module
+		typesByAddress[type] = j->second;
+		return j->second;
+	}
+
 	//type not found - add it to the list and return given ID
 	ui16 id = types.size() + 1;
-	types.insert(std::make_pair(type,id));
+	types[std::type_index(*type)] = id;
+	typesByAddress[type] = id;
+	typesByID.push_back(type);
 	return id;
 }
 
 ui16 CTypeList::getTypeID( const std::type_info *type )
 {
-	TTypeMap::const_iterator i = types.find(type);
-	if(i != types.end())
+	auto i = typesByAddress.find(type);
+	if(i != typesByAddress.end())
 		return i->second;
+
+	auto j = types.find(std::type_index(*type));
+	if(j != types.end())
+		return j->second;
 	else
 		return 0;
 }
 
+const std::type_info * CTypeList::getTypeInfo(ui16 id) const
+{
+	if(id == 0 || id > typesByID.size())
+		return nullptr;
+	return typesByID[id - 1];
+}
+
+void CCompressedBlock::pack(const std::vector<ui8> &data, std::vector<ui8> &out, int level)
+{
+	size_t start = out.size();
+	out.resize(start + HEADER_SIZE);
+	ui32 dataSize = data.size(), rawSize = 0;
+	if(level && data.size() >= MIN_COMPRESSED_SIZE)
+	{
+		uLongf compressedSize = compressBound(data.size());
+		out.resize(start + HEADER_SIZE + compressedSize);
+		if(compress2(&out[start + HEADER_SIZE], &compressedSize, data.data(), data.size(), level) == Z_OK
+			&& compressedSize < data.size())
+		{
+			rawSize = data.size();
+			dataSize = compressedSize;
+		}
+	}
+
+	out.resize(start + HEADER_SIZE);
+	if(rawSize)
+		out.resize(start + HEADER_SIZE + dataSize); //compressed data is already there
+	else
+		out.insert(out.end(), data.begin(), data.end());
+
+	makeHeader(&out[start], dataSize, rawSize);
+}
+
+void CCompressedBlock::makeHeader(ui8 *header, ui32 dataSize, ui32 rawSize)
+{
+	for(int i = 0; i < 4; i++)
+	{
+		header[i] = (dataSize >> (8 * i)) & 0xff;
+		header[4 + i] = (rawSize >> (8 * i)) & 0xff;
+	}
+}
+
+void CCompressedBlock::parseHeader(const ui8 *header, ui32 &dataSize, ui32 &rawSize)
+{
+	dataSize = rawSize = 0;
+	for(int i = 0; i < 4; i++)
+	{
+		dataSize |= ui32(header[i]) << (8 * i);
+		rawSize |= ui32(header[4 + i]) << (8 * i);
+	}
+}
+
+void CCompressedBlock::unpack(const ui8 *data, ui32 dataSize, ui32 rawSize, ui8 *out)
+{
+	if(!rawSize)
+	{
+		std::copy(data, data + dataSize, out);
+		return;
+	}
+
+	uLongf decompressedSize = rawSize;
+	if(uncompress(out, &decompressedSize, data, dataSize) != Z_OK || decompressedSize != rawSize)
+		throw std::runtime_error("Corrupted compressed data");
+}
+
+void CCompressedBlock::unpack(std::vector<ui8> &data, ui32 rawSize, std::vector<ui8> &out)
+{
+	if(!rawSize)
+	{
+		out.swap(data);
+		return;
+	}
+
+	out.resize(rawSize);
+	unpack(data.data(), data.size(), rawSize, out.data());
+}
+
  std::ostream & operator<<(std::ostream &str, const CConnection &cpc)
  {
  	return str << "Connection with " << cpc.name << " (ID: " << cpc.connectionID << /*", " << (cpc.host ? "host" : "guest") <<*/ ")";
  }
 
+CMemorySaver::CMemorySaver()
+{
+	registerTypes(*this);
+}
+
+int CMemorySaver::write(const void * data, unsigned size)
+{
+	auto bytes = static_cast<const ui8 *>(data);
+	buffer.insert(buffer.end(), bytes, bytes + size);
+	return size;
+}
+
+void CMemorySaver::putMagicBytes(const std::string &text)
+{
+	write(text.c_str(), text.length());
+}
+
+CMemoryLoader::CMemoryLoader(const std::vector<ui8> &Buffer)
+	: buffer(Buffer), pos(0)
+{
+	registerTypes(*this);
+	fileVersion = version;
+}
+
+int CMemoryLoader::read(void * data, unsigned size)
+{
+	if(pos + size > buffer.size())
+		throw std::runtime_error("Reading past end of buffer");
+	std::copy(buffer.begin() + pos, buffer.begin() + pos + size, static_cast<ui8 *>(data));
+	pos += size;
+	return size;
+}
+
+void CMemoryLoader::checkMagicBytes(const std::string &text)
+{
+	std::string loaded = text;
+	read((void *)loaded.c_str(), text.length());
+	if(loaded != text)
+		throw std::runtime_error("Magic bytes doesn't match!");
+}
+
+bool CMemorySaver::hasSameSettings(const CConnection &c) const
+{
+	//with smart pointer serialization result would depend on pointers already sent through given connection
+	if(smartPointerSerialization || c.COSer<CConnection>::smartPointerSerialization)
+		return false;
+
+	if(smartVectorMembersSerialization != c.smartVectorMembersSerialization
+		|| sendStackInstanceByIds != c.sendStackInstanceByIds)
+		return false;
+
+	if(smartVectorMembersSerialization)
+	{
+		//both must use vectors of the same game state, so it's enough to check that the same types are vectorised
+		if(vectors.size() != c.vectors.size())
+			return false;
+		for(auto & elem : vectors)
+			if(!c.vectors.count(elem.first))
+				return false;
+	}
+	return true;
+}
+
 CSerializer::~CSerializer()
 {
 
@@ -529,6 +1329,7 @@ int CLoadIntegrityValidator::read( const void * data, unsigned size )
 unique_ptr<CLoadFile> CLoadIntegrityValidator::decay()
 {
 	primaryFile->loadedPointers = this->loadedPointers;
+	primaryFile->sparseLoadedPointers = this->sparseLoadedPointers;
 	return std::move(primaryFile);
 }
 
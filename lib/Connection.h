@@ -12,6 +12,7 @@
 #pragma once
 
 #include <typeinfo> //XXX this is in namespace std if you want w/o use typeinfo.h?
+#include <typeindex>
 #include <type_traits>
 
 #include <boost/variant.hpp>
@@ -27,7 +28,8 @@
 #include "mapping/CCampaignHandler.h" //for CCampaignState
 #include "rmg/CMapGenerator.h" // for CMapGenOptions
 
-const ui32 version = 741;
+const ui32 version = 742;
+const ui32 compressedSaveVersion = 742; //saves since this version store data in compressed chunks
 
 class CConnection;
 class CGObjectInstance;
@@ -86,8 +88,9 @@ struct TypeComparer
 
 class DLL_LINKAGE CTypeList
 {
-	typedef std::multimap<const std::type_info *,ui16,TypeComparer> TTypeMap;
-	TTypeMap types;
+	std::unordered_map<const std::type_info *, ui16> typesByAddress; //fast lookup, but the same type may have different type_info objects in different modules
+	std::unordered_map<std::type_index, ui16> types; //[type] -> id, ids are consecutive starting from 1
+	std::vector<const std::type_info *> typesByID; //[id - 1] -> type
 public:
 	CTypeList();
 	ui16 registerType(const std::type_info *type);
@@ -102,6 +105,7 @@ public:
 		return getTypeID(getTypeInfo(t));
 	}
 
+	const std::type_info * getTypeInfo(ui16 id) const; //nullptr for unknown id
 
 	template <typename T> const std::type_info * getTypeInfo(const T * t = nullptr)
 	{
@@ -539,9 +543,9 @@ template <typename Serializer> class DLL_LINKAGE COSer : public CSaverBase
 {
 public:
 	bool saving;
-	std::map<ui16,CBasicPointerSaver*> savers; // typeID => CPointerSaver<serializer,type>
+	std::vector<CBasicPointerSaver*> savers; // [typeID] => CPointerSaver<serializer,type>
 
-	std::map<const void*, ui32> savedPointers;
+	std::unordered_map<const void*, ui32> savedPointers;
 	bool smartPointerSerialization;
 
 	COSer()
@@ -549,17 +553,22 @@ public:
 		saving=true;
 		smartPointerSerialization = true;
 	}
+
+	void reservePointers(size_t expectedCount) //avoids rehashing pointers table while saving big structures
+	{
+		savedPointers.reserve(expectedCount);
+	}
 	~COSer()
 	{
-		std::map<ui16,CBasicPointerSaver*>::iterator iter;
-
-		for(iter = savers.begin(); iter != savers.end(); iter++)
-			delete iter->second;
+		for(auto saver : savers)
+			delete saver;
 	}
 
 	template<typename T> void registerType(const T * t=nullptr)
 	{
 		ui16 ID = typeList.registerType(t);
+		if(ID >= savers.size())
+			savers.resize(ID + 1, nullptr);
 		savers[ID] = new CPointerSaver<COSer<Serializer>,T>;
 	}
 
@@ -624,7 +633,7 @@ public:
 
 		if(smartPointerSerialization)
 		{
-			std::map<const void*,ui32>::iterator i = savedPointers.find(data);
+			auto i = savedPointers.find(data);
 			if(i != savedPointers.end())
 			{
 				//this pointer has been already serialized - write only it's id
@@ -659,7 +668,25 @@ public:
 	void saveArray(const T &data)
 	{
 		ui32 size = ARRAY_COUNT(data);
-		for(ui32 i=0; i < size; i++)
+		saveRange(&data[0], size);
+	}
+
+	//saves count elements, primitive ones are written in one call
+	template <typename T>
+	void saveRange(const T *data, ui32 count)
+	{
+		saveRange(data, count, typename mpl::equal_to<SerializationLevel<T>,mpl::int_<Primitive> >::type());
+	}
+	template <typename T>
+	void saveRange(const T *data, ui32 count, mpl::true_)
+	{
+		if(count)
+			this->This()->write(data, sizeof(T) * count);
+	}
+	template <typename T>
+	void saveRange(const T *data, ui32 count, mpl::false_)
+	{
+		for(ui32 i=0; i < count; i++)
 			*this << data[i];
 	}
 	template <typename T>
@@ -720,14 +747,12 @@ public:
 	{
 		ui32 length = data.size();
 		*this << length;
-		for(ui32 i=0;i<length;i++)
-			*this << data[i];
+		saveRange(data.data(), length);
 	}
 	template <typename T, size_t N>
 	void saveSerializable(const std::array<T, N> &data)
 	{
-		for(ui32 i=0; i < N; i++)
-			*this << data[i];
+		saveRange(data.data(), N);
 	}
 	template <typename T>
 	void saveSerializable(const std::set<T> &data)
@@ -848,12 +873,14 @@ template <typename Serializer> class DLL_LINKAGE CISer : public CLoaderBase
 {
 public:
 	bool saving;
-	std::map<ui16,CBasicPointerLoader*> loaders; // typeID => CPointerSaver<serializer,type>
+	std::vector<CBasicPointerLoader*> loaders; // [typeID] => CPointerSaver<serializer,type>
 	ui32 fileVersion;
 	bool reverseEndianess; //if source has different endianess than us, we reverse bytes
 
-	std::map<ui32, void*> loadedPointers;
-	std::map<const void*, boost::any> loadedSharedPointers;
+	static const ui32 MAX_POINTER_ID_GAP = 1024; //ids further beyond loadedPointers end go to sparseLoadedPointers
+	std::vector<void*> loadedPointers; //[pointer id] -> loaded object (nullptr if not loaded yet); ids are given in order of saving, so the vector is dense
+	std::unordered_map<ui32, void*> sparseLoadedPointers; //[pointer id] -> loaded object for ids that would make loadedPointers huge (corrupted data)
+	std::unordered_map<const void*, boost::any> loadedSharedPointers;
 
 	bool smartPointerSerialization;
 
@@ -867,15 +894,15 @@ public:
 
 	~CISer()
 	{
-		std::map<ui16,CBasicPointerLoader*>::iterator iter;
-
-		for(iter = loaders.begin(); iter != loaders.end(); iter++)
-			delete iter->second;
+		for(auto loader : loaders)
+			delete loader;
 	}
 
 	template<typename T> void registerType(const T * t=nullptr)
 	{
 		ui16 ID = typeList.registerType(t);
+		if(ID >= loaders.size())
+			loaders.resize(ID + 1, nullptr);
 		loaders[ID] = new CPointerLoader<CISer<Serializer>,T>;
 	}
 
@@ -970,7 +997,35 @@ public:
 	void loadArray(T &data)
 	{
 		ui32 size = ARRAY_COUNT(data);
-		for(ui32 i = 0; i < size; i++)
+		loadRange(&data[0], size);
+	}
+
+	//loads count elements, primitive ones are read in one call
+	template <typename T>
+	void loadRange(T *data, ui32 count)
+	{
+		loadRange(data, count, typename mpl::equal_to<SerializationLevel<T>,mpl::int_<Primitive> >::type());
+	}
+	template <typename T>
+	void loadRange(T *data, ui32 count, mpl::true_)
+	{
+		if(!count)
+			return;
+
+		this->This()->read(data, sizeof(T) * count);
+		if(reverseEndianess && sizeof(T) > 1)
+		{
+			for(ui32 i = 0; i < count; i++)
+			{
+				char *dataPtr = (char*)(data + i);
+				std::reverse(dataPtr, dataPtr + sizeof(T));
+			}
+		}
+	}
+	template <typename T>
+	void loadRange(T *data, ui32 count, mpl::false_)
+	{
+		for(ui32 i = 0; i < count; i++)
 			*this >> data[i];
 	}
 	template <typename T>
@@ -1012,12 +1067,10 @@ public:
 		if(smartPointerSerialization)
 		{
 			*this >> pid; //get the id
-			std::map<ui32, void*>::iterator i = loadedPointers.find(pid); //lookup
-
-			if(i != loadedPointers.end())
+			if(void *loaded = getLoadedPointer(pid))
 			{
 				//we already got this pointer
-				data = static_cast<T>(i->second);
+				data = static_cast<T>(loaded);
 				return;
 			}
 		}
@@ -1042,6 +1095,8 @@ public:
 		}
 		else
 		{
+			if(tid >= loaders.size() || !loaders[tid])
+				throw std::runtime_error("Cannot load pointer to unknown type " + boost::lexical_cast<std::string>(tid));
 			loaders[tid]->loadPtr(*this,&data, pid);
 		}
 	}
@@ -1050,7 +1105,35 @@ public:
 	void ptrAllocated(const T *ptr, ui32 pid)
 	{
 		if(smartPointerSerialization && pid != 0xffffffff)
-			loadedPointers[pid] = (void*)ptr; //add loaded pointer to our lookup map; cast is to avoid errors with const T* pt
+		{
+			//add loaded pointer to our lookup table; cast is to avoid errors with const T* pt
+			if(pid < loadedPointers.size())
+				loadedPointers[pid] = (void*)ptr;
+			else if(pid - loadedPointers.size() <= MAX_POINTER_ID_GAP)
+			{
+				loadedPointers.resize(pid + 1, nullptr);
+				loadedPointers[pid] = (void*)ptr;
+			}
+			else
+				sparseLoadedPointers[pid] = (void*)ptr;
+		}
+	}
+
+	void * getLoadedPointer(ui32 pid) const //nullptr if not loaded yet
+	{
+		if(pid < loadedPointers.size() && loadedPointers[pid])
+			return loadedPointers[pid];
+		if(sparseLoadedPointers.empty())
+			return nullptr;
+
+		auto i = sparseLoadedPointers.find(pid);
+		return i != sparseLoadedPointers.end() ? i->second : nullptr;
+	}
+
+	void clearLoadedPointers()
+	{
+		loadedPointers.clear();
+		sparseLoadedPointers.clear();
 	}
 
 #define READ_CHECK_U32(x)			\
@@ -1110,14 +1193,12 @@ public:
 	{
 		READ_CHECK_U32(length);
 		data.resize(length);
-		for(ui32 i=0;i<length;i++)
-			*this >> data[i];
+		loadRange(data.data(), length);
 	}
 	template <typename T, size_t N>
 	void loadSerializable(std::array<T, N> &data)
 	{
-		for(ui32 i = 0; i < N; i++)
-			*this >> data[i];
+		loadRange(data.data(), N);
 	}
 	template <typename T>
 	void loadSerializable(std::set<T> &data)
@@ -1251,6 +1332,43 @@ public:
 	}
 };
 
+/// Block of data compressed with zlib, used by chunks of saves and frames of connections.
+/// Stored as ui32 size of stored data, ui32 size of uncompressed data (0 if data isn't compressed), data; little endian.
+class DLL_LINKAGE CCompressedBlock
+{
+public:
+	static const size_t HEADER_SIZE = 8;
+	static const size_t MIN_COMPRESSED_SIZE = 128; //smaller blocks are not worth compressing
+
+	static void pack(const std::vector<ui8> &data, std::vector<ui8> &out, int level); //appends block with given data to out, with level 0 data is stored as is
+	static void makeHeader(ui8 *header, ui32 dataSize, ui32 rawSize);
+	static void parseHeader(const ui8 *header, ui32 &dataSize, ui32 &rawSize);
+	static void unpack(const ui8 *data, ui32 dataSize, ui32 rawSize, ui8 *out); //out must have room for rawSize (or dataSize if not compressed) bytes, throws!
+	static void unpack(std::vector<ui8> &data, ui32 rawSize, std::vector<ui8> &out); //data - stored data of block (may be taken over), throws!
+};
+
+/// Compresses chunks of data (as CCompressedBlock) and writes them to a stream in a background thread.
+class DLL_LINKAGE CBackgroundChunkWriter
+{
+	std::ostream &out;
+	std::deque<std::vector<ui8> > chunks; //waiting for compression
+	bool finishing;
+	std::string error; //message of exception thrown while writing, empty if none
+	boost::mutex mx;
+	boost::condition_variable cond;
+	boost::thread thread;
+
+	void run();
+public:
+	static const size_t CHUNK_SIZE = 256 * 1024;
+	static const size_t MAX_QUEUED_CHUNKS = 16; //adding chunk blocks if more are waiting
+
+	CBackgroundChunkWriter(std::ostream &Out);
+	~CBackgroundChunkWriter(); //waits till all chunks are written
+	void addChunk(std::vector<ui8> &&data); //throws if writing failed
+	void finish(); //waits till all chunks are written, throws if writing failed
+};
+
 class DLL_LINKAGE CSaveFile
 	: public COSer<CSaveFile>
 {
@@ -1261,13 +1379,18 @@ class DLL_LINKAGE CSaveFile
 public:
 	std::string fName;
 	unique_ptr<std::ofstream> sfile;
+	std::vector<ui8> chunk; //data not passed to writer yet
+	unique_ptr<CBackgroundChunkWriter> writer; //compresses and writes data to sfile
 
 	CSaveFile(const std::string &fname); //throws!
 	~CSaveFile();
 	int write(const void * data, unsigned size);
 
-	void openNextFile(const std::string &fname); //throws!
+	void openNextFile(const std::string &fname); //waits for background saves, throws!
+	void close(); //writes remaining data, throws!
+	void closeInBackground(); //remaining data is written by another thread, errors are only logged; throws if writing has already failed
 	void clear();
+	static void waitForBackgroundSaves(); //has to be called before reading saved files or exiting
     void reportState(CLogger * out);
 
 	void putMagicBytes(const std::string &text);
@@ -1281,9 +1404,14 @@ class DLL_LINKAGE CLoadFile
 		std::string dummy = "This function makes stuff working.";
 		*this >> dummy;
 	}
+
+	void readChunk();
 public:
 	std::string fName;
 	unique_ptr<std::ifstream> sfile;
+	bool compressed; //true for files containing compressed chunks
+	std::vector<ui8> chunk; //content of current chunk
+	size_t chunkPos; //position of next byte to be read from chunk
 
 	CLoadFile(const std::string &fname, int minimalVersion = version); //throws!
 	~CLoadFile();
@@ -1319,9 +1447,50 @@ class DLL_LINKAGE CConnection
 	//CGameState *gs;
 	CConnection(void);
 
+	//Data is sent in frames (CCompressedBlock) of at most BUFFER_SIZE uncompressed bytes. Frame shorter than BUFFER_SIZE
+	//(possibly empty) ends a message - data sent by one flush, so reader knows when it has whole packs without parsing them.
+	std::vector<ui8> writeBuffer; //data waiting to be sent with next flush
+	bool messageStarted; //full frames of current message have been sent already, message has to be ended by short frame
+	int batchDepth; //number of active batches, flush() does nothing when non-zero
+	std::vector<ui8> readBuffer; //data received from socket but not read yet (from readPos to readEnd), has room for whole frame
+	size_t readPos, readEnd;
+
+	bool compression; //negotiated during handshake, if true frames are compressed
+	int compressionLevel;
+	std::vector<ui8> frameData; //uncompressed content of received frames not read yet (from framePos)
+	size_t framePos;
+
+	bool asyncWrites; //if true, flushed data is queued and sent by thread running io_service
+	shared_ptr<void> strand; //boost::asio::io_service::strand, all asynchronous operations on socket go through it
+	size_t queuedBytes, maxQueuedBytes;
+	std::deque<shared_ptr<const std::vector<ui8> > > writeQueue; //data waiting to be sent, the first one is being sent
+	boost::mutex writeQueueMx;
+	boost::condition_variable writeQueueCond;
+
+	bool asyncReads; //if true, socket is read by thread running io_service which calls messageHandler for each received message
+	bool stoppingReads;
+	std::function<bool()> messageHandler;
+	std::function<void(const std::string &)> readErrorHandler;
+	boost::mutex readStateMx; //protects asyncReads and stoppingReads
+	boost::condition_variable readStateCond;
+
 	void init();
+	void sendBuffer(); //ends message, sends all buffered data regardless of batches; throws on error
+	void sendFrame(); //sends content of write buffer as one frame, throws on error
+	void readFrame(); //reads next frame into frameData
+	void readRaw(ui8 * out, size_t size); //reads data as received from socket, through read buffer
+	size_t readSocket(ui8 * out, size_t size, size_t atLeast); //blocks till at least atLeast bytes are read, returns number of read bytes
+	bool takeBufferedFrame(bool &endsMessage); //appends content of frame to frameData if whole frame is in read buffer, throws
+	void queueWrite(shared_ptr<const std::vector<ui8> > data); //blocks if queue is full, throws if connection has been lost
+	void startAsyncWrite(); //has to be called in strand with writeQueueMx locked
+	void asyncWriteFinished(const boost::system::error_code &error);
+	void continueAsyncReads(); //handles messages in read buffer and starts reading next frame, has to be called in strand
+	void asyncReadFinished(const boost::system::error_code &error, size_t transferred);
+	void finishAsyncReads(const std::string &error); //error is empty if reading was stopped
     void reportState(CLogger * out);
 public:
+	static const size_t BUFFER_SIZE = 64 * 1024; //size of read buffer and size of write buffer that forces flush
+	static const int FAST_COMPRESSION = 1, BEST_COMPRESSION = 9; //zlib compression levels: for live traffic and for big, one-time transfers
 	boost::mutex *rmx, *wmx; // read/write mutexes
 	TSocket * socket;
 	bool logging;
@@ -1339,8 +1508,9 @@ public:
 	CConnection(TAcceptor * acceptor, boost::asio::io_service *Io_service, std::string Name);
 	CConnection(TSocket * Socket, std::string Name); //use immediately after accepting connection into socket
 
-	int write(const void * data, unsigned size);
+	int write(const void * data, unsigned size); //buffered, data is sent on flush
 	int read(void * data, unsigned size);
+	void flush(); //has to be called after each complete message (eg. pack), sends buffered data unless batch is active; throws on error
 	void close();
 	bool isOpen() const;
     template<class T>
@@ -1349,6 +1519,20 @@ public:
 
 	CPack *retreivePack(); //gets from server next pack (allocates it with new)
 	void sendPackToServer(const CPack &pack, PlayerColor player, ui32 requestID);
+	void sendRawData(shared_ptr<const std::vector<ui8> > data); //sends already serialized data (eg. pack encoded once for many connections)
+
+	void startBatch(); //data sent until matching endBatch call is buffered and sent at once, calls can be nested
+	void endBatch();
+
+	void setCompressionLevel(int level); //zlib level of compression (if enabled for this connection), FAST_COMPRESSION by default
+	void enableAsyncWrites(size_t MaxQueuedBytes); //someone must run io_service of the socket, writers are blocked only when more than MaxQueuedBytes waits for sending
+	void disableAsyncWrites(); //waits till queued data is sent
+	//Someone must run io_service of the socket. OnMessage is called by it for each received message, it has to read whole message
+	//(reads don't block, they throw if message has no more data) and return false to stop reading; rest of data can be read later as usual.
+	//OnError is called if connection has been lost (or message couldn't be read), reading stops then.
+	void startAsyncReads(std::function<bool()> OnMessage, std::function<void(const std::string &)> OnError);
+	void stopAsyncReads(); //cancels reading and waits till handlers finish; io_service has to be running, cancels asynchronous writes as well
+	bool hasUnreadMessageData() const; //true if received message (in async reads) has data that wasn't read yet
 
 	void disableStackSendingByID();
 	void enableStackSendingByID();
@@ -1363,23 +1547,84 @@ public:
 
 DLL_LINKAGE std::ostream &operator<<(std::ostream &str, const CConnection &cpc);
 
+/// Batches writes to given connections for the lifetime of this object (eg. all packs sent during new turn)
+class DLL_LINKAGE CConnectionsBatch
+{
+	std::vector<CConnection *> conns;
+public:
+	CConnectionsBatch(const std::set<CConnection *> &Conns);
+	~CConnectionsBatch(); //sends buffered data
+};
+
+/// Switches given connections to asynchronous writes and runs their io_service in a separate thread for the lifetime of this object.
+/// Slow client doesn't block sending data to other clients unless its queue is full. Asynchronous reads of the connections
+/// (started with startAsyncReads) are done by the same thread, so socket is never used by two threads at once.
+class DLL_LINKAGE CAsyncConnectionsWriter
+{
+	std::vector<CConnection *> conns;
+	std::vector<boost::asio::io_service *> services;
+	std::vector<shared_ptr<void> > works; //io_service::work objects keeping io_services running
+	boost::thread_group threads;
+	size_t maxQueuedBytes;
+
+	void runService(boost::asio::io_service *service);
+public:
+	CAsyncConnectionsWriter(const std::set<CConnection *> &Conns, size_t MaxQueuedBytes);
+	~CAsyncConnectionsWriter(); //waits till queued data is sent, then stops reads
+
+	void addConnection(CConnection *c); //eg. client joining running game, has to be called by thread owning this object
+};
+
+/// Serializes data into memory buffer. Used to encode pack once and send the same bytes through many connections
+/// and to keep checkpoint of game state for clients joining running game.
+class DLL_LINKAGE CMemorySaver
+	: public COSer<CMemorySaver>
+{
+public:
+	std::vector<ui8> buffer;
+
+	CMemorySaver();
+	int write(const void * data, unsigned size);
+	void putMagicBytes(const std::string &text);
+
+	bool hasSameSettings(const CConnection &c) const; //true if data serialized by this saver is identical to data serialized directly by c
+};
+
+/// Reads data serialized by CMemorySaver of the same version
+class DLL_LINKAGE CMemoryLoader
+	: public CISer<CMemoryLoader>
+{
+public:
+	std::vector<ui8> buffer;
+	size_t pos; //position of next byte to be read
+
+	CMemoryLoader(const std::vector<ui8> &Buffer);
+	int read(void * data, unsigned size); //throws if buffer ends!
+
+	void checkMagicBytes(const std::string &text);
+};
+
 template<typename T>
 class CApplier
 {
 public:
-	std::map<ui16,T*> apps;
+	std::vector<T*> apps; //[type id]
 
 	~CApplier()
 	{
-		typename std::map<ui16, T*>::iterator iter;
-
-		for(iter = apps.begin(); iter != apps.end(); iter++)
-			delete iter->second;
+		for(auto app : apps)
+			delete app;
 	}
 	template<typename U> void registerType(const U * t=nullptr)
 	{
 		ui16 ID = typeList.registerType(t);
+		if(ID >= apps.size())
+			apps.resize(ID + 1, nullptr);
 		apps[ID] = T::getApplier(t);
 	}
 
+	T *getApplier(ui16 ID) const //nullptr if type has no applier
+	{
+		return ID < apps.size() ? apps[ID] : nullptr;
+	}
 };
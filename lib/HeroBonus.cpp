@@ -73,9 +73,113 @@ const bmap<std::string, TPropagatorPtr> bonusPropagatorMap = boost::assign::map_
 #define BONUS_LOG_LINE(x) logBonus->traceStream() << x
 
 int CBonusSystemNode::treeChanged = 1;
+int CBonusSystemNode::treeInvalidated = 1;
 const bool CBonusSystemNode::cachingEnabled = true;
 
-BonusList::BonusList(bool BelongsToTree /* =false */) : belongsToTree(BelongsToTree)
+//selectors of fixed queries are built once, not on every call of a getter
+static CSelector fieldsSelector(CSelectorTerm::EField field, si32 value, CSelectorTerm::EField field2, si32 value2) //value2 == -1 - any
+{
+	CSelectorTerm term(field, value);
+	if(value2 != -1)
+	{
+		term.values[field2] = value2;
+		term.masks[field2] = -1;
+	}
+	return CSelector(term);
+}
+
+static std::vector<CSelector> makeTypeSelectors()
+{
+	std::vector<CSelector> ret;
+#define BONUS_NAME(x) ret.push_back(CSelector(CSelectorTerm(CSelectorTerm::TYPE, Bonus::x)));
+	BONUS_LIST
+#undef BONUS_NAME
+	return ret;
+}
+
+static const std::vector<CSelector> typeSelectors = makeTypeSelectors(); //[bonus type]
+static const CSelector minDamageSelector = fieldsSelector(CSelectorTerm::TYPE, Bonus::CREATURE_DAMAGE, CSelectorTerm::SUBTYPE, 0)
+	.Or(fieldsSelector(CSelectorTerm::TYPE, Bonus::CREATURE_DAMAGE, CSelectorTerm::SUBTYPE, 1));
+static const CSelector maxDamageSelector = fieldsSelector(CSelectorTerm::TYPE, Bonus::CREATURE_DAMAGE, CSelectorTerm::SUBTYPE, 0)
+	.Or(fieldsSelector(CSelectorTerm::TYPE, Bonus::CREATURE_DAMAGE, CSelectorTerm::SUBTYPE, 2));
+static const CSelector notLivingSelector = typeSelectors[Bonus::UNDEAD].Or(typeSelectors[Bonus::NON_LIVING]).Or(typeSelectors[Bonus::SIEGE_WEAPON]);
+static const CSelector spellEffectsSelector = CSelector(CSelectorTerm(CSelectorTerm::SOURCE, Bonus::SPELL_EFFECT));
+static const CSelector anyRangeSelector = CSelector(CSelectorTerm());
+
+BonusCachingKey::BonusCachingKey(EQueryKind kind, ui32 field, si32 value)
+	: key((static_cast<ui64>(kind) << 56) | (static_cast<ui64>(field & 0xffffff) << 32) | static_cast<ui32>(value))
+{
+}
+
+BonusCachingKey BonusCachingKey::type(Bonus::BonusType type, si32 subtype /*= -1*/)
+{
+	return BonusCachingKey(TYPE, type, subtype);
+}
+
+BonusCachingKey BonusCachingKey::source(Bonus::BonusSource source, si32 sourceID /*= -1*/)
+{
+	return BonusCachingKey(SOURCE, source, sourceID);
+}
+
+BonusCachingKey BonusCachingKey::special(EQueryKind kind)
+{
+	return BonusCachingKey(kind, 0, 0);
+}
+
+CBonusRequestsCache::CBonusRequestsCache() : used(0)
+{
+}
+
+size_t CBonusRequestsCache::slotFor(const BonusCachingKey &key) const
+{
+	const size_t mask = slots.size() - 1;
+	size_t i = static_cast<size_t>((key.key * 0x9E3779B97F4A7C15ULL) >> 32) & mask; //Fibonacci hashing
+	while(!slots[i].first.empty() && slots[i].first != key)
+		i = (i + 1) & mask;
+	return i;
+}
+
+TBonusListPtr CBonusRequestsCache::find(const BonusCachingKey &key) const
+{
+	if(!used)
+		return TBonusListPtr();
+
+	return slots[slotFor(key)].second;
+}
+
+void CBonusRequestsCache::insert(const BonusCachingKey &key, const TBonusListPtr &result)
+{
+	assert(!key.empty());
+	if(2 * (used + 1) > slots.size()) //keep load factor below 1/2
+	{
+		std::vector<std::pair<BonusCachingKey, TBonusListPtr> > oldSlots(std::max<size_t>(16, 2 * slots.size()));
+		oldSlots.swap(slots);
+		for(auto & slot : oldSlots)
+			if(!slot.first.empty())
+				slots[slotFor(slot.first)] = std::move(slot);
+	}
+
+	auto & slot = slots[slotFor(key)];
+	if(slot.first.empty())
+		used++;
+	slot.first = key;
+	slot.second = result;
+}
+
+void CBonusRequestsCache::clear()
+{
+	if(!used)
+		return;
+
+	for(auto & slot : slots)
+	{
+		slot.first = BonusCachingKey();
+		slot.second.reset();
+	}
+	used = 0;
+}
+
+BonusList::BonusList(CBonusSystemNode *Owner /* = nullptr */) : owner(Owner), columnsValid(false)
 {
 
 }
@@ -84,14 +188,16 @@ BonusList::BonusList(const BonusList &bonusList)
 {
 	bonuses.resize(bonusList.size());
 	std::copy(bonusList.begin(), bonusList.end(), bonuses.begin());
-	belongsToTree = false;
+	owner = nullptr;
+	columnsValid = false;
 }
 
 BonusList& BonusList::operator=(const BonusList &bonusList)
 {
 	bonuses.resize(bonusList.size());
 	std::copy(bonusList.begin(), bonusList.end(), bonuses.begin());
-	belongsToTree = false;
+	owner = nullptr;
+	columnsValid = false;
 	return *this;
 }
 
@@ -221,16 +327,81 @@ void BonusList::getBonuses(BonusList & out, const CSelector &selector) const
 
 void BonusList::getBonuses(BonusList & out, const CSelector &selector, const CSelector &limit) const
 {
+	const bool hasLimit = limit;
+	if(columnsValid && selector.isCompiled() && (!hasLimit || limit.isCompiled()))
+	{
+		//bonuses without limit predicate have to have NO_LIMIT effect range
+		CSelector filter = selector.And(hasLimit ? limit : CSelector(CSelectorTerm(CSelectorTerm::EFFECT_RANGE, Bonus::NO_LIMIT)));
+		if(filter.isCompiled())
+		{
+			getBonusesByColumns(out, filter);
+			return;
+		}
+	}
+
 	for (auto & elem : bonuses)
 	{
 		Bonus *b = elem;
 
 		//add matching bonuses that matches limit predicate or have NO_LIMIT if no given predicate
-		if(selector(b) && ((!limit && b->effectRange == Bonus::NO_LIMIT) || (limit && limit(b))))
+		if(selector(b) && (hasLimit ? limit(b) : b->effectRange == Bonus::NO_LIMIT))
 			out.push_back(b);
 	}
 }
 
+void BonusList::getBonusesByColumns(BonusList &out, const CSelector &filter) const
+{
+	// Bonuses are processed in blocks, for each block and term we compare whole columns of tested
+	// fields, which touches only contiguous memory and can be vectorized by compiler
+	const int BLOCK_SIZE = 64;
+	const size_t count = bonuses.size();
+	si32 matched[BLOCK_SIZE], diff[BLOCK_SIZE];
+
+	for(size_t first = 0; first < count; first += BLOCK_SIZE)
+	{
+		const size_t blockSize = std::min<size_t>(BLOCK_SIZE, count - first);
+		std::fill_n(matched, blockSize, 0);
+
+		for(int t = 0; t < filter.getTermsCount(); t++)
+		{
+			const CSelectorTerm &term = filter.getTerm(t);
+			std::fill_n(diff, blockSize, 0);
+			for(int field = 0; field < CSelectorTerm::FIELDS_COUNT; field++)
+			{
+				if(!term.masks[field])
+					continue;
+
+				const si32 *column = &columns[field * count + first];
+				const si32 value = term.values[field];
+				for(size_t i = 0; i < blockSize; i++)
+					diff[i] |= column[i] ^ value;
+			}
+
+			for(size_t i = 0; i < blockSize; i++)
+				matched[i] |= !diff[i];
+		}
+
+		for(size_t i = 0; i < blockSize; i++)
+			if(matched[i])
+				out.push_back(bonuses[first + i]);
+	}
+}
+
+void BonusList::buildColumns()
+{
+	const size_t count = bonuses.size();
+	columns.resize(count * CSelectorTerm::FIELDS_COUNT);
+
+	si32 fields[CSelectorTerm::FIELDS_COUNT];
+	for(size_t i = 0; i < count; i++)
+	{
+		CSelectorTerm::getFields(bonuses[i], fields);
+		for(int field = 0; field < CSelectorTerm::FIELDS_COUNT; field++)
+			columns[field * count + i] = fields[field];
+	}
+	columnsValid = true;
+}
+
 void BonusList::getAllBonuses(BonusList &out) const
 {
 	for(Bonus *b : bonuses)
@@ -256,20 +427,26 @@ void BonusList::eliminateDuplicates()
 {
 	sort( bonuses.begin(), bonuses.end() );
 	bonuses.erase( unique( bonuses.begin(), bonuses.end() ), bonuses.end() );
+	columnsValid = false;
+}
+
+void BonusList::changed()
+{
+	columnsValid = false;
+	if(owner)
+		owner->nodeHasChanged();
 }
 
 void BonusList::push_back(Bonus* const &x)
 {
 	bonuses.push_back(x);
 
-	if (belongsToTree)
-		CBonusSystemNode::incrementTreeChangedNum();
+	changed();
 }
 
 std::vector<Bonus*>::iterator BonusList::erase(const int position)
 {
-	if (belongsToTree)
-		CBonusSystemNode::incrementTreeChangedNum();
+	changed();
 	return bonuses.erase(bonuses.begin() + position);
 }
 
@@ -277,8 +454,7 @@ void BonusList::clear()
 {
 	bonuses.clear();
 
-	if (belongsToTree)
-		CBonusSystemNode::incrementTreeChangedNum();
+	changed();
 }
 
 std::vector<BonusList*>::size_type BonusList::operator-=(Bonus* const &i)
@@ -288,8 +464,7 @@ std::vector<BonusList*>::size_type BonusList::operator-=(Bonus* const &i)
 		return false;
 	bonuses.erase(itr);
 
-	if (belongsToTree)
-		CBonusSystemNode::incrementTreeChangedNum();
+	changed();
 	return true;
 }
 
@@ -297,16 +472,14 @@ void BonusList::resize(std::vector<Bonus*>::size_type sz, Bonus* c )
 {
 	bonuses.resize(sz, c);
 
-	if (belongsToTree)
-		CBonusSystemNode::incrementTreeChangedNum();
+	changed();
 }
 
 void BonusList::insert(std::vector<Bonus*>::iterator position, std::vector<Bonus*>::size_type n, Bonus* const &x)
 {
 	bonuses.insert(position, n, x);
 
-	if (belongsToTree)
-		CBonusSystemNode::incrementTreeChangedNum();
+	changed();
 }
 
 int IBonusBearer::valOfBonuses(Bonus::BonusType type, const CSelector &selector) const
@@ -316,77 +489,66 @@ int IBonusBearer::valOfBonuses(Bonus::BonusType type, const CSelector &selector)
 
 int IBonusBearer::valOfBonuses(Bonus::BonusType type, int subtype /*= -1*/) const
 {
-	std::stringstream cachingStr;
-	cachingStr << "type_" << type << "s_" << subtype;
-
-	CSelector s = Selector::type(type);
-	if(subtype != -1)
-		s = s.And(Selector::subtype(subtype));
+	if(subtype == -1)
+		return valOfBonuses(typeSelectors[type], BonusCachingKey::type(type, subtype));
 
-	return valOfBonuses(s, cachingStr.str());
+	return valOfBonuses(fieldsSelector(CSelectorTerm::TYPE, type, CSelectorTerm::SUBTYPE, subtype), BonusCachingKey::type(type, subtype));
 }
 
-int IBonusBearer::valOfBonuses(const CSelector &selector, const std::string &cachingStr) const
+int IBonusBearer::valOfBonuses(const CSelector &selector, const BonusCachingKey &cachingKey) const
 {
 	CSelector limit = nullptr;
-	TBonusListPtr hlp = getAllBonuses(selector, limit, nullptr, cachingStr);
+	TBonusListPtr hlp = getAllBonuses(selector, limit, nullptr, cachingKey);
 	return hlp->totalValue();
 }
-bool IBonusBearer::hasBonus(const CSelector &selector, const std::string &cachingStr /*= ""*/) const
+bool IBonusBearer::hasBonus(const CSelector &selector, const BonusCachingKey &cachingKey /*= BonusCachingKey()*/) const
 {
-	return getBonuses(selector, cachingStr)->size() > 0;
+	return getBonuses(selector, cachingKey)->size() > 0;
 }
 
 bool IBonusBearer::hasBonusOfType(Bonus::BonusType type, int subtype /*= -1*/) const
 {
-	std::stringstream cachingStr;
-	cachingStr << "type_" << type << "s_" << subtype;
-
-	CSelector s = Selector::type(type);
-	if(subtype != -1)
-		s = s.And(Selector::subtype(subtype));
+	if(subtype == -1)
+		return hasBonus(typeSelectors[type], BonusCachingKey::type(type, subtype));
 
-	return hasBonus(s, cachingStr.str());
+	return hasBonus(fieldsSelector(CSelectorTerm::TYPE, type, CSelectorTerm::SUBTYPE, subtype), BonusCachingKey::type(type, subtype));
 }
 
 void IBonusBearer::getModifiersWDescr(TModDescr &out, Bonus::BonusType type, int subtype /*= -1 */) const
 {
-	std::stringstream cachingStr;
-	cachingStr << "type_" << type << "s_" << subtype;
-	getModifiersWDescr(out, subtype != -1 ? Selector::typeSubtype(type, subtype) : Selector::type(type), cachingStr.str());
+	if(subtype == -1)
+		getModifiersWDescr(out, typeSelectors[type], BonusCachingKey::type(type, subtype));
+	else
+		getModifiersWDescr(out, fieldsSelector(CSelectorTerm::TYPE, type, CSelectorTerm::SUBTYPE, subtype), BonusCachingKey::type(type, subtype));
 }
 
-void IBonusBearer::getModifiersWDescr(TModDescr &out, const CSelector &selector, const std::string &cachingStr /* =""*/) const
+void IBonusBearer::getModifiersWDescr(TModDescr &out, const CSelector &selector, const BonusCachingKey &cachingKey /*= BonusCachingKey()*/) const
 {
-	getBonuses(selector, cachingStr)->getModifiersWDescr(out);
+	getBonuses(selector, cachingKey)->getModifiersWDescr(out);
 }
 int IBonusBearer::getBonusesCount(Bonus::BonusSource from, int id) const
 {
-	std::stringstream cachingStr;
-	cachingStr << "source_" << from << "id_" << id;
-	return getBonusesCount(Selector::source(from, id), cachingStr.str());
+	return getBonusesCount(fieldsSelector(CSelectorTerm::SOURCE, from, CSelectorTerm::SOURCE_ID, id), BonusCachingKey::source(from, id));
 }
 
-int IBonusBearer::getBonusesCount(const CSelector &selector, const std::string &cachingStr /* =""*/) const
+int IBonusBearer::getBonusesCount(const CSelector &selector, const BonusCachingKey &cachingKey /*= BonusCachingKey()*/) const
 {
-	return getBonuses(selector, cachingStr)->size();
+	return getBonuses(selector, cachingKey)->size();
 }
 
-const TBonusListPtr IBonusBearer::getBonuses(const CSelector &selector, const std::string &cachingStr /*= ""*/) const
+const TBonusListPtr IBonusBearer::getBonuses(const CSelector &selector, const BonusCachingKey &cachingKey /*= BonusCachingKey()*/) const
 {
-	return getAllBonuses(selector, nullptr, nullptr, cachingStr);
+	return getAllBonuses(selector, nullptr, nullptr, cachingKey);
 }
 
-const TBonusListPtr IBonusBearer::getBonuses(const CSelector &selector, const CSelector &limit, const std::string &cachingStr /*= ""*/) const
+const TBonusListPtr IBonusBearer::getBonuses(const CSelector &selector, const CSelector &limit, const BonusCachingKey &cachingKey /*= BonusCachingKey()*/) const
 {
-	return getAllBonuses(selector, limit, nullptr, cachingStr);
+	return getAllBonuses(selector, limit, nullptr, cachingKey);
 }
 
 bool IBonusBearer::hasBonusFrom(Bonus::BonusSource source, ui32 sourceID) const
 {
-	std::stringstream cachingStr;
-	cachingStr << "source_" << source << "id_" << sourceID;
-	return hasBonus(Selector::source(source,sourceID), cachingStr.str());
+	return hasBonus(fieldsSelector(CSelectorTerm::SOURCE, source, CSelectorTerm::SOURCE_ID, sourceID), BonusCachingKey::source(source, sourceID));
 }
 
 int IBonusBearer::MoraleVal() const
@@ -449,15 +611,11 @@ ui32 IBonusBearer::MaxHealth() const
 
 ui32 IBonusBearer::getMinDamage() const
 {
-	std::stringstream cachingStr;
-	cachingStr << "type_" << Bonus::CREATURE_DAMAGE << "s_0Otype_" << Bonus::CREATURE_DAMAGE << "s_1";
-	return valOfBonuses(Selector::typeSubtype(Bonus::CREATURE_DAMAGE, 0).Or(Selector::typeSubtype(Bonus::CREATURE_DAMAGE, 1)), cachingStr.str());
+	return valOfBonuses(minDamageSelector, BonusCachingKey::special(BonusCachingKey::MIN_DAMAGE));
 }
 ui32 IBonusBearer::getMaxDamage() const
 {
-	std::stringstream cachingStr;
-	cachingStr << "type_" << Bonus::CREATURE_DAMAGE << "s_0Otype_" << Bonus::CREATURE_DAMAGE << "s_2";
-	return valOfBonuses(Selector::typeSubtype(Bonus::CREATURE_DAMAGE, 0).Or(Selector::typeSubtype(Bonus::CREATURE_DAMAGE, 2)), cachingStr.str());
+	return valOfBonuses(maxDamageSelector, BonusCachingKey::special(BonusCachingKey::MAX_DAMAGE));
 }
 
 si32 IBonusBearer::manaLimit() const
@@ -488,18 +646,12 @@ si32 IBonusBearer::magicResistance() const
 
 bool IBonusBearer::isLiving() const //TODO: theoreticaly there exists "LIVING" bonus in stack experience documentation
 {
-	std::stringstream cachingStr;
-	cachingStr << "type_" << Bonus::UNDEAD << "s_-1Otype_" << Bonus::NON_LIVING << "s_-11type_" << Bonus::SIEGE_WEAPON; //I don't relaly get what string labels mean?
-	return !hasBonus(Selector::type(Bonus::UNDEAD)
-					.Or(Selector::type(Bonus::NON_LIVING))
-					.Or(Selector::type(Bonus::SIEGE_WEAPON)), cachingStr.str());
+	return !hasBonus(notLivingSelector, BonusCachingKey::special(BonusCachingKey::NOT_LIVING));
 }
 
 const TBonusListPtr IBonusBearer::getSpellBonuses() const
 {
-	std::stringstream cachingStr;
-	cachingStr << "source_" << Bonus::SPELL_EFFECT;
-	return getBonuses(Selector::sourceType(Bonus::SPELL_EFFECT), Selector::anyRange(), cachingStr.str());
+	return getBonuses(spellEffectsSelector, anyRangeSelector, BonusCachingKey::special(BonusCachingKey::SPELL_EFFECTS));
 }
 
 const Bonus * IBonusBearer::getEffect(ui16 id, int turn /*= 0*/) const
@@ -606,18 +758,50 @@ void CBonusSystemNode::getAllBonusesRec(BonusList &out) const
 	bonuses.getAllBonuses(out);
 }
 
-const TBonusListPtr CBonusSystemNode::getAllBonuses(const CSelector &selector, const CSelector &limit, const CBonusSystemNode *root /*= nullptr*/, const std::string &cachingStr /*= ""*/) const
+boost::shared_mutex & CBonusSystemNode::getCacheMutex(const CBonusSystemNode *node)
+{
+	//caches of different nodes are guarded by different mutexes (unless they share a stripe)
+	static boost::shared_mutex cacheMutexes[CACHE_MUTEXES];
+	return cacheMutexes[(reinterpret_cast<size_t>(node) / sizeof(CBonusSystemNode)) % CACHE_MUTEXES];
+}
+
+bool CBonusSystemNode::isCacheOutdated() const
+{
+	return cachedLast < nodeChanged || cachedLast < treeInvalidated;
+}
+
+const TBonusListPtr CBonusSystemNode::getAllBonuses(const CSelector &selector, const CSelector &limit, const CBonusSystemNode *root /*= nullptr*/, const BonusCachingKey &cachingKey /*= BonusCachingKey()*/) const
 {
 	bool limitOnUs = (!root || root == this); //caching won't work when we want to limit bonuses against an external node
 	if (CBonusSystemNode::cachingEnabled && limitOnUs)
 	{
+		boost::shared_mutex &cacheMutex = getCacheMutex(this);
+
+		// Up-to-date cache is only read, so many threads (e.g. AI evaluating frozen game state) may query it at once
+		{
+			boost::shared_lock<boost::shared_mutex> lock(cacheMutex);
+			if(!isCacheOutdated())
+			{
+				if(!cachingKey.empty())
+				{
+					if(auto cached = cachedRequests.find(cachingKey))
+						return cached;
+				}
+				else
+				{
+					auto ret = make_shared<BonusList>();
+					cachedBonuses.getBonuses(*ret, selector, limit);
+					return ret;
+				}
+			}
+		}
+
 		// Exclusive access for one thread
-		static boost::mutex m;
-		boost::mutex::scoped_lock lock(m);
+		boost::unique_lock<boost::shared_mutex> lock(cacheMutex);
 
-		// If the bonus system tree changes(state of a single node or the relations to each other) then
-		// cache all bonus objects. Selector objects doesn't matter.
-		if (cachedLast != treeChanged)
+		// If this node or any node we inherit bonuses from has changed (state of a single node or the relations
+		// to each other) since the cache was built then cache all bonus objects. Selector objects doesn't matter.
+		if (isCacheOutdated())
 		{
 			cachedBonuses.clear();
 			cachedRequests.clear();
@@ -626,19 +810,19 @@ const TBonusListPtr CBonusSystemNode::getAllBonuses(const CSelector &selector, c
 			getAllBonusesRec(allBonuses);
 			allBonuses.eliminateDuplicates();
 			limitBonuses(allBonuses, cachedBonuses);
+			cachedBonuses.buildColumns();
 
 			cachedLast = treeChanged;
 		}
 
-		// If a bonus system request comes with a caching string then look up in the map if there are any
+		// If a bonus system request comes with a caching key then look up in the cache if there are any
 		// pre-calculated bonus results. Limiters can't be cached so they have to be calculated.
-		if (cachingStr != "")
+		if (!cachingKey.empty())
 		{
-			auto it = cachedRequests.find(cachingStr);
-			if(it != cachedRequests.end())
+			if(auto cached = cachedRequests.find(cachingKey))
 			{
 				//Cached list contains bonuses for our query with applied limiters
-				return it->second;
+				return cached;
 			}
 		}
 
@@ -648,8 +832,8 @@ const TBonusListPtr CBonusSystemNode::getAllBonuses(const CSelector &selector, c
 		cachedBonuses.getBonuses(*ret, selector, limit);
 
 		// Save the results in the cache
-		if(cachingStr != "")
-			cachedRequests[cachingStr] = ret;
+		if(!cachingKey.empty())
+			cachedRequests.insert(cachingKey, ret);
 
 		return ret;
 	}
@@ -698,7 +882,7 @@ const TBonusListPtr CBonusSystemNode::getAllBonusesWithoutCaching(const CSelecto
 	return ret;
 }
 
-CBonusSystemNode::CBonusSystemNode() : bonuses(true), exportedBonuses(true), nodeType(UNKNOWN), cachedLast(0)
+CBonusSystemNode::CBonusSystemNode() : bonuses(this), exportedBonuses(this), nodeType(UNKNOWN), cachedLast(0), nodeChanged(0)
 {
 }
 
@@ -728,7 +912,7 @@ void CBonusSystemNode::attachTo(CBonusSystemNode *parent)
 		newRedDescendant(parent);
 
 	parent->newChildAttached(this);
-	CBonusSystemNode::treeChanged++;
+	nodeHasChanged();
 }
 
 void CBonusSystemNode::detachFrom(CBonusSystemNode *parent)
@@ -742,7 +926,7 @@ void CBonusSystemNode::detachFrom(CBonusSystemNode *parent)
 
 	parents -= parent;
 	parent->childDetached(this);
-	CBonusSystemNode::treeChanged++;
+	nodeHasChanged();
 }
 
 void CBonusSystemNode::popBonuses(const CSelector &s)
@@ -766,7 +950,6 @@ void CBonusSystemNode::addNewBonus(Bonus *b)
 	assert(!vstd::contains(exportedBonuses,b));
 	exportedBonuses.push_back(b);
 	exportBonus(b);
-	CBonusSystemNode::treeChanged++;
 }
 
 void CBonusSystemNode::accumulateBonus(Bonus &b)
@@ -786,7 +969,6 @@ void CBonusSystemNode::removeBonus(Bonus *b)
 	else
 		bonuses -= b;
 	vstd::clear_pointer(b);
-	CBonusSystemNode::treeChanged++;
 }
 
 bool CBonusSystemNode::actsAsBonusSourceOnly() const
@@ -963,8 +1145,6 @@ void CBonusSystemNode::exportBonus(Bonus * b)
 		propagateBonus(b);
 	else
 		bonuses.push_back(b);
-
-	CBonusSystemNode::treeChanged++;
 }
 
 void CBonusSystemNode::exportBonuses()
@@ -1018,11 +1198,6 @@ void CBonusSystemNode::setDescription(const std::string &description)
 	this->description = description;
 }
 
-void CBonusSystemNode::incrementTreeChangedNum()
-{
-	treeChanged++;
-}
-
 void CBonusSystemNode::limitBonuses(const BonusList &allBonuses, BonusList &out) const
 {
 	assert(&allBonuses != &out); //todo should it work in-place?
@@ -1065,9 +1240,24 @@ TBonusListPtr CBonusSystemNode::limitBonuses(const BonusList &allBonuses) const
 	return ret;
 }
 
+void CBonusSystemNode::nodeHasChanged()
+{
+	invalidateSubtree(++treeChanged);
+}
+
+void CBonusSystemNode::invalidateSubtree(int changeNum)
+{
+	if(nodeChanged == changeNum)
+		return; //already reached through another parent
+
+	nodeChanged = changeNum;
+	for(CBonusSystemNode *child : children)
+		child->invalidateSubtree(changeNum);
+}
+
 void CBonusSystemNode::treeHasChanged()
 {
-	treeChanged++;
+	treeInvalidated = ++treeChanged;
 }
 
 int NBonus::valOf(const CBonusSystemNode *obj, Bonus::BonusType type, int subtype /*= -1*/)
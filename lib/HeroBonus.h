@@ -28,42 +28,153 @@ typedef std::set<CBonusSystemNode*> TNodes;
 typedef std::set<const CBonusSystemNode*> TCNodes;
 typedef std::vector<CBonusSystemNode *> TNodesVector;
 
+/// Conjunction of "field == value" tests on bonus fields. Selectors built only from such tests
+/// (see CSelectFieldEqual) are compiled into a few terms and evaluated without indirect calls.
+struct DLL_LINKAGE CSelectorTerm
+{
+	enum EField
+	{
+		TYPE, SUBTYPE, SOURCE, SOURCE_ID, VALUE_TYPE, ADDITIONAL_INFO, EFFECT_RANGE, DURATION, FIELDS_COUNT
+	};
+
+	si32 values[FIELDS_COUNT];
+	si32 masks[FIELDS_COUNT]; //-1 if field is tested, 0 if any value is accepted
+
+	CSelectorTerm() //accepts every bonus
+	{
+		std::fill_n(values, (int)FIELDS_COUNT, 0);
+		std::fill_n(masks, (int)FIELDS_COUNT, 0);
+	}
+	CSelectorTerm(EField field, si32 value)
+	{
+		std::fill_n(values, (int)FIELDS_COUNT, 0);
+		std::fill_n(masks, (int)FIELDS_COUNT, 0);
+		values[field] = value;
+		masks[field] = -1;
+	}
+
+	bool combine(const CSelectorTerm &other) //ANDs other term into this one, returns false if the result can't match anything
+	{
+		for(int i = 0; i < FIELDS_COUNT; i++)
+		{
+			if((values[i] ^ other.values[i]) & masks[i] & other.masks[i])
+				return false;
+			values[i] |= other.values[i] & other.masks[i];
+			masks[i] |= other.masks[i];
+		}
+		return true;
+	}
+
+	bool matches(const si32 *fields) const //fields are ordered by EField
+	{
+		si32 diff = 0;
+		for(int i = 0; i < FIELDS_COUNT; i++)
+			diff |= (fields[i] ^ values[i]) & masks[i];
+		return !diff;
+	}
+
+	inline bool matches(const Bonus *b) const;
+	static inline void getFields(const Bonus *b, si32 *fields);
+};
+
 class CSelector : std::function<bool(const Bonus*)>
 {
 	typedef std::function<bool(const Bonus*)> TBase;
 public:
-	CSelector() {}
+	enum { MAX_TERMS = 4 };
+private:
+	// Compiled form: selector matches if any of terms matches. Used if termsCount >= 0, otherwise
+	// the wrapped function is called.
+	std::array<CSelectorTerm, MAX_TERMS> terms;
+	si8 termsCount;
+
+	bool matchesCompiled(const Bonus *b) const
+	{
+		si32 fields[CSelectorTerm::FIELDS_COUNT];
+		CSelectorTerm::getFields(b, fields);
+		for(int i = 0; i < termsCount; i++)
+			if(terms[i].matches(fields))
+				return true;
+		return false;
+	}
+public:
+	CSelector() : termsCount(-1) {}
 	template<typename T>
 	CSelector(const T &t,	//SFINAE trick -> include this c-tor in overload resolution only if parameter is class 
 							//(includes functors, lambdas) or function. Without that VC is going mad about ambiguities.
 		typename std::enable_if < boost::mpl::or_ < std::is_class<T>, std::is_function<T >> ::value>::type *dummy = nullptr)
-		: TBase(t)
+		: TBase(t), termsCount(-1)
 	{}
 
-	CSelector(std::nullptr_t)
+	CSelector(std::nullptr_t) : termsCount(-1)
 	{}
+	explicit CSelector(const CSelectorTerm &term) : termsCount(1)
+	{
+		terms[0] = term;
+	}
 	//CSelector(std::function<bool(const Bonus*)> f) : std::function<bool(const Bonus*)>(std::move(f)) {}
 
 	CSelector And(CSelector rhs) const
 	{
+		if(isCompiled() && rhs.isCompiled() && termsCount * rhs.termsCount <= MAX_TERMS)
+		{
+			CSelector ret(*this);
+			ret.termsCount = 0;
+			for(int i = 0; i < termsCount; i++)
+			{
+				for(int j = 0; j < rhs.termsCount; j++)
+				{
+					CSelectorTerm term = terms[i];
+					if(term.combine(rhs.terms[j]))
+						ret.terms[ret.termsCount++] = term;
+				}
+			}
+			return ret;
+		}
+
 		//lambda may likely outlive "this" (it can be even a temporary) => we copy the OBJECT (not pointer)
 		auto thisCopy = *this;
 		return [thisCopy, rhs](const Bonus *b) mutable { return thisCopy(b) && rhs(b); };
 	}
 	CSelector Or(CSelector rhs) const
 	{
+		if(isCompiled() && rhs.isCompiled() && termsCount + rhs.termsCount <= MAX_TERMS)
+		{
+			CSelector ret(*this);
+			for(int i = 0; i < rhs.termsCount; i++)
+				ret.terms[ret.termsCount++] = rhs.terms[i];
+			return ret;
+		}
+
 		auto thisCopy = *this;
 		return [thisCopy, rhs](const Bonus *b) mutable { return thisCopy(b) || rhs(b); };
 	}
 
 	bool operator()(const Bonus *b) const
 	{
+		if(termsCount >= 0)
+			return matchesCompiled(b);
 		return TBase::operator()(b);
 	}
 
 	operator bool() const
 	{
-		return !!static_cast<const TBase&>(*this);
+		return termsCount >= 0 || !!static_cast<const TBase&>(*this);
+	}
+
+	bool isCompiled() const
+	{
+		return termsCount >= 0;
+	}
+
+	int getTermsCount() const //only for compiled selectors
+	{
+		return termsCount;
+	}
+
+	const CSelectorTerm &getTerm(int i) const
+	{
+		return terms[i];
 	}
 };
 
@@ -388,6 +499,67 @@ struct DLL_LINKAGE Bonus
 
 DLL_LINKAGE std::ostream & operator<<(std::ostream &out, const Bonus &bonus);
 
+inline void CSelectorTerm::getFields(const Bonus *b, si32 *fields)
+{
+	fields[TYPE] = b->type;
+	fields[SUBTYPE] = b->subtype;
+	fields[SOURCE] = b->source;
+	fields[SOURCE_ID] = b->sid;
+	fields[VALUE_TYPE] = b->valType;
+	fields[ADDITIONAL_INFO] = b->additionalInfo;
+	fields[EFFECT_RANGE] = b->effectRange;
+	fields[DURATION] = b->duration;
+}
+
+inline bool CSelectorTerm::matches(const Bonus *b) const
+{
+	si32 fields[FIELDS_COUNT];
+	getFields(b, fields);
+	return matches(fields);
+}
+
+/// Compact identifier of a cacheable bonus query (used instead of string keys, so cache lookups don't allocate)
+struct DLL_LINKAGE BonusCachingKey
+{
+	enum EQueryKind
+	{
+		NONE, //query is not cached
+		TYPE, //bonuses of given type and (optionally) subtype
+		SOURCE, //bonuses from given source and (optionally) source id
+		MIN_DAMAGE, MAX_DAMAGE, NOT_LIVING, SPELL_EFFECTS //queries of getMinDamage and other helpers
+	};
+
+	ui64 key; //kind in top 8 bits, then type or source, then subtype or source id
+
+	BonusCachingKey() : key(0) {}
+
+	static BonusCachingKey type(Bonus::BonusType type, si32 subtype = -1);
+	static BonusCachingKey source(Bonus::BonusSource source, si32 sourceID = -1);
+	static BonusCachingKey special(EQueryKind kind);
+
+	bool empty() const { return key == 0; }
+	bool operator==(const BonusCachingKey &other) const { return key == other.key; }
+	bool operator!=(const BonusCachingKey &other) const { return key != other.key; }
+
+private:
+	BonusCachingKey(EQueryKind kind, ui32 field, si32 value);
+};
+
+/// Open addressing hash table with results of cached bonus queries
+class DLL_LINKAGE CBonusRequestsCache
+{
+	std::vector<std::pair<BonusCachingKey, TBonusListPtr> > slots; //size is zero or power of 2, empty key marks free slot
+	size_t used;
+
+	size_t slotFor(const BonusCachingKey &key) const; //slot with given key or free slot where it should be placed
+public:
+	CBonusRequestsCache();
+
+	TBonusListPtr find(const BonusCachingKey &key) const; //returns nullptr if query is not cached
+	void insert(const BonusCachingKey &key, const TBonusListPtr &result);
+	void clear(); //keeps allocated slots for reuse
+};
+
 
 class DLL_LINKAGE BonusList
 {
@@ -395,8 +567,15 @@ private:
 	typedef std::vector<Bonus*> TInternalContainer;
 
 	TInternalContainer bonuses;
-	bool belongsToTree;
+	CBonusSystemNode *owner; //node whose tree this list belongs to (nullptr if none) -> its caches get invalidated on change
+
+	// Structure of arrays copy of the fields tested by compiled selectors: column of each CSelectorTerm::EField
+	// (size() values) follows the previous one. Built on demand by lists filtered repeatedly, dropped on change.
+	std::vector<si32> columns;
+	bool columnsValid;
 
+	void changed();
+	void getBonusesByColumns(BonusList &out, const CSelector &filter) const;
 
 public:
 	typedef TInternalContainer::const_reference const_reference;
@@ -405,7 +584,7 @@ public:
 	typedef TInternalContainer::const_iterator const_iterator;
 	typedef TInternalContainer::iterator iterator;
 
-	BonusList(bool BelongsToTree = false);
+	explicit BonusList(CBonusSystemNode *Owner = nullptr);
 	BonusList(const BonusList &bonusList);
 	BonusList& operator=(const BonusList &bonusList);
 
@@ -435,6 +614,7 @@ public:
 	void getModifiersWDescr(TModDescr &out) const;
 
 	void getBonuses(BonusList & out, const CSelector &selector) const;
+	void buildColumns(); //speeds up filtering with compiled selectors until the list is modified
 
 	//special find functions
 	Bonus *getFirst(const CSelector &select);
@@ -458,6 +638,7 @@ public:
 		bonuses.clear();
 		bonuses.resize(newList.size());
 		std::copy(newList.begin(), newList.end(), bonuses.begin());
+		changed();
 	}
 
 	template <class InputIterator>
@@ -466,11 +647,14 @@ public:
 	template <typename Handler> void serialize(Handler &h, const int version)
 	{
 		h & static_cast<std::vector<Bonus*>&>(bonuses);
+		if(!h.saving)
+			columnsValid = false;
 	}
 
 	// C++ for range support
 	auto begin () -> decltype (bonuses.begin())
 	{
+		columnsValid = false;
 		return bonuses.begin();
 	}
 
@@ -562,13 +746,13 @@ public:
 	// * selector is predicate that tests if HeroBonus matches our criteria
 	// * root is node on which call was made (nullptr will be replaced with this)
 	//interface
-	virtual const TBonusListPtr getAllBonuses(const CSelector &selector, const CSelector &limit, const CBonusSystemNode *root = nullptr, const std::string &cachingStr = "") const = 0;
-	void getModifiersWDescr(TModDescr &out, const CSelector &selector, const std::string &cachingStr = "") const;  //out: pairs<modifier value, modifier description>
-	int getBonusesCount(const CSelector &selector, const std::string &cachingStr = "") const;
-	int valOfBonuses(const CSelector &selector, const std::string &cachingStr = "") const;
-	bool hasBonus(const CSelector &selector, const std::string &cachingStr = "") const;
-	const TBonusListPtr getBonuses(const CSelector &selector, const CSelector &limit, const std::string &cachingStr = "") const;
-	const TBonusListPtr getBonuses(const CSelector &selector, const std::string &cachingStr = "") const;
+	virtual const TBonusListPtr getAllBonuses(const CSelector &selector, const CSelector &limit, const CBonusSystemNode *root = nullptr, const BonusCachingKey &cachingKey = BonusCachingKey()) const = 0;
+	void getModifiersWDescr(TModDescr &out, const CSelector &selector, const BonusCachingKey &cachingKey = BonusCachingKey()) const;  //out: pairs<modifier value, modifier description>
+	int getBonusesCount(const CSelector &selector, const BonusCachingKey &cachingKey = BonusCachingKey()) const;
+	int valOfBonuses(const CSelector &selector, const BonusCachingKey &cachingKey = BonusCachingKey()) const;
+	bool hasBonus(const CSelector &selector, const BonusCachingKey &cachingKey = BonusCachingKey()) const;
+	const TBonusListPtr getBonuses(const CSelector &selector, const CSelector &limit, const BonusCachingKey &cachingKey = BonusCachingKey()) const;
+	const TBonusListPtr getBonuses(const CSelector &selector, const BonusCachingKey &cachingKey = BonusCachingKey()) const;
 
 	const TBonusListPtr getAllBonuses() const;
 	const Bonus *getBonus(const CSelector &selector) const; //returns any bonus visible on node that matches (or nullptr if none matches)
@@ -617,19 +801,26 @@ private:
 	ENodeTypes nodeType;
 	std::string description;
 
+	// Bonus queries may be done concurrently from many threads as long as the bonus tree isn't modified meanwhile.
+	// Cache of each node is guarded by one of CACHE_MUTEXES mutexes (see getCacheMutex), readers share it.
+	enum { CACHE_MUTEXES = 64 };
 	static const bool cachingEnabled;
 	mutable BonusList cachedBonuses;
-	mutable int cachedLast;
-	static int treeChanged;
+	mutable int cachedLast; //value of treeChanged when the cache was built
+	int nodeChanged; //value of treeChanged at the last change of this node or of any node we inherit bonuses from
+	static int treeChanged; //change counter, incremented on every modification of the bonus system
+	static int treeInvalidated; //value of treeChanged at the last change that invalidated caches of all nodes
 
-	// Setting a value to cachingStr before getting any bonuses caches the result for later requests.
-	// This string needs to be unique, that's why it has to be setted in the following manner:
-	// [property key]_[value] => only for selector
-	mutable std::map<std::string, TBonusListPtr > cachedRequests;
+	// Passing a cachingKey when getting bonuses caches the result for later requests.
+	// The key has to identify the selector uniquely, see BonusCachingKey.
+	mutable CBonusRequestsCache cachedRequests;
 
 	void getBonusesRec(BonusList &out, const CSelector &selector, const CSelector &limit) const;
 	void getAllBonusesRec(BonusList &out) const;
 	const TBonusListPtr getAllBonusesWithoutCaching(const CSelector &selector, const CSelector &limit, const CBonusSystemNode *root = nullptr) const;
+	void invalidateSubtree(int changeNum); //marks this node and all its descendants as changed
+	bool isCacheOutdated() const;
+	static boost::shared_mutex &getCacheMutex(const CBonusSystemNode *node);
 
 public:
 
@@ -638,7 +829,7 @@ public:
 
 	void limitBonuses(const BonusList &allBonuses, BonusList &out) const; //out will bo populed with bonuses that are not limited here
 	TBonusListPtr limitBonuses(const BonusList &allBonuses) const; //same as above, returns out by val for convienence
-	const TBonusListPtr getAllBonuses(const CSelector &selector, const CSelector &limit, const CBonusSystemNode *root = nullptr, const std::string &cachingStr = "") const;
+	const TBonusListPtr getAllBonuses(const CSelector &selector, const CSelector &limit, const CBonusSystemNode *root = nullptr, const BonusCachingKey &cachingKey = BonusCachingKey()) const;
 	void getParents(TCNodes &out) const;  //retrieves list of parent nodes (nodes to inherit bonuses from),
 	const Bonus *getBonusLocalFirst(const CSelector &selector) const;
 
@@ -678,7 +869,6 @@ public:
 	void exportBonus(Bonus * b);
 	void exportBonuses();
 
-	static void incrementTreeChangedNum();
 	BonusList &getBonusList();
 	const BonusList &getBonusList() const;
 	BonusList &getExportedBonusList();
@@ -689,7 +879,8 @@ public:
 	const std::string &getDescription() const;
 	void setDescription(const std::string &description);
 
-	static void treeHasChanged();
+	void nodeHasChanged(); //invalidates caches of this node and of all nodes that inherit bonuses from it
+	static void treeHasChanged(); //invalidates caches of all nodes
 
 	template <typename Handler> void serialize(Handler &h, const int version)
 	{
@@ -732,6 +923,24 @@ inline Bonus * makeFeature(Bonus::BonusType type, ui8 duration, si16 subtype, si
 	return new Bonus(makeFeatureVal(type, duration, subtype, value, source, turnsRemain, additionalInfo));
 }
 
+//maps bonus field to CSelectorTerm field, returns -1 if field can't be used in compiled selectors
+template<typename T>
+inline int selectorFieldIndex(T Bonus::*ptr) { return -1; }
+inline int selectorFieldIndex(Bonus::BonusType Bonus::*ptr) { return ptr == &Bonus::type ? CSelectorTerm::TYPE : -1; }
+inline int selectorFieldIndex(Bonus::BonusSource Bonus::*ptr) { return ptr == &Bonus::source ? CSelectorTerm::SOURCE : -1; }
+inline int selectorFieldIndex(ui32 Bonus::*ptr) { return ptr == &Bonus::sid ? CSelectorTerm::SOURCE_ID : -1; }
+inline int selectorFieldIndex(Bonus::ValueType Bonus::*ptr) { return ptr == &Bonus::valType ? CSelectorTerm::VALUE_TYPE : -1; }
+inline int selectorFieldIndex(Bonus::LimitEffect Bonus::*ptr) { return ptr == &Bonus::effectRange ? CSelectorTerm::EFFECT_RANGE : -1; }
+inline int selectorFieldIndex(ui16 Bonus::*ptr) { return ptr == &Bonus::duration ? CSelectorTerm::DURATION : -1; }
+inline int selectorFieldIndex(si32 Bonus::*ptr)
+{
+	if(ptr == &Bonus::subtype)
+		return CSelectorTerm::SUBTYPE;
+	if(ptr == &Bonus::additionalInfo)
+		return CSelectorTerm::ADDITIONAL_INFO;
+	return -1;
+}
+
 template<typename T>
 class CSelectFieldEqual
 {
@@ -745,6 +954,10 @@ public:
 	
 	CSelector operator()(const T &valueToCompareAgainst) const
 	{
+		int field = selectorFieldIndex(ptr);
+		if(field >= 0)
+			return CSelector(CSelectorTerm(static_cast<CSelectorTerm::EField>(field), static_cast<si32>(valueToCompareAgainst)));
+
 		auto ptr2 = ptr; //We need a COPY because we don't want to reference this (might be outlived by lambda)
 		return [ptr2, valueToCompareAgainst](const Bonus *bonus) {  return bonus->*ptr2 == valueToCompareAgainst; };
 	}
@@ -763,9 +976,9 @@ public:
 	{
 		return true;
 	}
-	CSelectFieldAny& operator()()
+	CSelector operator()() const
 	{
-		return *this;
+		return CSelector(CSelectorTerm());
 	}
 };
 
@@ -974,9 +1187,7 @@ template <class InputIterator>
 void BonusList::insert(const int position, InputIterator first, InputIterator last)
 {
 	bonuses.insert(bonuses.begin() + position, first, last);
-
-	if (belongsToTree)
-		CBonusSystemNode::incrementTreeChangedNum();
+	changed();
 }
 
 // Extensions for BOOST_FOREACH to enable iterating of BonusList objects
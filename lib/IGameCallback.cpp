@@ -240,6 +240,7 @@ void CPrivilagedInfoCallback::saveCommonState(Saver &out) const
 {
     logGlobal->infoStream() << "Saving lib part of game...";
 	out.putMagicBytes(SAVEGAME_MAGIC);
+	out.reservePointers(4 * (gs->map->objects.size() + gs->map->artInstances.size())); //rough estimate: objects, their armies, artifacts and bonuses
     logGlobal->infoStream() <<"\tSaving header";
 	out << static_cast<CMapHeader&>(*gs->map);
     logGlobal->infoStream() << "\tSaving options";
@@ -253,6 +254,8 @@ void CPrivilagedInfoCallback::saveCommonState(Saver &out) const
 template DLL_LINKAGE void CPrivilagedInfoCallback::loadCommonState<CLoadIntegrityValidator>(CLoadIntegrityValidator&);
 template DLL_LINKAGE void CPrivilagedInfoCallback::loadCommonState<CLoadFile>(CLoadFile&);
 template DLL_LINKAGE void CPrivilagedInfoCallback::saveCommonState<CSaveFile>(CSaveFile&) const;
+template DLL_LINKAGE void CPrivilagedInfoCallback::loadCommonState<CMemoryLoader>(CMemoryLoader&);
+template DLL_LINKAGE void CPrivilagedInfoCallback::saveCommonState<CMemorySaver>(CMemorySaver&) const;
 
 TerrainTile * CNonConstInfoCallback::getTile( int3 pos )
 {
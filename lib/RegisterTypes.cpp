@@ -35,3 +35,5 @@ template void registerTypes<CSaveFile>(CSaveFile & s);
 template void registerTypes<CLoadFile>(CLoadFile & s);
 template void registerTypes<CTypeList>(CTypeList & s);
 template void registerTypes<CLoadIntegrityValidator>(CLoadIntegrityValidator & s);
+template void registerTypes<CMemorySaver>(CMemorySaver & s);
+template void registerTypes<CMemoryLoader>(CMemoryLoader & s);
@@ -0,0 +1,297 @@
+#include "StdInc.h"
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "../lib/CGameInterface.h"
+#include "../lib/CGameState.h"
+#include "../lib/BattleState.h"
+#include "../lib/StartInfo.h"
+#include "../lib/NetPacks.h"
+#include "../lib/CCreatureHandler.h"
+#include "../lib/CConsoleHandler.h"
+#include "../lib/logging/CBasicLogConfigurator.h"
+#include "../lib/CConfigHandler.h"
+#include "../lib/VCMIDirs.h"
+#include "../lib/VCMI_Lib.h"
+#include "../lib/CStopWatch.h"
+#include "../lib/CThreadHelper.h"
+#include "CGameHandler.h"
+#include "CQuery.h"
+
+/*
+ * BattleSimulator.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+/// Headless simulator of AI vs AI battles: duels (see DuelParameters) are run in-process by the game handler,
+/// battle AIs are called directly, without server, client and connections between them.
+/// Battles are spread between worker processes (game handler and lib use global state, so one process runs one battle at a time).
+/// Results are appended to results file, one line per battle: duel file, AIs, seed, winner, result, casualties points.
+
+bool end2 = false;
+boost::program_options::variables_map cmdLineOptions;
+
+/// Battle callback given to simulated AIs, their requests are passed directly to the handler
+class CSimulatedBattleCallback : public CBattleCallback
+{
+	CGameHandler *gh;
+
+protected:
+	int sendRequest(const CPack *request) override
+	{
+		if(auto mca = dynamic_cast<const MakeCustomAction *>(request))
+		{
+			BattleAction ba = mca->ba;
+			gh->makeCustomAction(ba);
+		}
+		else if(auto ma = dynamic_cast<const MakeAction *>(request))
+		{
+			BattleAction ba = ma->ba;
+			gh->makeBattleAction(ba);
+		}
+		else
+			throw std::runtime_error(std::string("Simulated battle can't handle request of type ") + typeid(*request).name());
+		return 0;
+	}
+
+public:
+	CSimulatedBattleCallback(CGameHandler *GH, PlayerColor Player)
+		: CBattleCallback(GH->gameState(), Player), gh(GH)
+	{
+		setBattle(GH->gameState()->curB);
+	}
+};
+
+struct SimulatedBattle
+{
+	std::string duelFile;
+	ui32 seed;
+};
+
+static std::string simulateBattle(const SimulatedBattle &battle, const std::string (&aiNames)[2])
+{
+	StartInfo si;
+	si.mode = StartInfo::DUEL;
+	si.mapname = battle.duelFile;
+	si.seedToBeUsed = battle.seed;
+	for(int i = 0; i < 2; i++)
+	{
+		si.playerInfos[PlayerColor(i)].color = PlayerColor(i);
+		si.playerInfos[PlayerColor(i)].name = aiNames[i];
+	}
+	srand(battle.seed);
+
+	CGameHandler gh;
+	gh.init(&si);
+	const BattleInfo *curB = gh.gameState()->curB;
+	gh.queries.addQuery(make_shared<CBattleQuery>(curB));
+
+	std::map<PlayerColor, shared_ptr<CBattleGameInterface> > ais;
+	for(int i = 0; i < 2; i++)
+	{
+		auto ai = CDynLibHandler::getNewBattleAI(aiNames[i]);
+		ai->init(make_shared<CSimulatedBattleCallback>(&gh, curB->sides[i]));
+		ai->battleStart(curB->belligerents[0], curB->belligerents[1], curB->tile, curB->heroes[0], curB->heroes[1], i);
+		ais[curB->sides[i]] = ai;
+	}
+
+	gh.battleActionSource = [&](const CStack *stack) -> BattleAction
+	{
+		PlayerColor player = stack->owner;
+		if(stack->hasBonusOfType(Bonus::HYPNOTIZED))
+			player = curB->sides[curB->sides[0] == stack->owner];
+		return ais[player]->activeStack(stack);
+	};
+
+	std::string result;
+	gh.duelResultHandler = [&](const BattleResult &br, int casualtiesPoints)
+	{
+		for(auto &ai : ais)
+			ai.second->battleEnd(&br);
+		result = boost::str(boost::format("%s\t%s\t%s\t%d\t%d\t%d\t%d") % battle.duelFile % aiNames[0] % aiNames[1]
+			% battle.seed % (int)br.winner % (int)br.result % casualtiesPoints);
+	};
+
+	if(curB->tacticDistance)
+	{
+		ais[curB->sides[curB->tacticsSide]]->yourTacticPhase(curB->tacticDistance);
+		if(gh.gameState()->curB->tacticDistance)
+		{
+			BattleAction endTactic = BattleAction::makeEndOFTacticPhase(curB->tacticsSide);
+			gh.makeBattleAction(endTactic);
+		}
+	}
+
+	gh.runBattle();
+	return result;
+}
+
+//runs every jobs-th battle starting from given one, results are stored under indices of battles
+static void runBattles(const std::vector<SimulatedBattle> &battles, const std::string (&aiNames)[2], size_t first, size_t jobs, std::map<size_t, std::string> &results)
+{
+	for(size_t i = first; i < battles.size(); i += jobs)
+	{
+		try
+		{
+			results[i] = simulateBattle(battles[i], aiNames);
+		}
+		catch(std::exception &e)
+		{
+			logGlobal->errorStream() << boost::format("Battle %s (seed %d) failed: %s") % battles[i].duelFile % battles[i].seed % e.what();
+		}
+	}
+}
+
+#ifndef _WIN32
+//every worker writes results of its battles to its own file ("index<tab>result" lines), they are merged by the parent
+static void runWorkers(const std::vector<SimulatedBattle> &battles, const std::string (&aiNames)[2], size_t jobs, std::map<size_t, std::string> &results)
+{
+	const std::string workerFile = cmdLineOptions["resultsFile"].as<std::string>() + ".worker";
+	std::vector<pid_t> workers;
+	for(size_t w = 0; w < jobs; w++)
+	{
+		pid_t pid = fork();
+		if(pid == 0)
+		{
+			std::map<size_t, std::string> workerResults;
+			runBattles(battles, aiNames, w, jobs, workerResults);
+			std::ofstream out(workerFile + boost::lexical_cast<std::string>(w));
+			for(auto &result : workerResults)
+				out << result.first << '\t' << result.second << '\n';
+			out.close();
+			_exit(out ? 0 : 1);
+		}
+		else if(pid < 0)
+		{
+			logGlobal->errorStream() << "Cannot start worker process, running its battles here";
+			runBattles(battles, aiNames, w, jobs, results);
+		}
+		else
+			workers.push_back(pid);
+	}
+
+	for(pid_t pid : workers)
+	{
+		int status;
+		waitpid(pid, &status, 0);
+		if(!WIFEXITED(status) || WEXITSTATUS(status))
+			logGlobal->errorStream() << "Worker process " << pid << " failed, results of its battles may be missing";
+	}
+
+	for(size_t w = 0; w < jobs; w++)
+	{
+		const std::string fname = workerFile + boost::lexical_cast<std::string>(w);
+		std::ifstream in(fname);
+		size_t index;
+		std::string result;
+		while(in >> index && in.get() == '\t' && std::getline(in, result))
+			results[index] = result;
+		in.close();
+		boost::filesystem::remove(fname);
+	}
+}
+#endif
+
+static void handleCommandOptions(int argc, char *argv[])
+{
+	namespace po = boost::program_options;
+	po::options_description opts("Allowed options");
+	opts.add_options()
+		("help,h", "display help and exit")
+		("battle,b", po::value<std::vector<std::string> >(), "duel file (in DATA/ directory for .json files) to be simulated, may be given multiple times")
+		("count,n", po::value<int>()->default_value(1), "number of simulations of each duel")
+		("ai1", po::value<std::string>(), "battle AI of the first side (neutral AI from settings by default)")
+		("ai2", po::value<std::string>(), "battle AI of the second side (neutral AI from settings by default)")
+		("seed", po::value<ui32>(), "seed of the first battle, each next battle uses next number (current time by default)")
+		("jobs,j", po::value<int>()->default_value(boost::thread::hardware_concurrency()), "number of worker processes")
+		("aiThreads", po::value<int>()->default_value(1), "number of threads used by battle AI in each process (battles already run in parallel)")
+		("verbose", "keep log levels from settings (only warnings and errors are logged by default)")
+		("resultsFile", po::value<std::string>()->default_value("./results.txt"), "file to which battle results will be appended");
+
+	po::positional_options_description positional;
+	positional.add("battle", -1);
+
+	try
+	{
+		po::store(po::command_line_parser(argc, argv).options(opts).positional(positional).run(), cmdLineOptions);
+	}
+	catch(std::exception &e)
+	{
+		std::cerr << "Failure during parsing command-line options:\n" << e.what() << std::endl;
+	}
+	po::notify(cmdLineOptions);
+
+	if(cmdLineOptions.count("help") || !cmdLineOptions.count("battle"))
+	{
+		std::cout << "Usage: " << argv[0] << " [options] <duel file>...\n" << opts << std::endl;
+		exit(cmdLineOptions.count("help") ? 0 : 1);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	handleCommandOptions(argc, argv);
+
+	console = new CConsoleHandler;
+	CBasicLogConfigurator logConfig(VCMIDirs::get().userCachePath() + "/VCMI_BattleSim_log.txt", console);
+	logConfig.configureDefault();
+
+	preinitDLL(console);
+	settings.init();
+	logConfig.configure();
+	if(!cmdLineOptions.count("verbose"))
+		CLogger::getGlobalLogger()->setLevel(ELogLevel::WARN);
+
+	loadDLLClasses();
+	CThreadPool::get().setMaxThreads(cmdLineOptions["aiThreads"].as<int>()); //pool threads are started on first use, so workers forked later don't lose them
+
+	std::string aiNames[2];
+	aiNames[0] = cmdLineOptions.count("ai1") ? cmdLineOptions["ai1"].as<std::string>() : settings["server"]["neutralAI"].String();
+	aiNames[1] = cmdLineOptions.count("ai2") ? cmdLineOptions["ai2"].as<std::string>() : settings["server"]["neutralAI"].String();
+
+	ui32 seed = cmdLineOptions.count("seed") ? cmdLineOptions["seed"].as<ui32>() : std::time(nullptr);
+	std::vector<SimulatedBattle> battles;
+	for(int i = 0; i < cmdLineOptions["count"].as<int>(); i++)
+	{
+		for(auto &duelFile : cmdLineOptions["battle"].as<std::vector<std::string> >())
+		{
+			SimulatedBattle battle;
+			battle.duelFile = duelFile;
+			battle.seed = seed++;
+			battles.push_back(battle);
+		}
+	}
+
+	size_t jobs = std::max(1, std::min<int>(cmdLineOptions["jobs"].as<int>(), battles.size()));
+	std::cout << boost::format("Simulating %d battles of %s vs %s in %d processes") % battles.size() % aiNames[0] % aiNames[1] % jobs << std::endl;
+
+	CStopWatch sw;
+	std::map<size_t, std::string> results; //[battle index] -> result line
+#ifndef _WIN32
+	if(jobs > 1)
+		runWorkers(battles, aiNames, jobs, results);
+	else
+#endif
+		runBattles(battles, aiNames, 0, 1, results);
+
+	const std::string resultsFile = cmdLineOptions["resultsFile"].as<std::string>();
+	std::ofstream out(resultsFile, std::ios::app);
+	for(auto &result : results)
+		out << result.second << '\n';
+	if(!out)
+		logGlobal->errorStream() << "Cannot write results to " << resultsFile;
+
+	int ms = sw.getDiff();
+	std::cout << boost::format("Finished %d of %d battles in %.1f s (%d battles per minute)")
+		% results.size() % battles.size() % (ms / 1000.0) % (ms ? results.size() * 60000 / ms : results.size()) << std::endl;
+
+	return results.size() == battles.size() ? 0 : 1;
+}
@@ -1,5 +1,7 @@
 #include "StdInc.h"
 
+#include <boost/asio.hpp>
+
 #include "../lib/filesystem/CResourceLoader.h"
 #include "../lib/filesystem/CFileInfo.h"
 #include "../lib/int3.h"
@@ -29,6 +31,7 @@
 #include "../lib/CThreadHelper.h"
 #include "../lib/GameConstants.h"
 #include "../lib/RegisterTypes.h"
+#include "../lib/ScopeGuard.h"
 
 /*
  * CGameHandler.cpp, part of VCMI engine
@@ -45,6 +48,7 @@
 #include <boost/thread/xtime.hpp>
 #endif
 extern bool end2;
+extern std::string NAME;
 #ifdef min
 #undef min
 #endif
@@ -812,35 +816,59 @@ void CGameHandler::applyBattleEffects(BattleAttack &bat, const CStack *att, cons
 		bat.bsa.push_back(bsa2);
 	}
 }
-void CGameHandler::handleConnection(std::set<PlayerColor> players, CConnection &c)
+bool CGameHandler::handleMessage(CConnection &c)
 {
-	setThreadName("CGameHandler::handleConnection");
+	while(c.hasUnreadMessageData())
+	{
+		ReceivedPack received;
+		received.c = &c;
+		received.player = PlayerColor::NEUTRAL;
+		received.requestID = -999;
+		received.pack = nullptr;
+		c >> received.player >> received.requestID >> received.pack; //get the package
+
+		boost::unique_lock<boost::mutex> lock(receivedPacksMx);
+		receivedPacks.push_back(received);
+		receivedPacksCond.notify_one();
+	}
+	return true;
+}
+
+void CGameHandler::applyReceivedPacks()
+{
+	setThreadName("CGameHandler::applyReceivedPacks");
 	srand(time(nullptr));
 
 	try
 	{
-		while(1)//server should never shut connection first //was: while(!end2)
+		while(1)
 		{
-			CPack *pack = nullptr;
-			PlayerColor player = PlayerColor::NEUTRAL;
-			si32 requestID = -999;
-			int packType = 0;
-
+			ReceivedPack received;
 			{
-				boost::unique_lock<boost::mutex> lock(*c.rmx);
-				c >> player >> requestID >> pack; //get the package
-
-				if(!pack)
-				{
-					logGlobal ->errorStream() << boost::format("Received a null package marked as request %d from player %d") % requestID % player;
-				}
+				boost::unique_lock<boost::mutex> lock(receivedPacksMx);
+				while(receivedPacks.empty() && !stopApplyingPacks)
+					receivedPacksCond.wait(lock);
+				if(stopApplyingPacks)
+					break;
 
-				packType = typeList.getTypeID(pack); //get the id of type
+				received = receivedPacks.front();
+				receivedPacks.pop_front();
+			}
 
-                logGlobal->traceStream() << boost::format("Received client message (request %d by player %d) of type with ID=%d (%s).\n")
-					% requestID % player.getNum() % packType % typeid(*pack).name();
+			CConnection &c = *received.c;
+			CPack *pack = received.pack;
+			const PlayerColor player = received.player;
+			const si32 requestID = received.requestID;
+			if(!pack)
+			{
+				logGlobal ->errorStream() << boost::format("Received a null package marked as request %d from player %d") % requestID % player;
 			}
 
+			const int packType = typeList.getTypeID(pack); //get the id of type
+
+            logGlobal->traceStream() << boost::format("Received client message (request %d by player %d) of type with ID=%d (%s).\n")
+				% requestID % player.getNum() % packType % typeid(*pack).name();
+
 			//prepare struct informing that action was applied
 			auto sendPackageResponse = [&](bool succesfullyApplied)
 			{
@@ -849,11 +877,19 @@ void CGameHandler::handleConnection(std::set<PlayerColor> players, CConnection &
 				applied.result = succesfullyApplied;
 				applied.packType = packType;
 				applied.requestID = requestID;
-				boost::unique_lock<boost::mutex> lock(*c.wmx);
-				c << &applied;
+				try
+				{
+					boost::unique_lock<boost::mutex> lock(*c.wmx);
+					c << &applied;
+					c.flush();
+				}
+				catch(std::exception &e)
+				{
+					logGlobal->errorStream() << "Failed to send reply through " << c << ": " << e.what(); //lost connection is handled when its reads fail
+				}
 			};
 
-			CBaseForGHApply *apply = applier->apps[packType]; //and appropriae applier object
+			CBaseForGHApply *apply = applier->getApplier(packType); //and appropriae applier object
 			if(isBlockedByQueries(pack, player))
 			{
 				sendPackageResponse(false);
@@ -877,13 +913,12 @@ void CGameHandler::handleConnection(std::set<PlayerColor> players, CConnection &
 	}
 	catch(boost::system::system_error &e) //for boost errors just log, not crash - probably client shut down connection
 	{
-		assert(!c.connected); //make sure that connection has been marked as broken
         logGlobal->errorStream() << e.what();
 		end2 = true;
 	}
 	HANDLE_EXCEPTION(end2 = true);
 
-    logGlobal->errorStream() << "Ended handling connection";
+    logGlobal->infoStream() << "Ended applying packs";
 }
 
 int CGameHandler::moveStack(int stack, BattleHex dest)
@@ -1014,14 +1049,21 @@ CGameHandler::CGameHandler(void)
 	QID = 1;
 	//gs = nullptr;
 	IObjectInterface::cb = this;
+	battleResult.set(nullptr); //may be left by previous handler (eg. simulated duels)
 	applier = new CApplier<CBaseForGHApply>;
 	registerTypes3(*applier);
 	visitObjectAfterVictory = false;
+	stopApplyingPacks = false;
 	queries.gh = this;
+	acceptor = nullptr;
+	upcomingConnection = nullptr;
+	accepting = false;
 }
 
 CGameHandler::~CGameHandler(void)
 {
+	for(auto &received : receivedPacks) //arrived after game has ended
+		delete received.pack;
 	delete applier;
 	applier = nullptr;
 	delete gs;
@@ -1109,6 +1151,9 @@ void CGameHandler::newTurn()
 		}
 	}
 
+	//new turn packs are sent together; nothing below waits for client reply till the batch is reset (level-up queries are above)
+	auto batch = make_unique<CConnectionsBatch>(conns);
+
 	if (newWeek && !firstTurn)
 	{
 		n.specialWeek = NewTurn::NORMAL;
@@ -1389,6 +1434,7 @@ void CGameHandler::newTurn()
 		}
 	}
 
+	batch.reset();
     logGlobal->traceStream() << "Info about turn " << n.day << "has been sent!";
 	handleTimeEvents();
 	//call objects
@@ -1443,7 +1489,10 @@ void CGameHandler::run(bool resume)
 	{
 		if(!resume)
 		{
+			cc->setCompressionLevel(CConnection::BEST_COMPRESSION); //start info may contain whole campaign
 			(*cc) << gs->initialOpts; // gs->scenarioOps
+			cc->flush();
+			cc->setCompressionLevel(CConnection::FAST_COMPRESSION);
 		}
 
 		std::set<PlayerColor> players;
@@ -1466,15 +1515,22 @@ void CGameHandler::run(bool resume)
 		cc->disableSmartPointerSerialization();
 	}
 
-	for(auto & elem : conns)
+	//from now on data is sent to clients in background, so slow client doesn't delay others
+	//packs from clients are read by the same io_service thread and applied in order of arrival by a single thread
+	CAsyncConnectionsWriter asyncWriter(conns, 16 * 1024 * 1024);
+	boost::thread packsApplier(&CGameHandler::applyReceivedPacks, this);
+	auto stopApplyingPacksGuard = vstd::makeScopeGuard([&]()
 	{
-		std::set<PlayerColor> pom;
-		for(auto j = connections.cbegin(); j!=connections.cend();j++)
-			if(j->second == elem)
-				pom.insert(j->first);
+		{
+			boost::unique_lock<boost::mutex> lock(receivedPacksMx);
+			stopApplyingPacks = true;
+			receivedPacksCond.notify_all();
+		}
+		packsApplier.join();
+	});
 
-		boost::thread(boost::bind(&CGameHandler::handleConnection,this,pom,boost::ref(*elem)));
-	}
+	for(auto & elem : conns)
+		startReading(elem);
 
 	if(gs->scenarioOps->mode == StartInfo::DUEL)
 	{
@@ -1488,10 +1544,17 @@ void CGameHandler::run(bool resume)
 		return;
 	}
 
+	startAcceptingClients();
+	auto stopAcceptingGuard = vstd::makeScopeGuard([&]()
+	{
+		stopAcceptingClients();
+	});
+
 	while (!end2)
 	{
 		if(!resume)
 			newTurn();
+		makeStateCheckpoint(); //joining clients get state from the beginning of the day
 
 		std::map<PlayerColor,PlayerState>::iterator i;
 		if(!resume)
@@ -1523,6 +1586,9 @@ void CGameHandler::run(bool resume)
 				static time_duration p = milliseconds(200);
 				states.cv.timed_wait(lock,p);
 
+				lock.unlock();
+				handleJoiningClients(asyncWriter);
+				lock.lock();
 			}
 		}
 	}
@@ -1530,6 +1596,209 @@ void CGameHandler::run(bool resume)
 		boost::this_thread::sleep(boost::posix_time::milliseconds(5)); //give time client to close socket
 }
 
+void CGameHandler::startReading(CConnection *c)
+{
+	c->startAsyncReads([this, c]{ return handleMessage(*c); }, [this, c](const std::string &error)
+	{
+		connectionLost(c);
+	});
+}
+
+void CGameHandler::connectionLost(CConnection *c)
+{
+	if(!acceptor)
+	{
+		end2 = true; //server should never shut connection first
+		return;
+	}
+
+	boost::unique_lock<boost::mutex> lock(joiningMx);
+	lostConns.push_back(c);
+}
+
+void CGameHandler::startAcceptingClients()
+{
+	if(!acceptor)
+		return;
+
+	boost::unique_lock<boost::mutex> lock(joiningMx);
+	acceptNextClient();
+}
+
+void CGameHandler::acceptNextClient()
+{
+	//acceptor shares io_service with connections accepted by it, so handler is called by thread of CAsyncConnectionsWriter
+	upcomingConnection = new TSocket(acceptor->get_io_service());
+	accepting = true;
+	acceptor->async_accept(*upcomingConnection, [this](const boost::system::error_code &error)
+	{
+		clientAccepted(error);
+	});
+}
+
+void CGameHandler::stopAcceptingClients()
+{
+	if(!acceptor)
+		return;
+
+	boost::unique_lock<boost::mutex> lock(joiningMx);
+	while(accepting) //handler of accepted connection starts next accept before it releases the lock
+	{
+		acceptor->get_io_service().post([this]
+		{
+			boost::system::error_code error;
+			acceptor->cancel(error);
+		});
+		joiningCond.wait(lock);
+	}
+
+	for(TSocket *socket : acceptedSockets) //game has ended before they were handled
+		delete socket;
+	acceptedSockets.clear();
+}
+
+void CGameHandler::clientAccepted(const boost::system::error_code &error)
+{
+	boost::unique_lock<boost::mutex> lock(joiningMx);
+	accepting = false;
+	joiningCond.notify_all();
+	if(error)
+	{
+		if(error != boost::asio::error::operation_aborted)
+			logGlobal->errorStream() << "Failed to accept connection: " << error.message();
+		vstd::clear_pointer(upcomingConnection);
+		return;
+	}
+
+	logGlobal->infoStream() << "Accepted connection during the game";
+	acceptedSockets.push_back(upcomingConnection);
+	upcomingConnection = nullptr;
+	acceptNextClient();
+}
+
+void CGameHandler::handleJoiningClients(CAsyncConnectionsWriter &asyncWriter)
+{
+	std::vector<CConnection *> lost;
+	std::vector<TSocket *> accepted;
+	{
+		boost::unique_lock<boost::mutex> lock(joiningMx);
+		lost.swap(lostConns);
+		accepted.swap(acceptedSockets);
+	}
+
+	for(CConnection *c : lost)
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(stateSyncMx);
+			conns.erase(c);
+		}
+		logGlobal->warnStream() << *c << " has been lost, its players wait for client to join again";
+	}
+	if(conns.empty())
+	{
+		logGlobal->errorStream() << "All connections have been lost, game ends";
+		end2 = true;
+	}
+
+	for(TSocket *socket : accepted)
+	{
+		if(end2)
+		{
+			delete socket;
+			continue;
+		}
+
+		try
+		{
+			acceptJoiningClient(socket, asyncWriter);
+		}
+		catch(std::exception &e)
+		{
+			logGlobal->errorStream() << "Client failed to join the game: " << e.what();
+		}
+	}
+}
+
+void CGameHandler::acceptJoiningClient(TSocket *socket, CAsyncConnectionsWriter &asyncWriter)
+{
+	unique_ptr<TSocket> socketGuard(socket); //owned by connection once it's established
+	auto c = new CConnection(socket, NAME);
+	socketGuard.release();
+
+	std::set<PlayerColor> requested, players; //client may ask for all players waiting for client by empty set
+	*c >> requested;
+	{
+		boost::unique_lock<boost::recursive_mutex> lock(gsm);
+		for(auto & elem : connections)
+		{
+			if(!vstd::contains(conns, elem.second) && (requested.empty() || vstd::contains(requested, elem.first)))
+				players.insert(elem.first);
+		}
+	}
+
+	{
+		boost::unique_lock<boost::mutex> lock(stateSyncMx); //no pack is sent to other clients till this one is up to date
+		if(!stateCheckpoint)
+		{
+			logGlobal->warnStream() << "State can't be restored till the next day";
+			players.clear();
+		}
+
+		*c << players;
+		c->flush();
+		if(players.empty())
+		{
+			logGlobal->warnStream() << *c << " didn't get any player and will be closed";
+			c->close(); //not deleted, it shares io_service with other connections
+			return;
+		}
+
+		c->addStdVecItems(gs);
+		c->enableStackSendingByID();
+		c->disableSmartPointerSerialization();
+		asyncWriter.addConnection(c);
+		sendStateSync(*c);
+		conns.insert(c);
+		{
+			boost::unique_lock<boost::recursive_mutex> gsLock(gsm);
+			for(PlayerColor color : players)
+				connections[color] = c;
+		}
+	}
+
+	//replayed packs don't reach player interfaces, so client is asked again for what the server waits
+	auto resend = [c](CPackForClient *pack)
+	{
+		boost::unique_lock<boost::mutex> lock(*c->wmx);
+		*c << pack;
+		c->flush();
+	};
+	if(vstd::contains(players, gs->currentPlayer) && states.checkFlag(gs->currentPlayer, &PlayerStatus::makingTurn))
+	{
+		YourTurn yt;
+		yt.player = gs->currentPlayer;
+		resend(&yt);
+	}
+	{
+		boost::unique_lock<boost::recursive_mutex> lock(gsm);
+		for(PlayerColor color : players)
+		{
+			QueryPtr query = queries.topQuery(color);
+			if(auto dialog = std::dynamic_pointer_cast<CBlockingDialogQuery>(query))
+				resend(&dialog->bd);
+			else if(auto levelUp = std::dynamic_pointer_cast<CHeroLevelUpDialogQuery>(query))
+				resend(&levelUp->hlu);
+		}
+	}
+
+	std::stringstream sbuffer;
+	sbuffer << *c << " joined the game with players: ";
+	for(PlayerColor color : players)
+		sbuffer << color << " ";
+	logGlobal->infoStream() << sbuffer.str();
+	startReading(c);
+}
+
 void CGameHandler::setupBattle( int3 tile, const CArmedInstance *armies[2], const CGHeroInstance *heroes[2], bool creatureBank, const CGTownInstance *town )
 {
 	battleResult.set(nullptr);
@@ -2008,6 +2277,7 @@ void CGameHandler::sendMessageTo( CConnection &c, const std::string &message )
 	sm.text = message;
 	boost::unique_lock<boost::mutex> lock(*c.wmx);
 	c << &sm;
+	c.flush();
 }
 
 void CGameHandler::giveHeroBonus( GiveBonus * bonus )
@@ -2154,13 +2424,73 @@ void CGameHandler::heroExchange(ObjectInstanceID hero1, ObjectInstanceID hero2)
 void CGameHandler::sendToAllClients( CPackForClient * info )
 {
     logGlobal->traceStream() << "Sending to all clients a package of type " << typeid(*info).name();
+	boost::unique_lock<boost::mutex> syncLock(stateSyncMx);
+	if(conns.empty())
+		return; //eg. battle simulated in-process
+
+	shared_ptr<const std::vector<ui8> > data; //pack encoded once, shared by all connections and state sync log
+	{
+		boost::unique_lock<boost::mutex> lock(packSaverMx);
+		if(!packSaver)
+		{
+			packSaver = make_unique<CMemorySaver>();
+			packSaver->addStdVecItems(gs);
+			packSaver->sendStackInstanceByIds = true;
+			packSaver->smartPointerSerialization = false;
+		}
+
+		if(!vstd::contains_if(conns, [&](const CConnection *c){ return !packSaver->hasSameSettings(*c); }))
+		{
+			packSaver->buffer.clear();
+			*packSaver << info;
+			data = make_shared<const std::vector<ui8> >(std::move(packSaver->buffer));
+		}
+	}
+
+	if(data)
+		packsSinceCheckpoint.push_back(data);
+	else
+		stateCheckpoint.reset(); //pack couldn't be logged, state can't be restored until next checkpoint
+
 	for(auto & elem : conns)
 	{
-		boost::unique_lock<boost::mutex> lock(*(elem)->wmx);
-		*elem << info;
+		try
+		{
+			boost::unique_lock<boost::mutex> lock(*(elem)->wmx);
+			if(data)
+				elem->sendRawData(data);
+			else
+			{
+				*elem << info; //connection with its own serialization state (eg. smart pointers) - encode separately
+				elem->flush();
+			}
+		}
+		catch(std::exception &e)
+		{
+			logGlobal->errorStream() << "Failed to send pack through " << *elem << ": " << e.what(); //lost connection is handled when its reads fail
+		}
 	}
 }
 
+void CGameHandler::makeStateCheckpoint()
+{
+	CMemorySaver saver; //default settings are the same as for save files
+	saveCommonState(saver);
+
+	boost::unique_lock<boost::mutex> lock(stateSyncMx);
+	stateCheckpoint = make_shared<const std::vector<ui8> >(std::move(saver.buffer));
+	packsSinceCheckpoint.clear();
+}
+
+void CGameHandler::sendStateSync(CConnection &c)
+{
+	boost::unique_lock<boost::mutex> lock(*c.wmx);
+	c << *stateCheckpoint << ui32(packsSinceCheckpoint.size());
+	c.flush();
+	for(auto & pack : packsSinceCheckpoint)
+		c.sendRawData(pack);
+}
+
 void CGameHandler::sendAndApply(CPackForClient * info)
 {
 	sendToAllClients(info);
@@ -2229,8 +2559,9 @@ void CGameHandler::save(const std::string & filename )
 			saveCommonState(save);
             logGlobal->infoStream() << "Saving server state";
 			save << *this;
+			save.closeInBackground(); //game goes on while data is compressed and written
 		}
-        logGlobal->infoStream() << "Game has been successfully saved!";
+        logGlobal->infoStream() << "Game state has been serialized!";
 	}
 	catch(std::exception &e)
 	{
@@ -3242,7 +3573,7 @@ static EndAction end_action;
 
 bool CGameHandler::makeBattleAction( BattleAction &ba )
 {
-    logGlobal->errorStream() << "\tMaking action of type " << ba.actionType;
+    logGlobal->traceStream() << "\tMaking action of type " << ba.actionType;
 	bool ok = true;
 
 
@@ -5968,12 +6299,21 @@ void CGameHandler::runBattle()
                         logGlobal->traceStream() << "Activating " << next->nodeName();
 						BattleSetActiveStack sas;
 						sas.stack = next->ID;
+						battleMadeAction.setn(false); //before activating, client may answer before we start waiting
 						sendAndApply(&sas);
-						boost::unique_lock<boost::mutex> lock(battleMadeAction.mx);
-						battleMadeAction.data = false;
-						while (next->alive() &&
-							(!battleMadeAction.data  &&  !battleResult.get())) //active stack hasn't made its action and battle is still going
-							battleMadeAction.cond.wait(lock);
+						if(battleActionSource)
+						{
+							BattleAction ba = battleActionSource(next);
+							if(!makeBattleAction(ba))
+								makeStackDoNothing(next);
+						}
+						else
+						{
+							boost::unique_lock<boost::mutex> lock(battleMadeAction.mx);
+							while (next->alive() &&
+								(!battleMadeAction.data  &&  !battleResult.get())) //active stack hasn't made its action and battle is still going
+								battleMadeAction.cond.wait(lock);
+						}
 					}
 				}
 
@@ -6213,24 +6553,31 @@ void CGameHandler::duelFinished()
 	}
 	logGlobal->debugStream() << boost::format("Total casualties points: %d") % casualtiesPoints;
 
-
-	time_t timeNow;
-	time(&timeNow);
-
-	std::ofstream out(cmdLineOptions["resultsFile"].as<std::string>(), std::ios::app);
-	if(out)
+	if(duelResultHandler)
 	{
-		out << boost::format("%s\t%s\t%s\t%d\t%d\t%d\t%s\n") % si->mapname % getName(0) % getName(1)
-			% battleResult.data->winner % battleResult.data->result % casualtiesPoints 
-			% asctime(localtime(&timeNow));
+		duelResultHandler(*battleResult.data, casualtiesPoints);
 	}
 	else
 	{
-		logGlobal->errorStream() << "Cannot open to write " << cmdLineOptions["resultsFile"].as<std::string>();
-	}
+		time_t timeNow;
+		time(&timeNow);
+
+		std::ofstream out(cmdLineOptions["resultsFile"].as<std::string>(), std::ios::app);
+		if(out)
+		{
+			out << boost::format("%s\t%s\t%s\t%d\t%d\t%d\t%s\n") % si->mapname % getName(0) % getName(1)
+				% battleResult.data->winner % battleResult.data->result % casualtiesPoints 
+				% asctime(localtime(&timeNow));
+		}
+		else
+		{
+			logGlobal->errorStream() << "Cannot open to write " << cmdLineOptions["resultsFile"].as<std::string>();
+		}
 
-	CSaveFile resultFile("result.vdrst");
-	resultFile << *battleResult.data;
+		CSaveFile resultFile("result.vdrst");
+		resultFile << *battleResult.data;
+		resultFile.close();
+	}
 
 	BattleResultsApplied resultsApplied;
 	resultsApplied.player1 = finishingBattle->victor;
@@ -93,6 +93,38 @@ public:
 	std::map<PlayerColor, CConnection*> connections; //player color -> connection to client with interface of that player
 	PlayerStatuses states; //player color -> player state
 	std::set<CConnection*> conns;
+	unique_ptr<CMemorySaver> packSaver; //encodes packs sent to all clients, created on first use
+	boost::mutex packSaverMx;
+
+	//state sync for clients joining running game: game state from the beginning of current day and packs sent to all clients since then
+	shared_ptr<const std::vector<ui8> > stateCheckpoint; //common state in the format of saves, nullptr if state can't be restored
+	std::vector<shared_ptr<const std::vector<ui8> > > packsSinceCheckpoint;
+	boost::mutex stateSyncMx; //protects also conns while game runs, so joining client gets every pack exactly once
+
+	//clients joining again after their connection has been lost, handled by run() between waits
+	TAcceptor *acceptor; //if set, lost connection doesn't end the game and its players wait for client to join again
+	TSocket *upcomingConnection;
+	bool accepting; //accept operation is pending
+	std::vector<TSocket *> acceptedSockets;
+	std::vector<CConnection *> lostConns; //not deleted, server connections share io_service of acceptor
+	boost::mutex joiningMx; //protects the variables above
+	boost::condition_variable joiningCond;
+
+	struct ReceivedPack
+	{
+		CConnection *c;
+		PlayerColor player;
+		si32 requestID;
+		CPack *pack;
+	};
+	std::deque<ReceivedPack> receivedPacks; //read from connections, waiting for applying
+	bool stopApplyingPacks;
+	boost::mutex receivedPacksMx;
+	boost::condition_variable receivedPacksCond;
+
+	//in-process battle simulation (no clients)
+	std::function<BattleAction(const CStack *)> battleActionSource; //if set, actions of activated stacks are taken from it instead of waiting for clients
+	std::function<void(const BattleResult &, int)> duelResultHandler; //if set, receives result and casualties points of finished duel instead of results files
 
 	//queries stuff
 	boost::recursive_mutex gsm;
@@ -200,7 +232,16 @@ public:
 	void commitPackage(CPackForClient *pack) override;
 
 	void init(StartInfo *si);
-	void handleConnection(std::set<PlayerColor> players, CConnection &c);
+	bool handleMessage(CConnection &c); //queues packs received from client, called by io_service thread
+	void applyReceivedPacks(); //applies queued packs in order of arrival, run by separate thread while game runs
+	void startReading(CConnection *c); //packs from c are read in background and queued for applyReceivedPacks
+	void connectionLost(CConnection *c); //called by io_service thread
+	void startAcceptingClients();
+	void stopAcceptingClients(); //waits till pending accept operation is cancelled
+	void acceptNextClient(); //joiningMx has to be locked
+	void clientAccepted(const boost::system::error_code &error);
+	void handleJoiningClients(CAsyncConnectionsWriter &asyncWriter); //removes lost connections, syncs state of accepted clients
+	void acceptJoiningClient(TSocket *socket, CAsyncConnectionsWriter &asyncWriter);
 	PlayerColor getPlayerAt(CConnection *c) const;
 
 	void playerMessage( PlayerColor player, const std::string &message);
@@ -254,6 +295,8 @@ public:
 	void sendMessageToAll(const std::string &message);
 	void sendMessageTo(CConnection &c, const std::string &message);
 	void sendToAllClients(CPackForClient * info);
+	void makeStateCheckpoint();
+	void sendStateSync(CConnection &c); //sends checkpoint and packs since it, client loads the state and applies packs in order; stateSyncMx has to be locked
 	void sendAndApply(CPackForClient * info);
 	void applyAndSend(CPackForClient * info);
 	void sendAndApply(CGarrisonOperationPack * info);
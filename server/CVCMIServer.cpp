@@ -4,7 +4,6 @@
 
 #include "../lib/filesystem/CResourceLoader.h"
 #include "../lib/mapping/CCampaignHandler.h"
-#include "../lib/CThreadHelper.h"
 #include "../lib/Connection.h"
 #include "../lib/CModHandler.h"
 #include "../lib/CArtHandler.h"
@@ -30,8 +29,6 @@
 #include "../lib/CConfigHandler.h"
 #include "../lib/ScopeGuard.h"
 
-#include "../lib/UnlockGuard.h"
-
 std::string NAME_AFFIX = "server";
 std::string NAME = GameConstants::VCMI_VERSION + std::string(" (") + NAME_AFFIX + ')'; //application name
 using namespace boost;
@@ -53,63 +50,51 @@ boost::program_options::variables_map cmdLineOptions;
  *
  */
 
-static void vaccept(tcp::acceptor *ac, tcp::socket *s, boost::system::error_code *error)
-{
-	ac->accept(*s,*error);
-}
-
-
-
 CPregameServer::CPregameServer(CConnection *Host, TAcceptor *Acceptor /*= nullptr*/)
-	: host(Host), listeningThreads(0), acceptor(Acceptor), upcomingConnection(nullptr),
+	: host(Host), readingConnections(0), acceptor(Acceptor), upcomingConnection(nullptr),
 	  curmap(nullptr), curStartInfo(nullptr), state(RUNNING)
 {
 	initConnection(host);
 }
 
-void CPregameServer::handleConnection(CConnection *cpc)
+bool CPregameServer::handleMessage(CConnection *cpc)
 {
-	setThreadName("CPregameServer::handleConnection");
-	try
+	boost::unique_lock<boost::recursive_mutex> queueLock(mx);
+	bool startingGame = false;
+	while(cpc->hasUnreadMessageData())
 	{
-		while(!cpc->receivedStop)
-		{
-			CPackForSelectionScreen *cpfs = nullptr;
-			*cpc >> cpfs;
+		CPackForSelectionScreen *cpfs = nullptr;
+		*cpc >> cpfs;
 
-            logNetwork->infoStream() << "Got package to announce " << typeid(*cpfs).name() << " from " << *cpc;
+        logNetwork->infoStream() << "Got package to announce " << typeid(*cpfs).name() << " from " << *cpc;
 
-			boost::unique_lock<boost::recursive_mutex> queueLock(mx);
-			bool quitting = dynamic_cast<QuitMenuWithoutStarting*>(cpfs), 
-				startingGame = dynamic_cast<StartWithCurrentSettings*>(cpfs);
-			if(quitting || startingGame) //host leaves main menu or wants to start game -> we end
-			{
-				cpc->receivedStop = true;
-				if(!cpc->sendStop)
-					sendPack(cpc, *cpfs);
+		bool quitting = dynamic_cast<QuitMenuWithoutStarting*>(cpfs);
+		startingGame = dynamic_cast<StartWithCurrentSettings*>(cpfs);
+		if(quitting || startingGame) //host leaves main menu or wants to start game -> we end
+		{
+			cpc->receivedStop = true;
+			if(!cpc->sendStop)
+				sendPack(cpc, *cpfs);
 
-				if(cpc == host)
-					toAnnounce.push_back(cpfs);
-			}
-			else
+			if(cpc == host)
 				toAnnounce.push_back(cpfs);
-
-			if(startingGame)
-			{
-				//wait for sending thread to announce start
-				auto unlock = vstd::makeUnlockGuard(mx);
-				while(state == RUNNING) boost::this_thread::sleep(boost::posix_time::milliseconds(50));
-			}
+			break; //following data is read by game handler or main server loop
 		}
-	} 
-	catch (const std::exception& e)
-	{
-		boost::unique_lock<boost::recursive_mutex> queueLock(mx);
-        logNetwork->errorStream() << *cpc << " dies... \nWhat happened: " << e.what();
+		else
+			toAnnounce.push_back(cpfs);
 	}
 
+	if(!cpc->receivedStop)
+		return true;
+
+	connectionFinished(cpc, startingGame);
+	return false;
+}
+
+void CPregameServer::connectionFinished(CConnection *cpc, bool startingGame)
+{
 	boost::unique_lock<boost::recursive_mutex> queueLock(mx);
-	if(state != ENDING_AND_STARTING_GAME)
+	if(state != ENDING_AND_STARTING_GAME && !startingGame) //host starting game is not leaving, start is announced later
 	{
 		connections -= cpc;
 
@@ -127,14 +112,13 @@ void CPregameServer::handleConnection(CConnection *cpc)
 		}
 	}
 
-    logNetwork->infoStream() << "Thread listening for " << *cpc << " ended";
-	listeningThreads--;
-	vstd::clear_pointer(cpc->handler);
+    logNetwork->infoStream() << "Stopped reading packs from " << *cpc;
+	readingConnections--;
 }
 
 void CPregameServer::run()
 {
-	startListeningThread(host);
+	startReading(host);
 	start_async_accept();
 
 	while(state == RUNNING)
@@ -159,11 +143,7 @@ void CPregameServer::run()
 				acceptor->close();
 			}
 
-			if(acceptor)
-			{
-				acceptor->get_io_service().reset();
-				acceptor->get_io_service().poll();
-			}
+			pollConnections(); //accepts new connections and handles received packs
 		} //frees lock
 
 		boost::this_thread::sleep(boost::posix_time::milliseconds(50));
@@ -173,12 +153,26 @@ void CPregameServer::run()
 
 	if(state == ENDING_AND_STARTING_GAME)
 	{
-        logNetwork->infoStream() << "Waiting for listening thread to finish...";
-		while(listeningThreads) boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+        logNetwork->infoStream() << "Waiting for clients to confirm start...";
+		while(readingConnections)
+		{
+			pollConnections();
+			boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+		}
         logNetwork->infoStream() << "Preparing new game";
 	}
 }
 
+void CPregameServer::pollConnections()
+{
+	boost::unique_lock<boost::recursive_mutex> myLock(mx);
+	if(acceptor) //all connections use io_service of acceptor
+	{
+		acceptor->get_io_service().reset();
+		acceptor->get_io_service().poll();
+	}
+}
+
 CPregameServer::~CPregameServer()
 {
 	delete acceptor;
@@ -205,9 +199,10 @@ void CPregameServer::connectionAccepted(const boost::system::error_code& ec)
 	initConnection(pc);
 	upcomingConnection = nullptr;
 
-	startListeningThread(pc);
+	startReading(pc);
 
 	*pc << (ui8)pc->connectionID << curmap;
+	pc->flush();
 
 	announceTxt(pc->name + " joins the game");
 	auto pj = new PlayerJoined();
@@ -250,6 +245,7 @@ void CPregameServer::sendPack(CConnection * pc, const CPackForSelectionScreen &
 	{
         logNetwork->infoStream() << "\tSending pack of type " << typeid(pack).name() << " to " << *pc;
 		*pc << &pack;
+		pc->flush();
 	}
 
 	if(dynamic_cast<const QuitMenuWithoutStarting*>(&pack))
@@ -300,11 +296,15 @@ void CPregameServer::initConnection(CConnection *c)
     logNetwork->infoStream() << "Pregame connection with player " << c->name << " established!";
 }
 
-void CPregameServer::startListeningThread(CConnection * pc)
-{	
-	listeningThreads++;
+void CPregameServer::startReading(CConnection * pc)
+{
+	readingConnections++;
 	pc->enterPregameConnectionMode();
-	pc->handler = new boost::thread(&CPregameServer::handleConnection, this, pc);
+	//handlers are called by io_service polled in run(), so packs are read by the same thread that processes them
+	pc->startAsyncReads([this, pc]{ return handleMessage(pc); }, [this, pc](const std::string &error)
+	{
+		connectionFinished(pc, false);
+	});
 }
 
 CVCMIServer::CVCMIServer()
@@ -333,11 +333,13 @@ CGameHandler * CVCMIServer::initGhFromHostingConnection(CConnection &c)
 		if(!mapFound && si.mode == StartInfo::NEW_GAME)
 		{
 			c << ui8(1); //WRONG!
+			c.flush();
 			return nullptr;
 		}
 	}
 
 	c << ui8(0); //OK!
+	c.flush();
 
 	gh->init(&si);
 	gh->conns.insert(&c);
@@ -359,6 +361,7 @@ void CVCMIServer::newGame()
 		vstd::clear_pointer(gh);
 	});
 
+	gh->acceptor = acceptor;
 	gh->run(false);
 }
 
@@ -381,6 +384,13 @@ void CVCMIServer::newPregame()
 		for(CConnection *c : gh.conns)
 			c->addStdVecItems(gh.gs);
 
+		//pregame stopped listening, clients that lose connection can join again during the game
+		acceptor->open(tcp::v4());
+		acceptor->set_option(tcp::acceptor::reuse_address(true));
+		acceptor->bind(tcp::endpoint(tcp::v4(), port));
+		acceptor->listen();
+		gh.acceptor = acceptor;
+
 		gh.run(false);
 	}
 }
@@ -407,11 +417,10 @@ void CVCMIServer::start()
 	boost::system::error_code error;
     logNetwork->infoStream()<<"Listening for connections at port " << acceptor->local_endpoint().port();
 	auto  s = new tcp::socket(acceptor->get_io_service());
-	boost::thread acc(boost::bind(vaccept,acceptor,s,&error));
-	sr->setToTrueAndNotify();
+	sr->setToTrueAndNotify(); //acceptor already listens, connection made before accept() waits in backlog
 	delete mr;
 
-	acc.join();
+	acceptor->accept(*s, error);
 	if (error)
 	{
         logNetwork->warnStream()<<"Got connection but there is an error " << error;
@@ -481,6 +490,7 @@ void CVCMIServer::loadGame()
 	}
 
 	c << ui8(0);
+	c.flush();
 
 	CConnection* cc; //tcp::socket * ss;
 	for(int i=0; i<clients; i++)
@@ -505,6 +515,7 @@ void CVCMIServer::loadGame()
 		gh.conns.insert(cc);
 	}
 
+	gh.acceptor = acceptor;
 	gh.run(true);
 }
 
@@ -575,6 +586,7 @@ int main(int argc, char** argv)
 		//and return non-zero status so client can detect error
 		throw;
 	}
+	CSaveFile::waitForBackgroundSaves();
 	//delete VLC; //can't be re-enabled due to access to already freed memory in bonus system
 	CResourceHandler::clear();
 
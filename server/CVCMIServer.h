@@ -63,7 +63,7 @@ class CPregameServer
 {
 public:
 	CConnection *host;
-	int listeningThreads;
+	int readingConnections; //connections which may still send pregame packs
 	std::set<CConnection *> connections;
 	std::list<CPackForSelectionScreen*> toAnnounce;
 	boost::recursive_mutex mx;
@@ -81,7 +81,9 @@ public:
 	void run();
 
 	void processPack(CPackForSelectionScreen * pack);
-	void handleConnection(CConnection *cpc);
+	bool handleMessage(CConnection *cpc); //returns false when connection won't send more pregame packs
+	void connectionFinished(CConnection *cpc, bool startingGame); //connection stopped sending pregame packs or has been lost
+	void pollConnections();
 	void connectionAccepted(const boost::system::error_code& ec);
 	void initConnection(CConnection *c);
 
@@ -94,7 +96,7 @@ public:
 	void announcePack(const CPackForSelectionScreen &pack);
 
 	void sendPack(CConnection * pc, const CPackForSelectionScreen & pack);
-	void startListeningThread(CConnection * pc);
+	void startReading(CConnection * pc);
 };
 
 extern boost::program_options::variables_map cmdLineOptions;
\ No newline at end of file
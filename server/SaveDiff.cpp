@@ -0,0 +1,334 @@
+#include "StdInc.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
+
+#include "../lib/Connection.h"
+#include "../lib/RegisterTypes.h"
+#include "../lib/CThreadHelper.h"
+#include "../lib/CConsoleHandler.h"
+#include "../lib/logging/CBasicLogConfigurator.h"
+#include "../lib/CConfigHandler.h"
+#include "../lib/VCMIDirs.h"
+#include "../lib/VCMI_Lib.h"
+#include "../lib/mapping/CMapInfo.h"
+#include "../lib/mapping/CMap.h"
+#include "../lib/mapping/CCampaignHandler.h"
+#include "../lib/StartInfo.h"
+#include "../lib/BattleState.h"
+#include "../lib/CGameState.h"
+#include "../lib/CModHandler.h"
+#include "../lib/CObjectHandler.h"
+#include "../lib/CCreatureHandler.h"
+#include "../lib/CArtHandler.h"
+#include "../lib/CHeroHandler.h"
+#include "../lib/CSpellHandler.h"
+#include "../lib/CTownHandler.h"
+#include "../lib/CDefObjInfoHandler.h"
+#include "../lib/CBonusTypeHandler.h"
+#include "../lib/CBuildingHandler.h"
+#include "../lib/NetPacks.h"
+
+/*
+ * SaveDiff.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+/// Standalone tool comparing two saves (eg. made by desynchronized client and server).
+/// Usage: vcmisavediff <first save> <second save>
+/// Returns 0 if saves are identical, 1 if they differ, 2 on error.
+
+namespace bip = boost::interprocess;
+
+static const size_t COMPARED_SEGMENT_SIZE = 1024 * 1024;
+
+static std::string getTypeName(const std::type_info *type)
+{
+#ifdef __GNUC__
+	int status;
+	if(char *name = abi::__cxa_demangle(type->name(), nullptr, nullptr, &status))
+	{
+		std::string ret = name;
+		free(name);
+		return ret;
+	}
+#endif
+	return type->name();
+}
+
+/// Save file mapped into memory with its content unpacked
+class CSaveData
+{
+public:
+	std::string fName;
+	ui32 fileVersion;
+	bool reverseEndianess;
+	std::vector<ui8> data; //everything after format version, unpacked
+
+	CSaveData(const std::string &fname, int threads); //throws!
+
+private:
+	struct Block
+	{
+		size_t source, target; //offsets of stored data in file and of its content in data
+		ui32 dataSize, rawSize;
+	};
+};
+
+CSaveData::CSaveData(const std::string &fname, int threads)
+	: fName(fname), reverseEndianess(false)
+{
+	bip::file_mapping mapping(fname.c_str(), bip::read_only);
+	bip::mapped_region region(mapping, bip::read_only);
+	auto file = static_cast<const ui8 *>(region.get_address());
+	size_t fileSize = region.get_size();
+
+	if(fileSize < 8 || std::memcmp(file, "VCMI", 4))
+		THROW_FORMAT("Error: not a VCMI file(%s)!", fname);
+
+	std::memcpy(&fileVersion, file + 4, sizeof(fileVersion));
+	if(fileVersion > version)
+	{
+		auto versionptr = (ui8*)&fileVersion;
+		std::reverse(versionptr, versionptr + 4);
+		if(fileVersion != version)
+			THROW_FORMAT("Error: too new file format (%s)!", fname);
+		reverseEndianess = true;
+	}
+
+	if(fileVersion < compressedSaveVersion)
+	{
+		data.assign(file + 8, file + fileSize);
+		return;
+	}
+
+	//headers have to be scanned one by one, but blocks can be unpacked in parallel
+	std::vector<Block> blocks;
+	size_t rawSize = 0;
+	for(size_t pos = 8; pos < fileSize;)
+	{
+		if(pos + CCompressedBlock::HEADER_SIZE > fileSize)
+			THROW_FORMAT("Error: truncated file (%s)!", fname);
+
+		Block block;
+		CCompressedBlock::parseHeader(file + pos, block.dataSize, block.rawSize);
+		block.source = pos + CCompressedBlock::HEADER_SIZE;
+		block.target = rawSize;
+		pos = block.source + block.dataSize;
+		if(pos > fileSize)
+			THROW_FORMAT("Error: truncated file (%s)!", fname);
+
+		rawSize += block.rawSize ? block.rawSize : block.dataSize;
+		blocks.push_back(block);
+	}
+
+	data.resize(rawSize);
+	std::string error;
+	boost::mutex errorMx;
+	std::vector<Task> tasks;
+	for(auto &block : blocks)
+	{
+		tasks.push_back([&, block]
+		{
+			try
+			{
+				CCompressedBlock::unpack(file + block.source, block.dataSize, block.rawSize, data.data() + block.target);
+			}
+			catch(std::exception &e)
+			{
+				boost::unique_lock<boost::mutex> lock(errorMx);
+				error = e.what();
+			}
+		});
+	}
+	CThreadHelper th(&tasks, threads);
+	th.run();
+
+	if(!error.empty())
+		THROW_FORMAT("Error: %s (%s)!", error % fname);
+}
+
+/// Thrown by CSaveInspector when it reaches the diverging byte
+struct DivergenceReached {};
+
+/// Loads lib part of game from unpacked save, tracking the chain of loaded objects
+/// and remembering it when the given offset is reached.
+class CSaveInspector : public CISer<CSaveInspector>
+{
+	const std::vector<ui8> &data;
+	size_t pos, divergence;
+	std::vector<std::string> path;
+
+public:
+	std::vector<std::string> divergencePath;
+
+	CSaveInspector(const CSaveData &save, size_t Divergence);
+
+	int read(const void * data, unsigned size); //throws!
+	void checkMagicBytes(const std::string &text);
+	void enterSection(const std::string &name);
+
+	template <typename T>
+	void loadPointerHlp(ui16 tid, T & data, ui32 pid)
+	{
+		typedef typename boost::remove_const<typename boost::remove_pointer<T>::type>::type TObjectType;
+		const std::type_info *type = tid ? typeList.getTypeInfo(tid) : &typeid(TObjectType);
+		std::string name = type ? getTypeName(type) : "unknown type " + boost::lexical_cast<std::string>(tid);
+		if(pid != 0xffffffff)
+			name += " #" + boost::lexical_cast<std::string>(pid);
+
+		path.push_back(name);
+		CISer<CSaveInspector>::loadPointerHlp(tid, data, pid);
+		path.pop_back();
+	}
+};
+
+CSaveInspector::CSaveInspector(const CSaveData &save, size_t Divergence)
+	: data(save.data), pos(0), divergence(Divergence)
+{
+	registerTypes(*this);
+	fileVersion = save.fileVersion;
+	reverseEndianess = save.reverseEndianess;
+}
+
+int CSaveInspector::read(const void * out, unsigned size)
+{
+	if(divergence < pos + size)
+	{
+		divergencePath = path;
+		throw DivergenceReached();
+	}
+	if(pos + size > data.size())
+		throw std::runtime_error("Unexpected end of save");
+
+	std::copy(data.begin() + pos, data.begin() + pos + size, (ui8*)out);
+	pos += size;
+	return size;
+}
+
+void CSaveInspector::checkMagicBytes(const std::string &text)
+{
+	std::string loaded = text;
+	read((void*)loaded.data(), text.length());
+	if(loaded != text)
+		throw std::runtime_error("Magic bytes doesn't match!");
+}
+
+void CSaveInspector::enterSection(const std::string &name)
+{
+	path.assign(1, name);
+}
+
+static size_t findDivergence(const std::vector<ui8> &first, const std::vector<ui8> &second, int threads)
+{
+	size_t common = std::min(first.size(), second.size());
+	size_t segments = (common + COMPARED_SEGMENT_SIZE - 1) / COMPARED_SEGMENT_SIZE;
+	std::vector<size_t> results(segments, common); //[segment] -> first diverging offset in it
+
+	std::vector<Task> tasks;
+	for(size_t i = 0; i < segments; i++)
+	{
+		tasks.push_back([&, i]
+		{
+			size_t begin = i * COMPARED_SEGMENT_SIZE, end = std::min(begin + COMPARED_SEGMENT_SIZE, common);
+			auto mismatch = std::mismatch(first.begin() + begin, first.begin() + end, second.begin() + begin);
+			if(mismatch.first != first.begin() + end)
+				results[i] = mismatch.first - first.begin();
+		});
+	}
+	CThreadHelper th(&tasks, threads);
+	th.run();
+
+	for(size_t result : results)
+		if(result != common)
+			return result;
+	return common; //one save is prefix of other (or they are identical)
+}
+
+static void describeDivergence(const CSaveData &save, size_t divergence)
+{
+	CSaveInspector in(save, divergence);
+	try
+	{
+		in.enterSection("header");
+		in.checkMagicBytes(SAVEGAME_MAGIC);
+		CMapHeader dum;
+		in >> dum;
+
+		in.enterSection("options");
+		StartInfo *si;
+		in >> si;
+
+		in.enterSection("handlers");
+		in >> *VLC;
+
+		in.enterSection("gamestate");
+		CGameState *gs;
+		in >> gs;
+
+		std::cout << "Saves diverge after lib part of game (in server or client data)" << std::endl;
+	}
+	catch(DivergenceReached &)
+	{
+		std::cout << "Diverging object:" << std::endl;
+		for(size_t i = 0; i < in.divergencePath.size(); i++)
+			std::cout << std::string(2 * (i + 1), ' ') << in.divergencePath[i] << std::endl;
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Cannot find diverging object: " << e.what() << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 3)
+	{
+		std::cerr << "Usage: " << argv[0] << " <first save> <second save>" << std::endl;
+		return 2;
+	}
+
+	console = new CConsoleHandler;
+	CBasicLogConfigurator logConfig(VCMIDirs::get().userCachePath() + "/VCMI_SaveDiff_log.txt", console);
+	logConfig.configureDefault();
+
+	preinitDLL(console);
+	settings.init();
+	logConfig.configure();
+
+	int threads = std::max(1u, boost::thread::hardware_concurrency());
+	try
+	{
+		CSaveData first(argv[1], threads), second(argv[2], threads);
+		if(first.fileVersion != second.fileVersion)
+		{
+			std::cout << boost::format("Saves have different format versions: %d and %d") % first.fileVersion % second.fileVersion << std::endl;
+			return 1;
+		}
+
+		size_t divergence = findDivergence(first.data, second.data, threads);
+		if(divergence == first.data.size() && divergence == second.data.size())
+		{
+			std::cout << "Saves are identical" << std::endl;
+			return 0;
+		}
+
+		std::cout << boost::format("Saves diverge at offset %d of unpacked data (sizes: %d and %d)") % divergence % first.data.size() % second.data.size() << std::endl;
+		loadDLLClasses();
+		describeDivergence(first, divergence);
+		return 1;
+	}
+	catch(std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 2;
+	}
+}
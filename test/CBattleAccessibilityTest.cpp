@@ -0,0 +1,62 @@
+/*
+ * CBattleAccessibilityTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../lib/CBattleCallback.h"
+#include "../lib/CRandomGenerator.h"
+
+BOOST_AUTO_TEST_CASE(AccessibilityInfo_AccessibleHexes)
+{
+	CRandomGenerator gen;
+	gen.seed(1);
+	auto nextAccessibility = gen.getRangeI(EAccessibility::ACCESSIBLE, EAccessibility::SIDE_COLUMN);
+	auto nextPercent = gen.getRangeI(0, 99);
+
+	for(int battlefield = 0; battlefield < 50; battlefield++)
+	{
+		//from nearly empty battlefields to crowded ones
+		AccessibilityInfo accessibility;
+		for(auto &hex : accessibility)
+			hex = nextPercent() < battlefield * 2 ? static_cast<EAccessibility::EAccessibility>(nextAccessibility()) : EAccessibility::ACCESSIBLE;
+
+		for(int doubleWide = 0; doubleWide < 2; doubleWide++)
+		{
+			for(int attackerOwned = 0; attackerOwned < 2; attackerOwned++)
+			{
+				const TBattleHexSet hexes = accessibility.accessibleHexes(doubleWide, attackerOwned);
+				for(si16 hex = 0; hex < GameConstants::BFIELD_SIZE; hex++)
+				{
+					BOOST_CHECK_MESSAGE(hexes[hex] == accessibility.accessible(hex, doubleWide, attackerOwned),
+						"Hex " << hex << ", double wide " << doubleWide << ", attacker " << attackerOwned << ", battlefield " << battlefield);
+				}
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(BattleHex_NeighbouringTiles)
+{
+	for(si16 hex = 0; hex < GameConstants::BFIELD_SIZE; hex++)
+	{
+		const auto &neighbours = BattleHex(hex).neighbouringTiles();
+		BOOST_CHECK_LE(neighbours.size(), 6u);
+		for(BattleHex neighbour : neighbours)
+		{
+			BOOST_CHECK(neighbour.isValid());
+			BOOST_CHECK_EQUAL((int)BattleHex::getDistance(hex, neighbour), 1);
+			BOOST_CHECK(vstd::contains(neighbour.neighbouringTiles(), BattleHex(hex)));
+		}
+	}
+
+	BOOST_CHECK(BattleHex(-2).neighbouringTiles().empty());
+	BOOST_CHECK(BattleHex(GameConstants::BFIELD_SIZE).neighbouringTiles().empty());
+}
@@ -0,0 +1,295 @@
+/*
+ * CBattleSnapshotTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../lib/CBattleSnapshot.h"
+#include "../lib/BattleState.h"
+#include "../lib/NetPacks.h"
+#include "../lib/CObjectHandler.h"
+#include "../lib/CCreatureHandler.h"
+#include "../lib/CSpellHandler.h"
+
+/// Battle on open field without heroes: pikemen and archers of attacker against pikemen and archers of defender
+struct BattleFixture
+{
+	CArmedInstance armies[2];
+	BattleInfo battle;
+	CStack *pikemen, *archers, *enemyPikemen, *enemyArchers;
+
+	BattleFixture()
+	{
+		battle.round = 1;
+		battle.activeStack = battle.selectedStack = -1;
+		battle.siege = CGTownInstance::NONE;
+		battle.town = nullptr;
+		battle.battlefieldType = BFieldType::GRASS_HILLS;
+		battle.terrainType = ETerrainType::GRASS;
+		battle.tacticsSide = 0;
+		battle.tacticDistance = 0;
+		for(int side = 0; side < 2; side++)
+		{
+			battle.sides[side] = PlayerColor(side);
+			battle.heroes[side] = nullptr;
+			battle.belligerents[side] = &armies[side];
+			battle.castSpells[side] = 0;
+			battle.enchanterCounter[side] = 0;
+			armies[side].tempOwner = PlayerColor(side);
+		}
+
+		pikemen = addStack(0, SlotID(0), CreatureID(0), 20, 35);
+		archers = addStack(0, SlotID(1), CreatureID(2), 10, 69);
+		enemyPikemen = addStack(1, SlotID(0), CreatureID(0), 20, 49);
+		enemyArchers = addStack(1, SlotID(1), CreatureID(2), 10, 83);
+		battle.localInit();
+	}
+
+	~BattleFixture()
+	{
+		for(CStack *stack : battle.stacks)
+			delete stack;
+		battle.stacks.clear();
+
+		for(auto &army : armies)
+			army.detachFrom(&battle);
+	}
+
+	CStack * addStack(int side, SlotID slot, CreatureID creature, TQuantity count, BattleHex position)
+	{
+		auto instance = new CStackInstance(creature, count);
+		armies[side].putStack(slot, instance);
+
+		auto stack = new CStack(instance, battle.sides[side], battle.stacks.size(), !side, slot);
+		stack->position = position;
+		stack->state.insert(EBattleStackState::ALIVE);
+		battle.stacks.push_back(stack);
+		return stack;
+	}
+
+	static BattleStackMoved makeMove(const CStack *stack, BattleHex destination)
+	{
+		BattleStackMoved bsm;
+		bsm.stack = stack->ID;
+		bsm.tilesToMove.push_back(destination);
+		return bsm;
+	}
+
+	static BattleAttack makeAttack(const CBattleSnapshot &state, const CStack *attacker, const CStack *defender, ui32 damage, ui8 flags = 0)
+	{
+		BattleAttack ba;
+		ba.stackAttacking = attacker->ID;
+		ba.flags = flags;
+		ba.bsa.push_back(state.makeAttacked(defender, damage, attacker));
+		return ba;
+	}
+
+	static StacksHealedOrResurrected::HealInfo makeHeal(const CStack *stack, ui32 healedHP)
+	{
+		StacksHealedOrResurrected::HealInfo heal;
+		heal.stackID = stack->ID;
+		heal.healedHP = healedHP;
+		heal.lowLevelResurrection = false;
+		return heal;
+	}
+
+	static SetStackEffect makeEffect(const CStack *stack, SpellID spell, Bonus::BonusType type, int subtype, int value)
+	{
+		SetStackEffect sse;
+		sse.stacks.push_back(stack->ID);
+		sse.effect.push_back(CStack::featureGenerator(type, subtype, value, 1));
+		sse.effect.back().sid = spell;
+		return sse;
+	}
+};
+
+BOOST_FIXTURE_TEST_CASE(CBattleSnapshot_CopyOnWrite, BattleFixture)
+{
+	const CBattleSnapshot state(&battle);
+	CBattleSnapshot copy = state;
+	BOOST_CHECK_EQUAL(&copy.getStack(pikemen), &state.getStack(pikemen));
+
+	copy.apply(makeMove(pikemen, 36));
+	const auto *changed = &copy.getStack(pikemen);
+	BOOST_CHECK(changed != &state.getStack(pikemen));
+	BOOST_CHECK_EQUAL(&copy.getStack(archers), &state.getStack(archers)); //other stacks are still shared
+	BOOST_CHECK_EQUAL(copy.getStack(pikemen).position, BattleHex(36));
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).position, BattleHex(35));
+	BOOST_CHECK_EQUAL(pikemen->position, BattleHex(35));
+
+	//stack owned by one snapshot is changed in place
+	copy.apply(makeMove(pikemen, 37));
+	BOOST_CHECK_EQUAL(&copy.getStack(pikemen), changed);
+	BOOST_CHECK_EQUAL(copy.getStack(pikemen).position, BattleHex(37));
+
+	//copy of copy shares changed state
+	CBattleSnapshot branch = copy;
+	BOOST_CHECK_EQUAL(&branch.getStack(pikemen), changed);
+	branch.apply(makeMove(pikemen, 38));
+	BOOST_CHECK_EQUAL(copy.getStack(pikemen).position, BattleHex(37));
+}
+
+BOOST_FIXTURE_TEST_CASE(CBattleSnapshot_MovedStacks, BattleFixture)
+{
+	CBattleSnapshot state(&battle);
+	BOOST_CHECK(state.canShoot(enemyArchers, pikemen));
+	BOOST_CHECK(!state.isBlocked(enemyArchers));
+
+	//enemy archers are blocked only in snapshot
+	state.apply(makeMove(pikemen, 82));
+	BOOST_CHECK(state.isBlocked(enemyArchers));
+	BOOST_CHECK(!state.canShoot(enemyArchers, pikemen));
+	BOOST_CHECK(state.canShoot(archers, enemyArchers));
+	BOOST_CHECK(!battle.battleIsStackBlocked(enemyArchers));
+	BOOST_CHECK(battle.battleCanShoot(enemyArchers, pikemen->position));
+
+	//reachability sees stacks where they stand in snapshot
+	const auto reachability = state.getReachability(enemyPikemen);
+	BOOST_CHECK(!reachability.isReachable(82));
+	BOOST_CHECK(reachability.isReachable(35));
+	const auto hexes = state.getAvailableHexes(enemyPikemen, reachability);
+	BOOST_CHECK(vstd::contains(hexes, BattleHex(49)));
+	for(BattleHex hex : hexes)
+		BOOST_CHECK_LE(reachability.distances[hex], (int)enemyPikemen->Speed());
+
+	//killed stacks don't block
+	BattleStackAttacked killed = state.makeAttacked(pikemen, pikemen->count * pikemen->MaxHealth());
+	BOOST_REQUIRE(killed.killed());
+	state.apply(killed);
+	BOOST_CHECK(!state.getStack(pikemen).alive);
+	BOOST_CHECK(!vstd::contains(state.getAliveStacks(), pikemen));
+	BOOST_CHECK(!state.isBlocked(enemyArchers));
+	BOOST_CHECK(!state.canShoot(enemyArchers, pikemen));
+	BOOST_CHECK(state.getReachability(enemyPikemen).isReachable(82));
+}
+
+BOOST_FIXTURE_TEST_CASE(CBattleSnapshot_Attack, BattleFixture)
+{
+	pikemen->addNewBonus(new Bonus(Bonus::UNTIL_ATTACK, Bonus::PRIMARY_SKILL, Bonus::SPELL_EFFECT, 5, SpellID::BLOODLUST, PrimarySkill::ATTACK));
+	enemyPikemen->addNewBonus(new Bonus(Bonus::UNITL_BEING_ATTACKED, Bonus::PRIMARY_SKILL, Bonus::SPELL_EFFECT, 5, SpellID::STONE_SKIN, PrimarySkill::DEFENSE));
+	CBattleSnapshot state(&battle);
+	BOOST_REQUIRE_EQUAL(state.getStack(pikemen).Attack(), pikemen->Attack());
+
+	//melee attack removes one creature and part of next one
+	const ui32 health = enemyPikemen->MaxHealth();
+	state.apply(makeAttack(state, pikemen, enemyPikemen, health + 2));
+	BOOST_CHECK_EQUAL(state.getStack(enemyPikemen).count, 19u);
+	BOOST_CHECK_EQUAL(state.getStack(enemyPikemen).firstHPleft, health - 2);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).Attack(), pikemen->Attack() - 5);
+	BOOST_CHECK_EQUAL(state.getStack(enemyPikemen).Defense(), enemyPikemen->Defense() - 5);
+	BOOST_CHECK_EQUAL(enemyPikemen->count, 20u);
+
+	//counter-attack uses retaliation, not ammunition
+	state.apply(makeAttack(state, enemyPikemen, pikemen, health, BattleAttack::COUNTER));
+	BOOST_CHECK_EQUAL(state.getStack(enemyPikemen).counterAttacks, enemyPikemen->counterAttacks - 1);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).counterAttacks, pikemen->counterAttacks);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).count, 19u);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).firstHPleft, health);
+
+	//shot uses ammunition
+	BOOST_REQUIRE(archers->shots > 0);
+	state.apply(makeAttack(state, archers, enemyArchers, 1, BattleAttack::SHOT));
+	BOOST_CHECK_EQUAL(state.getStack(archers).shots, archers->shots - 1);
+	BOOST_CHECK_EQUAL(state.getStack(archers).counterAttacks, archers->counterAttacks);
+	BOOST_CHECK_EQUAL(state.getStack(enemyArchers).firstHPleft, enemyArchers->MaxHealth() - 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(CBattleSnapshot_LifeDrain, BattleFixture)
+{
+	CBattleSnapshot state(&battle);
+	const ui32 health = pikemen->MaxHealth();
+	state.apply(makeAttack(state, enemyPikemen, pikemen, 3 * health + 1));
+	BOOST_REQUIRE_EQUAL(state.getStack(pikemen).count, 17u);
+
+	//drained life restores killed creatures up to original count
+	BattleAttack drain = makeAttack(state, pikemen, enemyPikemen, 10);
+	StacksHealedOrResurrected shr;
+	shr.lifeDrain = true;
+	shr.tentHealing = false;
+	shr.drainedFrom = enemyPikemen->ID;
+	shr.healedStacks.push_back(makeHeal(pikemen, 2 * health));
+	drain.bsa.back().healedStacks.push_back(shr);
+	state.apply(drain);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).count, 19u);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).firstHPleft, health - 1);
+
+	shr.healedStacks.back().healedHP = 10 * health;
+	state.apply(shr);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).count, 20u);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).firstHPleft, health);
+}
+
+BOOST_FIXTURE_TEST_CASE(CBattleSnapshot_StackEffect, BattleFixture)
+{
+	CBattleSnapshot state(&battle);
+	const auto haste = makeEffect(pikemen, SpellID::HASTE, Bonus::STACKS_SPEED, 0, 3);
+	state.apply(haste);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).Speed(), pikemen->Speed() + 3);
+
+	//the same spell is not stacked
+	state.apply(haste);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).Speed(), pikemen->Speed() + 3);
+
+	//snapshot moves stack further
+	const auto reachability = state.getReachability(pikemen);
+	const auto hexes = state.getAvailableHexes(pikemen, reachability);
+	BOOST_CHECK(vstd::contains_if(hexes, [&](BattleHex hex) { return reachability.distances[hex] == (int)pikemen->Speed() + 3; }));
+	for(BattleHex hex : battle.battleGetAvailableHexes(pikemen, false))
+		BOOST_CHECK(vstd::contains(hexes, hex));
+
+	//limiters decide which stacks get the bonus
+	auto bloodlust = makeEffect(pikemen, SpellID::BLOODLUST, Bonus::PRIMARY_SKILL, PrimarySkill::ATTACK, 10);
+	bloodlust.stacks.push_back(archers->ID);
+	bloodlust.effect.back().limiter = make_shared<CCreatureTypeLimiter>(*archers->getCreature(), false);
+	state.apply(bloodlust);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).Attack(), pikemen->Attack());
+	BOOST_CHECK_EQUAL(state.getStack(archers).Attack(), archers->Attack() + 10);
+
+	//effect lasting until attack is dropped after it
+	auto stoneSkin = makeEffect(archers, SpellID::STONE_SKIN, Bonus::PRIMARY_SKILL, PrimarySkill::DEFENSE, 4);
+	stoneSkin.effect.back().duration = Bonus::UNTIL_ATTACK;
+	state.apply(stoneSkin);
+	BOOST_CHECK_EQUAL(state.getStack(archers).Defense(), archers->Defense() + 4);
+	state.apply(makeAttack(state, archers, enemyArchers, 1, BattleAttack::SHOT));
+	BOOST_CHECK_EQUAL(state.getStack(archers).Defense(), archers->Defense());
+	BOOST_CHECK_EQUAL(state.getStack(archers).Attack(), archers->Attack() + 10);
+
+	//real stacks are unchanged
+	BOOST_CHECK(!pikemen->hasBonus(Selector::source(Bonus::SPELL_EFFECT, SpellID::HASTE)));
+	BOOST_CHECK(!archers->hasBonus(Selector::source(Bonus::SPELL_EFFECT, SpellID::BLOODLUST)));
+}
+
+BOOST_FIXTURE_TEST_CASE(CBattleSnapshot_Resurrection, BattleFixture)
+{
+	CBattleSnapshot state(&battle);
+	const auto slow = makeEffect(pikemen, SpellID::SLOW, Bonus::STACKS_SPEED, 0, -2);
+	BOOST_REQUIRE(SpellID(SpellID::SLOW).toSpell()->isNegative());
+	state.apply(slow);
+	BOOST_REQUIRE_EQUAL(state.getStack(pikemen).Speed(), pikemen->Speed() - 2);
+	state.apply(state.makeAttacked(pikemen, pikemen->count * pikemen->MaxHealth()));
+	BOOST_REQUIRE(!state.getStack(pikemen).alive);
+
+	StacksHealedOrResurrected shr;
+	shr.lifeDrain = false;
+	shr.tentHealing = false;
+	shr.drainedFrom = 0;
+	shr.healedStacks.push_back(makeHeal(pikemen, 5 * pikemen->MaxHealth()));
+
+	//stack standing on corpse prevents resurrection
+	CBattleSnapshot blocked = state;
+	blocked.apply(makeMove(enemyPikemen, pikemen->position));
+	blocked.apply(shr);
+	BOOST_CHECK(!blocked.getStack(pikemen).alive);
+
+	state.apply(shr);
+	BOOST_CHECK(state.getStack(pikemen).alive);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).count, 5u);
+	BOOST_CHECK_EQUAL(state.getStack(pikemen).Speed(), pikemen->Speed()); //negative effects are gone
+}
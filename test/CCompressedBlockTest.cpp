@@ -0,0 +1,110 @@
+/*
+ * CCompressedBlockTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../lib/Connection.h"
+#include "../lib/CRandomGenerator.h"
+
+#include <zlib.h>
+
+static std::vector<ui8> repetitiveData(size_t size)
+{
+	std::vector<ui8> ret(size);
+	for(size_t i = 0; i < size; i++)
+		ret[i] = (i / 7) % 5;
+	return ret;
+}
+
+static std::vector<ui8> randomData(size_t size)
+{
+	CRandomGenerator gen;
+	gen.seed(42);
+	auto nextByte = gen.getRangeI(0, 255);
+	std::vector<ui8> ret(size);
+	for(auto &byte : ret)
+		byte = nextByte();
+	return ret;
+}
+
+//reads blocks one after another, like receiving side of connection reads frames
+static std::vector<std::vector<ui8> > unpackAll(const std::vector<ui8> &stream)
+{
+	std::vector<std::vector<ui8> > ret;
+	size_t pos = 0;
+	while(pos < stream.size())
+	{
+		BOOST_REQUIRE(pos + CCompressedBlock::HEADER_SIZE <= stream.size());
+		ui32 dataSize, rawSize;
+		CCompressedBlock::parseHeader(&stream[pos], dataSize, rawSize);
+		pos += CCompressedBlock::HEADER_SIZE;
+		BOOST_REQUIRE(pos + dataSize <= stream.size());
+
+		std::vector<ui8> data(stream.begin() + pos, stream.begin() + pos + dataSize), block;
+		CCompressedBlock::unpack(data, rawSize, block);
+		ret.push_back(block);
+		pos += dataSize;
+	}
+	return ret;
+}
+
+BOOST_AUTO_TEST_CASE(CCompressedBlock_RoundTrip)
+{
+	std::vector<std::vector<ui8> > blocks;
+	blocks.push_back(repetitiveData(100000));
+	blocks.push_back(repetitiveData(CCompressedBlock::MIN_COMPRESSED_SIZE - 1)); //too small to be compressed
+	blocks.push_back(randomData(5000)); //doesn't shrink
+	blocks.push_back(std::vector<ui8>());
+	blocks.push_back(repetitiveData(CCompressedBlock::MIN_COMPRESSED_SIZE));
+
+	std::vector<ui8> stream;
+	for(auto &block : blocks)
+		CCompressedBlock::pack(block, stream, Z_BEST_SPEED);
+
+	BOOST_CHECK(unpackAll(stream) == blocks);
+}
+
+BOOST_AUTO_TEST_CASE(CCompressedBlock_StoredSizes)
+{
+	std::vector<ui8> compressed, stored;
+	const auto data = repetitiveData(100000), noise = randomData(5000);
+	CCompressedBlock::pack(data, compressed, Z_BEST_COMPRESSION);
+	CCompressedBlock::pack(noise, stored, Z_BEST_COMPRESSION);
+
+	ui32 dataSize, rawSize;
+	CCompressedBlock::parseHeader(&compressed[0], dataSize, rawSize);
+	BOOST_CHECK_EQUAL(rawSize, data.size());
+	BOOST_CHECK_LT(dataSize, data.size());
+	BOOST_CHECK_EQUAL(compressed.size(), CCompressedBlock::HEADER_SIZE + dataSize);
+
+	CCompressedBlock::parseHeader(&stored[0], dataSize, rawSize);
+	BOOST_CHECK_EQUAL(rawSize, 0u);
+	BOOST_CHECK_EQUAL(dataSize, noise.size());
+
+	//level 0 stores even data that would compress well
+	std::vector<ui8> uncompressed;
+	CCompressedBlock::pack(data, uncompressed, 0);
+	CCompressedBlock::parseHeader(&uncompressed[0], dataSize, rawSize);
+	BOOST_CHECK_EQUAL(rawSize, 0u);
+	BOOST_CHECK_EQUAL(dataSize, data.size());
+	BOOST_CHECK(std::equal(data.begin(), data.end(), uncompressed.begin() + CCompressedBlock::HEADER_SIZE));
+}
+
+BOOST_AUTO_TEST_CASE(CCompressedBlock_Corrupted)
+{
+	std::vector<ui8> stream;
+	CCompressedBlock::pack(repetitiveData(100000), stream, Z_BEST_SPEED);
+
+	ui32 dataSize, rawSize;
+	CCompressedBlock::parseHeader(&stream[0], dataSize, rawSize);
+	std::vector<ui8> truncated(stream.begin() + CCompressedBlock::HEADER_SIZE, stream.begin() + CCompressedBlock::HEADER_SIZE + dataSize / 2), out;
+	BOOST_CHECK_THROW(CCompressedBlock::unpack(truncated, rawSize, out), std::runtime_error);
+}
@@ -0,0 +1,212 @@
+/*
+ * CConnectionTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/asio.hpp>
+
+#include "../lib/Connection.h"
+
+/// Two connections linked through loopback interface
+struct ConnectionsFixture
+{
+	unique_ptr<CConnection> server, client;
+
+	ConnectionsFixture()
+	{
+		auto io = new boost::asio::io_service(); //deleted by server connection
+		TAcceptor acceptor(*io, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		const std::string port = boost::lexical_cast<std::string>(acceptor.local_endpoint().port());
+
+		//both sides wait for greeting of the other one in constructor
+		boost::thread connecting([&]{ client.reset(new CConnection("127.0.0.1", port, "test client")); });
+		auto socket = new TSocket(*io);
+		acceptor.accept(*socket);
+		server.reset(new CConnection(socket, "test server"));
+		connecting.join();
+	}
+
+	~ConnectionsFixture()
+	{
+		client.reset();
+		server.reset();
+	}
+
+	//message from one flush, its size is multiple of frame size if extra is 0
+	void sendMessage(size_t vectors, size_t extra)
+	{
+		for(size_t i = 0; i < vectors; i++)
+			*client << std::vector<ui8>(CConnection::BUFFER_SIZE - sizeof(ui32), ui8(i));
+		if(extra)
+			*client << std::vector<ui8>(extra - sizeof(ui32), 0xff);
+		client->flush();
+	}
+};
+
+/// Collects vectors sent as messages by ConnectionsFixture::sendMessage, stops on empty vector
+struct MessagesReceiver
+{
+	CConnection &c;
+	std::vector<std::vector<size_t> > messages; //sizes of received vectors, for each message
+	std::string error;
+	bool finished;
+	boost::mutex mx;
+	boost::condition_variable cond;
+
+	MessagesReceiver(CConnection &C)
+		: c(C), finished(false)
+	{
+		c.startAsyncReads([this]
+		{
+			boost::unique_lock<boost::mutex> lock(mx);
+			messages.push_back(std::vector<size_t>());
+			while(c.hasUnreadMessageData())
+			{
+				std::vector<ui8> data;
+				c >> data;
+				if(data.empty())
+				{
+					finished = true;
+					cond.notify_all();
+					return false;
+				}
+				messages.back().push_back(data.size());
+			}
+			return true;
+		}, [this](const std::string &Error)
+		{
+			boost::unique_lock<boost::mutex> lock(mx);
+			error = Error;
+			finished = true;
+			cond.notify_all();
+		});
+	}
+
+	bool waitTillFinished()
+	{
+		boost::unique_lock<boost::mutex> lock(mx);
+		return cond.timed_wait(lock, boost::posix_time::seconds(10), [this]{ return finished; });
+	}
+};
+
+BOOST_FIXTURE_TEST_CASE(CConnection_BlockingReads, ConnectionsFixture)
+{
+	std::vector<si32> big(100000);
+	for(size_t i = 0; i < big.size(); i++)
+		big[i] = i * 7;
+	const std::string text = "text after frames";
+	*client << big << text;
+	client->flush();
+	sendMessage(1, 0); //ends with empty frame
+
+	std::vector<si32> loadedBig;
+	std::string loadedText;
+	std::vector<ui8> loadedFrame;
+	*server >> loadedBig >> loadedText >> loadedFrame;
+	BOOST_CHECK(loadedBig == big);
+	BOOST_CHECK_EQUAL(loadedText, text);
+	BOOST_CHECK_EQUAL(loadedFrame.size(), CConnection::BUFFER_SIZE - sizeof(ui32));
+}
+
+BOOST_FIXTURE_TEST_CASE(CConnection_AsyncReads, ConnectionsFixture)
+{
+	{
+		MessagesReceiver receiver(*server);
+		CAsyncConnectionsWriter asyncWriter(std::set<CConnection *>{server.get()}, 1024 * 1024); //stops reads before receiver is destroyed
+
+		sendMessage(0, 10);
+		sendMessage(3, 1000); //spans several frames
+		sendMessage(2, 0); //exact multiple of frame size
+		*client << std::vector<ui8>(5, 1) << std::vector<ui8>() << std::vector<ui8>(7, 2); //reading stops in the middle of message
+		client->flush();
+		*client << std::string("read later");
+		client->flush();
+
+		BOOST_REQUIRE(receiver.waitTillFinished());
+		BOOST_CHECK(receiver.error.empty());
+		BOOST_REQUIRE_EQUAL(receiver.messages.size(), 4u);
+		const size_t frameVector = CConnection::BUFFER_SIZE - sizeof(ui32);
+		BOOST_CHECK(receiver.messages[0] == std::vector<size_t>(1, 6));
+		BOOST_CHECK((receiver.messages[1] == std::vector<size_t>{frameVector, frameVector, frameVector, 996}));
+		BOOST_CHECK((receiver.messages[2] == std::vector<size_t>{frameVector, frameVector}));
+		BOOST_CHECK(receiver.messages[3] == std::vector<size_t>(1, 5));
+
+		//writes are still asynchronous
+		*server << std::string("reply");
+		server->flush();
+	}
+
+	//rest of data can be read as usual
+	std::vector<ui8> rest;
+	std::string text, reply;
+	*server >> rest >> text;
+	BOOST_CHECK_EQUAL(rest.size(), 7u);
+	BOOST_CHECK_EQUAL(text, "read later");
+	*client >> reply;
+	BOOST_CHECK_EQUAL(reply, "reply");
+}
+
+BOOST_FIXTURE_TEST_CASE(CConnection_StopReads, ConnectionsFixture)
+{
+	{
+		MessagesReceiver receiver(*server);
+		CAsyncConnectionsWriter asyncWriter(std::set<CConnection *>{server.get()}, 1024 * 1024); //stops reads before receiver is destroyed
+		sendMessage(0, 10);
+		while(true)
+		{
+			boost::unique_lock<boost::mutex> lock(receiver.mx);
+			if(!receiver.messages.empty())
+				break;
+			receiver.cond.timed_wait(lock, boost::posix_time::milliseconds(10));
+		}
+	} //read that is waiting for data is cancelled
+
+	BOOST_CHECK(server->isOpen());
+	sendMessage(0, 20);
+	std::vector<ui8> data;
+	*server >> data;
+	BOOST_CHECK_EQUAL(data.size(), 16u);
+}
+
+BOOST_FIXTURE_TEST_CASE(CConnection_LostDuringAsyncReads, ConnectionsFixture)
+{
+	MessagesReceiver receiver(*server);
+	CAsyncConnectionsWriter asyncWriter(std::set<CConnection *>{server.get()}, 1024 * 1024);
+	client->close();
+
+	BOOST_REQUIRE(receiver.waitTillFinished());
+	BOOST_CHECK(!receiver.error.empty());
+	BOOST_CHECK(!server->isOpen());
+}
+
+BOOST_FIXTURE_TEST_CASE(CConnection_AddedToRunningWriter, ConnectionsFixture)
+{
+	{
+		MessagesReceiver receiver(*server);
+		CAsyncConnectionsWriter asyncWriter(std::set<CConnection *>(), 1024 * 1024);
+		asyncWriter.addConnection(server.get()); //eg. client joining running game
+
+		sendMessage(0, 10);
+		*client << std::vector<ui8>();
+		client->flush();
+
+		BOOST_REQUIRE(receiver.waitTillFinished());
+		BOOST_CHECK(receiver.error.empty());
+		BOOST_REQUIRE(!receiver.messages.empty());
+		BOOST_CHECK(receiver.messages[0] == std::vector<size_t>(1, 6));
+
+		*server << std::string("reply");
+		server->flush();
+	}
+
+	std::string reply;
+	*client >> reply;
+	BOOST_CHECK_EQUAL(reply, "reply");
+}
@@ -0,0 +1,276 @@
+/*
+ * CPathfinderTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../lib/CGameState.h"
+#include "../lib/CSectorGraph.h"
+#include "../lib/CObjectHandler.h"
+#include "../lib/CCreatureHandler.h"
+#include "../lib/CTownHandler.h"
+#include "../lib/VCMI_Lib.h"
+#include "../lib/mapping/CMap.h"
+#include "../lib/mapping/CMapEditManager.h"
+#include "../lib/int3.h"
+
+/// Privileged access to game state for sector graph
+struct GameInfo : public CGameInfoCallback
+{
+	GameInfo(CGameState *gs) : CGameInfoCallback(gs, boost::optional<PlayerColor>()) {}
+};
+
+/// Game state with grass map and single hero of red player, whole map is visible
+struct PathfinderFixture
+{
+	CGameState gs;
+	CGHeroInstance *hero;
+
+	PathfinderFixture()
+	{
+		auto map = new CMap();
+		map->width = 36;
+		map->height = 36;
+		map->twoLevel = false;
+		map->initTerrain();
+		gs.map = map;
+
+		auto editManager = map->getEditManager();
+		editManager->getTerrainSelection().selectRange(MapRect(int3(0, 0, 0), map->width, map->height));
+		editManager->drawTerrain(ETerrainType::GRASS);
+
+		TeamState &team = gs.teams[TeamID(0)];
+		team.id = TeamID(0);
+		team.players.insert(PlayerColor(0));
+		team.fogOfWarMap.resize(map->width, std::vector<std::vector<ui8> >(map->height, std::vector<ui8>(1, 1)));
+		PlayerState &player = gs.players[PlayerColor(0)];
+		player.color = PlayerColor(0);
+		player.team = TeamID(0);
+
+		hero = new CGHeroInstance();
+		hero->ID = Obj::HERO;
+		hero->tempOwner = PlayerColor(0);
+		hero->initHero(HeroTypeID(0));
+		editManager->insertObject(hero, CGHeroInstance::convertPosition(int3(18, 18, 0), true));
+		hero->movement = hero->maxMovePoints(true);
+	}
+
+	void setBlocked(const std::vector<int3> &tiles, bool blocked)
+	{
+		for(const int3 &tile : tiles)
+			gs.map->getTile(tile).blocked = blocked;
+	}
+
+	//checks that paths kept in given workspace are the same as paths found by search from scratch
+	void checkSameAsFresh(CPathsInfo &paths)
+	{
+		gs.calculatePaths(hero, paths);
+
+		CPathsInfo fresh(paths.sizes);
+		gs.calculatePaths(hero, fresh);
+
+		int3 pos;
+		for(pos.x = 0; pos.x < paths.sizes.x; pos.x++)
+		{
+			for(pos.y = 0; pos.y < paths.sizes.y; pos.y++)
+			{
+				//predecessors may differ between paths of the same cost
+				const CGPathNode *node = paths.getNode(pos), *freshNode = fresh.getNode(pos);
+				BOOST_CHECK_EQUAL(node->reachable(), freshNode->reachable());
+				BOOST_CHECK_EQUAL(node->turns, freshNode->turns);
+				BOOST_CHECK_EQUAL(node->moveRemains, freshNode->moveRemains);
+				BOOST_CHECK_EQUAL(node->land, freshNode->land);
+			}
+		}
+	}
+
+	//checks that estimations of graph agree with paths found by pathfinder
+	void checkSectorGraph(CSectorGraph &graph)
+	{
+		CPathsInfo paths(gs.getMapSize());
+		gs.calculatePaths(hero, paths);
+
+		int3 pos;
+		for(pos.x = 0; pos.x < paths.sizes.x; pos.x++)
+		{
+			for(pos.y = 0; pos.y < paths.sizes.y; pos.y++)
+			{
+				const CGPathNode *node = paths.getNode(pos);
+				const int turns = graph.getTurns(hero, pos);
+				BOOST_CHECK_EQUAL(turns >= 0, node->reachable());
+				if(!node->reachable())
+					continue;
+
+				//detours to portals and leftover movement points shift estimation by a day at most
+				BOOST_CHECK_LE(std::abs(turns - node->turns), 1);
+				if(node->turns == 0 && node->moveRemains >= 1000)
+					BOOST_CHECK_EQUAL(turns, 0);
+			}
+		}
+	}
+};
+
+BOOST_FIXTURE_TEST_CASE(CPathfinder_RepairAfterBlocking, PathfinderFixture)
+{
+	CPathsInfo paths(gs.getMapSize());
+	gs.calculatePaths(hero, paths);
+	BOOST_CHECK(paths.isRepairable);
+
+	//wall across the way east with a gap, paths behind it get longer
+	std::vector<int3> wall;
+	for(int y = 10; y < 26; y++)
+		if(y != 12)
+			wall.push_back(int3(21, y, 0));
+	setBlocked(wall, true);
+	paths.invalidateTiles(wall);
+	checkSameAsFresh(paths);
+
+	//closing the gap
+	std::vector<int3> gap(1, int3(21, 12, 0));
+	setBlocked(gap, true);
+	paths.invalidateTiles(gap);
+	checkSameAsFresh(paths);
+
+	//removing the wall, paths get shorter again
+	setBlocked(wall, false);
+	setBlocked(gap, false);
+	wall.push_back(gap.front());
+	paths.invalidateTiles(wall);
+	checkSameAsFresh(paths);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPathfinder_RecomputeWithoutInvalidatedTiles, PathfinderFixture)
+{
+	CPathsInfo paths(gs.getMapSize());
+	gs.calculatePaths(hero, paths);
+
+	//change nobody told about, paths must not be repaired from stale graph
+	std::vector<int3> tiles;
+	for(int x = 14; x < 23; x++)
+		tiles.push_back(int3(x, 15, 0));
+	setBlocked(tiles, true);
+	checkSameAsFresh(paths);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPathfinder_RecomputeAfterCostChange, PathfinderFixture)
+{
+	auto editManager = gs.map->getEditManager();
+	editManager->getTerrainSelection().selectRange(MapRect(int3(20, 8, 0), 12, 20));
+	editManager->drawTerrain(ETerrainType::SWAMP);
+
+	CPathsInfo paths(gs.getMapSize());
+	gs.calculatePaths(hero, paths);
+
+	//army native to swamp moves through it faster, speed of army (and so movement points) stays the same
+	const int maxMovePoints = hero->maxMovePoints(true);
+	int speed = INT_MAX;
+	for(auto &stack : hero->Slots())
+		vstd::amin(speed, stack.second->valOfBonuses(Bonus::STACKS_SPEED));
+	CreatureID swampCreature = CreatureID::NONE;
+	for(const CCreature *creature : VLC->creh->creatures)
+	{
+		if(VLC->townh->factions[creature->faction]->nativeTerrain == ETerrainType::SWAMP
+			&& creature->valOfBonuses(Bonus::STACKS_SPEED) == speed)
+		{
+			swampCreature = creature->idNumber;
+			break;
+		}
+	}
+	BOOST_REQUIRE(swampCreature != CreatureID::NONE);
+	hero->clear();
+	hero->setCreature(SlotID(0), swampCreature, 10);
+	BOOST_REQUIRE_EQUAL(hero->maxMovePoints(true), maxMovePoints);
+	BOOST_CHECK(CPathsInfo::CostInputs(hero) != paths.costInputs);
+
+	std::vector<int3> tiles(1, int3(2, 2, 0)); //far from any changed cost
+	paths.invalidateTiles(tiles);
+	checkSameAsFresh(paths);
+}
+
+BOOST_FIXTURE_TEST_CASE(CSectorGraph_OpenMap, PathfinderFixture)
+{
+	GameInfo info(&gs);
+	CSectorGraph graph(&info);
+	checkSectorGraph(graph);
+
+	//portals never make path shorter than the straight one, inside the cluster of hero it's exact
+	const int3 src = hero->getPosition(false);
+	int3 pos;
+	for(pos.x = 0; pos.x < gs.map->width; pos.x++)
+	{
+		for(pos.y = 0; pos.y < gs.map->height; pos.y++)
+		{
+			const int dx = std::abs(pos.x - src.x), dy = std::abs(pos.y - src.y);
+			const int straight = 100 * std::abs(dx - dy) + 141 * std::min(dx, dy);
+			const int distance = graph.getDistance(src, pos);
+			BOOST_CHECK_GE(distance, straight);
+			if(pos.x / CSectorGraph::CLUSTER_SIZE == src.x / CSectorGraph::CLUSTER_SIZE
+				&& pos.y / CSectorGraph::CLUSTER_SIZE == src.y / CSectorGraph::CLUSTER_SIZE)
+			{
+				BOOST_CHECK_EQUAL(distance, straight);
+			}
+		}
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(CSectorGraph_Walls, PathfinderFixture)
+{
+	//wall across the way east with a gap and closed room in another cluster
+	std::vector<int3> wall, room;
+	for(int y = 10; y < 26; y++)
+		if(y != 12)
+			wall.push_back(int3(21, y, 0));
+	for(int i = 3; i < 10; i++)
+	{
+		room.push_back(int3(i, 3, 0));
+		room.push_back(int3(i, 9, 0));
+		room.push_back(int3(3, i, 0));
+		room.push_back(int3(9, i, 0));
+	}
+	setBlocked(wall, true);
+	setBlocked(room, true);
+
+	GameInfo info(&gs);
+	CSectorGraph graph(&info);
+	checkSectorGraph(graph);
+	BOOST_CHECK_EQUAL(graph.getSector(int3(21, 15, 0)), -1);
+	BOOST_CHECK_EQUAL(graph.getDistance(hero->getPosition(false), int3(6, 6, 0)), -1);
+	BOOST_CHECK_GE(graph.getSector(int3(6, 6, 0)), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(CSectorGraph_TilesChanged, PathfinderFixture)
+{
+	GameInfo info(&gs);
+	CSectorGraph graph(&info);
+	graph.getSector(hero->getPosition(false)); //builds graph before change
+
+	//changed clusters are rebuilt to the same state as fresh graph
+	auto checkSameAsFresh = [&]()
+	{
+		CSectorGraph fresh(&info);
+		const int3 src = hero->getPosition(false);
+		int3 pos;
+		for(pos.x = 0; pos.x < gs.map->width; pos.x++)
+			for(pos.y = 0; pos.y < gs.map->height; pos.y++)
+				BOOST_CHECK_EQUAL(graph.getDistance(src, pos), fresh.getDistance(src, pos));
+		checkSectorGraph(graph);
+	};
+
+	std::vector<int3> wall;
+	for(int x = 5; x < 30; x++)
+		wall.push_back(int3(x, 14, 0));
+	setBlocked(wall, true);
+	graph.tilesChanged(wall);
+	checkSameAsFresh();
+
+	setBlocked(wall, false);
+	graph.tilesChanged(wall);
+	checkSameAsFresh();
+}
@@ -0,0 +1,90 @@
+/*
+ * CReachabilityCacheTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../lib/CBattleCallback.h"
+
+static ReachabilityInfo::Parameters makeParams(BattleHex start, bool doubleWide = false)
+{
+	ReachabilityInfo::Parameters params;
+	params.startPosition = start;
+	params.doubleWide = doubleWide;
+	params.knownAccessible.push_back(start);
+	return params;
+}
+
+static ReachabilityInfo makeReachability(int distance)
+{
+	ReachabilityInfo ret;
+	ret.distances[0] = distance; //marks which computation the result comes from
+	return ret;
+}
+
+BOOST_AUTO_TEST_CASE(CReachabilityCache_SameVersion)
+{
+	CReachabilityCache cache;
+	const auto params = makeParams(20);
+	ReachabilityInfo out;
+	BOOST_CHECK(!cache.get(1, BattlePerspective::LEFT_SIDE, params, out));
+
+	cache.put(1, BattlePerspective::LEFT_SIDE, params, makeReachability(5));
+	BOOST_REQUIRE(cache.get(1, BattlePerspective::LEFT_SIDE, params, out));
+	BOOST_CHECK_EQUAL(out.distances[0], 5);
+	BOOST_CHECK_EQUAL(out.params.startPosition, params.startPosition);
+
+	//other parameters or other side (that may see other obstacles) don't share the result
+	BOOST_CHECK(!cache.get(1, BattlePerspective::RIGHT_SIDE, params, out));
+	BOOST_CHECK(!cache.get(1, BattlePerspective::LEFT_SIDE, makeParams(21), out));
+	BOOST_CHECK(!cache.get(1, BattlePerspective::LEFT_SIDE, makeParams(20, true), out));
+}
+
+BOOST_AUTO_TEST_CASE(CReachabilityCache_NewVersion)
+{
+	CReachabilityCache cache;
+	const auto params = makeParams(20);
+	ReachabilityInfo out;
+	cache.put(1, BattlePerspective::LEFT_SIDE, params, makeReachability(5));
+
+	//battle changed, result is outdated
+	BOOST_CHECK(!cache.get(2, BattlePerspective::LEFT_SIDE, params, out));
+
+	cache.put(2, BattlePerspective::LEFT_SIDE, params, makeReachability(6));
+	BOOST_REQUIRE(cache.get(2, BattlePerspective::LEFT_SIDE, params, out));
+	BOOST_CHECK_EQUAL(out.distances[0], 6);
+	BOOST_CHECK(!cache.get(1, BattlePerspective::LEFT_SIDE, params, out));
+
+	//result computed for older version (battle changed during computation) is not stored
+	cache.put(1, BattlePerspective::LEFT_SIDE, makeParams(30), makeReachability(7));
+	BOOST_CHECK(!cache.get(1, BattlePerspective::LEFT_SIDE, makeParams(30), out));
+	BOOST_CHECK(!cache.get(2, BattlePerspective::LEFT_SIDE, makeParams(30), out));
+	BOOST_REQUIRE(cache.get(2, BattlePerspective::LEFT_SIDE, params, out));
+	BOOST_CHECK_EQUAL(out.distances[0], 6);
+}
+
+BOOST_AUTO_TEST_CASE(CReachabilityCache_Limits)
+{
+	CReachabilityCache cache;
+	ReachabilityInfo out;
+	for(int i = 0; i <= CReachabilityCache::MAX_ENTRIES; i++)
+		cache.put(1, BattlePerspective::LEFT_SIDE, makeParams(i % GameConstants::BFIELD_SIZE, i >= GameConstants::BFIELD_SIZE), makeReachability(i));
+
+	//last entry is always kept
+	const int last = CReachabilityCache::MAX_ENTRIES;
+	BOOST_REQUIRE(cache.get(1, BattlePerspective::LEFT_SIDE, makeParams(last % GameConstants::BFIELD_SIZE, last >= GameConstants::BFIELD_SIZE), out));
+	BOOST_CHECK_EQUAL(out.distances[0], last);
+
+	//copies start empty, they belong to another battle
+	CReachabilityCache copy(cache);
+	BOOST_CHECK(!copy.get(1, BattlePerspective::LEFT_SIDE, makeParams(last % GameConstants::BFIELD_SIZE, last >= GameConstants::BFIELD_SIZE), out));
+	cache = copy;
+	BOOST_CHECK(!cache.get(1, BattlePerspective::LEFT_SIDE, makeParams(last % GameConstants::BFIELD_SIZE, last >= GameConstants::BFIELD_SIZE), out));
+}
@@ -0,0 +1,117 @@
+/*
+ * CSaveFileTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../lib/Connection.h"
+
+/// Content of test save, big enough to span several chunks
+struct SaveContent
+{
+	std::vector<si32> numbers;
+	std::string text;
+	std::map<std::string, std::vector<double> > table;
+
+	SaveContent()
+	{
+		for(si32 i = 0; i < 300000; i++)
+			numbers.push_back(i * 7919 % 100003 - 50000);
+		text = "Some text saved between big vectors";
+		for(int i = 0; i < 100; i++)
+			table["key" + boost::lexical_cast<std::string>(i)] = std::vector<double>(i, i / 3.0);
+	}
+
+	bool operator==(const SaveContent &other) const
+	{
+		return numbers == other.numbers && text == other.text && table == other.table;
+	}
+
+	template <typename Handler> void serialize(Handler &h, const int version)
+	{
+		h & numbers & text & table;
+	}
+};
+
+struct SaveFileFixture
+{
+	std::string fname;
+	SaveContent content;
+
+	SaveFileFixture()
+	{
+		fname = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("vcmitest-%%%%-%%%%.vsgm1")).string();
+	}
+
+	~SaveFileFixture()
+	{
+		CSaveFile::waitForBackgroundSaves();
+		boost::filesystem::remove(fname);
+	}
+
+	void checkLoaded()
+	{
+		CLoadFile loader(fname);
+		loader.checkMagicBytes("test");
+		SaveContent loaded;
+		loaded.numbers.clear();
+		loaded.text.clear();
+		loaded.table.clear();
+		loader >> loaded;
+		BOOST_CHECK(loaded == content);
+	}
+};
+
+BOOST_FIXTURE_TEST_CASE(CSaveFile_RoundTrip, SaveFileFixture)
+{
+	CSaveFile saver(fname);
+	saver.putMagicBytes("test");
+	saver << content;
+	saver.close();
+
+	BOOST_CHECK_LT(boost::filesystem::file_size(fname), content.numbers.size() * sizeof(si32)); //data was compressed
+	checkLoaded();
+}
+
+BOOST_FIXTURE_TEST_CASE(CSaveFile_CloseInBackground, SaveFileFixture)
+{
+	{
+		CSaveFile saver(fname);
+		saver.putMagicBytes("test");
+		saver << content;
+		saver.closeInBackground();
+	}
+	checkLoaded(); //loading waits for background saves
+}
+
+BOOST_FIXTURE_TEST_CASE(CSaveFile_FinishedByDestructor, SaveFileFixture)
+{
+	{
+		CSaveFile saver(fname);
+		saver.putMagicBytes("test");
+		saver << content;
+	}
+	checkLoaded();
+}
+
+BOOST_FIXTURE_TEST_CASE(CSaveFile_Truncated, SaveFileFixture)
+{
+	{
+		CSaveFile saver(fname);
+		saver.putMagicBytes("test");
+		saver << content;
+	}
+	boost::filesystem::resize_file(fname, boost::filesystem::file_size(fname) / 2);
+
+	CLoadFile loader(fname);
+	loader.checkMagicBytes("test");
+	SaveContent loaded;
+	BOOST_CHECK_THROW(loader >> loaded, std::exception);
+}
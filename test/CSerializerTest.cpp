@@ -0,0 +1,184 @@
+/*
+ * CSerializerTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../lib/Connection.h"
+
+struct TestNode
+{
+	si32 value;
+	TestNode *next;
+
+	TestNode() : value(0), next(nullptr) {}
+
+	template <typename Handler> void serialize(Handler &h, const int version)
+	{
+		h & value & next;
+	}
+};
+
+BOOST_AUTO_TEST_CASE(CSerializer_SharedPointers)
+{
+	//ring of nodes, every node is also referenced by the vector
+	std::vector<TestNode> nodes(2000);
+	std::vector<TestNode *> saved;
+	for(size_t i = 0; i < nodes.size(); i++)
+	{
+		nodes[i].value = i * 3;
+		nodes[i].next = &nodes[(i + 1) % nodes.size()];
+		saved.push_back(&nodes[(i * 7) % nodes.size()]);
+	}
+	saved.push_back(nullptr);
+	saved.push_back(saved.front());
+
+	CMemorySaver saver;
+	saver.reservePointers(nodes.size());
+	saver << saved;
+
+	CMemoryLoader loader(saver.buffer);
+	std::vector<TestNode *> loaded;
+	loader >> loaded;
+	BOOST_CHECK_EQUAL(loader.pos, saver.buffer.size());
+
+	BOOST_REQUIRE_EQUAL(loaded.size(), saved.size());
+	BOOST_CHECK(loaded[nodes.size()] == nullptr);
+	BOOST_CHECK(loaded.back() == loaded.front());
+	std::map<const TestNode *, TestNode *> loadedFor; //[saved node] -> its loaded copy
+	for(size_t i = 0; i < nodes.size(); i++)
+	{
+		BOOST_REQUIRE(loaded[i]);
+		BOOST_CHECK_EQUAL(loaded[i]->value, saved[i]->value);
+		loadedFor[saved[i]] = loaded[i];
+	}
+	BOOST_REQUIRE_EQUAL(loadedFor.size(), nodes.size());
+
+	//pointers to the same object are loaded as the same pointer
+	std::set<TestNode *> allLoaded;
+	for(auto &node : loadedFor)
+	{
+		BOOST_CHECK(node.second->next == loadedFor[node.first->next]);
+		allLoaded.insert(node.second);
+	}
+	BOOST_CHECK_EQUAL(allLoaded.size(), nodes.size()); //no node was loaded twice
+
+	for(auto node : allLoaded)
+		delete node;
+}
+
+BOOST_AUTO_TEST_CASE(CSerializer_SparsePointerIds)
+{
+	CMemoryLoader loader((std::vector<ui8>()));
+	TestNode first, far;
+	loader.ptrAllocated(&first, 0);
+	loader.ptrAllocated(&far, 0x7fffffff); //id from corrupted data mustn't make table huge
+
+	const size_t maxTableSize = CMemoryLoader::MAX_POINTER_ID_GAP + 1;
+	BOOST_CHECK_LE(loader.loadedPointers.size(), maxTableSize);
+	BOOST_CHECK(loader.getLoadedPointer(0) == &first);
+	BOOST_CHECK(loader.getLoadedPointer(0x7fffffff) == &far);
+	BOOST_CHECK(loader.getLoadedPointer(1) == nullptr);
+
+	loader.clearLoadedPointers();
+	BOOST_CHECK(loader.getLoadedPointer(0) == nullptr);
+	BOOST_CHECK(loader.getLoadedPointer(0x7fffffff) == nullptr);
+}
+
+template <typename T>
+static T roundTrip(const T &data)
+{
+	CMemorySaver saver;
+	saver << data;
+	CMemoryLoader loader(saver.buffer);
+	T ret;
+	loader >> ret;
+	BOOST_CHECK_EQUAL(loader.pos, saver.buffer.size());
+	return ret;
+}
+
+//data saved on machine with other endianess: every value of given width has its bytes reversed
+template <typename T>
+static T loadReversed(const T &data, size_t width)
+{
+	CMemorySaver saver;
+	saver << data;
+	std::vector<ui8> reversed = saver.buffer;
+	BOOST_REQUIRE_EQUAL(reversed.size() % width, 0u);
+	for(size_t i = 0; i < reversed.size(); i += width)
+		std::reverse(reversed.begin() + i, reversed.begin() + i + width);
+
+	CMemoryLoader loader(reversed);
+	loader.reverseEndianess = true;
+	T ret;
+	loader >> ret;
+	BOOST_CHECK_EQUAL(loader.pos, reversed.size());
+	return ret;
+}
+
+BOOST_AUTO_TEST_CASE(CSerializer_PrimitiveRanges)
+{
+	std::vector<si32> ints;
+	for(si32 i = -1000; i < 1000; i++)
+		ints.push_back(i * 12345);
+	BOOST_CHECK(roundTrip(ints) == ints);
+	BOOST_CHECK(roundTrip(std::vector<si32>()).empty());
+
+	std::vector<double> doubles(100, 0.1);
+	doubles[50] = -1e300;
+	BOOST_CHECK(roundTrip(doubles) == doubles);
+
+	std::vector<ui8> bytes(1000, 0xab);
+	BOOST_CHECK(roundTrip(bytes) == bytes);
+
+	std::array<ui16, 5> shorts = {{1, 2, 0xfffe, 0x1234, 0}};
+	BOOST_CHECK(roundTrip(shorts) == shorts);
+
+	//elements which are not primitive are still serialized one by one
+	std::vector<bool> bools(33, true);
+	bools[7] = false;
+	BOOST_CHECK(roundTrip(bools) == bools);
+	std::vector<std::string> strings(3, "text");
+	strings[1].clear();
+	BOOST_CHECK(roundTrip(strings) == strings);
+}
+
+BOOST_AUTO_TEST_CASE(CSerializer_ReverseEndianess)
+{
+	std::vector<ui32> ints; //saved with ui32 length, so whole buffer consists of 4 byte values
+	for(ui32 i = 0; i < 1000; i++)
+		ints.push_back(i * 0x01020304);
+	BOOST_CHECK(loadReversed(ints, sizeof(ui32)) == ints);
+
+	std::array<ui16, 6> shorts = {{0x0102, 0xff00, 0, 1, 0x8000, 0x7fff}};
+	BOOST_CHECK(loadReversed(shorts, sizeof(ui16)) == shorts);
+
+	std::array<si64, 3> longs = {{-1, 0x0102030405060708LL, -0x0102030405060708LL}};
+	BOOST_CHECK(loadReversed(longs, sizeof(si64)) == longs);
+
+	ui32 single = 0xdeadbeef;
+	BOOST_CHECK_EQUAL(loadReversed(single, sizeof(ui32)), single);
+}
+
+BOOST_AUTO_TEST_CASE(CSerializer_MagicBytes)
+{
+	CMemorySaver saver;
+	saver.putMagicBytes("VCMI test");
+	saver << std::string("content");
+
+	CMemoryLoader loader(saver.buffer);
+	loader.checkMagicBytes("VCMI test");
+	std::string content;
+	loader >> content;
+	BOOST_CHECK_EQUAL(content, "content");
+
+	CMemoryLoader otherLoader(saver.buffer);
+	BOOST_CHECK_THROW(otherLoader.checkMagicBytes("VCMI save"), std::runtime_error);
+}